@@ -3,6 +3,7 @@
 
 #include "stdafx.h"
 #include "MovePointBase.h"
+#include "../movepoint/ControlBlock.h"
 
 #define MAX_LOADSTRING 100
 
@@ -13,6 +14,10 @@ TCHAR szWindowClass[MAX_LOADSTRING];			// the main window class name
 LPTSTR myLpCmdLine;
 _PROCESS_INFORMATION controllerProcInfo;		// the actual controller process
 HDEVNOTIFY hde;
+HANDLE hControlMapping;							// control block shared with the controller process
+HANDLE hControlWake;
+movepoint::ControlBlock* control;
+LONG resumeFrames;								// frame count when the controller was last resumed
 
 // Forward declarations of functions included in this code module:
 ATOM				MyRegisterClass(HINSTANCE hInstance);
@@ -24,6 +29,9 @@ void				startController();
 _PROCESS_INFORMATION	startControllerProcess();
 DWORD WINAPI		TerminateApp(DWORD dwPID, DWORD dwTimeout);
 void				TerminateMovePoint();
+BOOL				sendControl(movepoint::controlCommand command);
+void				PauseMovePoint();
+void				ResumeMovePoint(HWND hWnd);
 BOOL				MovePointStillRunning();
 BOOL				duplicateExist();
 
@@ -53,6 +61,10 @@ int APIENTRY _tWinMain(_In_ HINSTANCE hInstance,
 		return FALSE;
 	}
 
+	//open the control block before the controller does, so it outlives controller restarts
+	control = movepoint::controlOpen(hControlMapping);
+	hControlWake = CreateEvent(NULL, FALSE, FALSE, CONTROL_WAKE_NAME);
+
 	//start controller process
 	startController();
 	//system("movepoint.exe");							//system doesn't return a processId
@@ -182,11 +194,21 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		break;
 	case WM_WTSSESSION_CHANGE:
 		if (wParam == WTS_SESSION_LOCK || wParam == WTS_CONSOLE_DISCONNECT) {
-			TerminateMovePoint();
+			PauseMovePoint();
 		}
 		
 		if (wParam == WTS_SESSION_UNLOCK || wParam == WTS_CONSOLE_CONNECT) {
-			startController();
+			ResumeMovePoint(hWnd);
+		}
+		break;
+	case WM_TIMER:
+		if (wParam == IDT_RESUME_CHECK) {
+			KillTimer(hWnd, IDT_RESUME_CHECK);
+			//No frame since resuming: the controllers did not come back, so start over
+			if (control != NULL && control->frames == resumeFrames && sendControl(movepoint::CONTROL_NONE)) {
+				TerminateMovePoint();
+				startController();
+			}
 		}
 		break;
 	case WM_DEVICECHANGE:
@@ -213,10 +235,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			//Is the device a Move controller?
 			if ((vid=="8888" && pid=="0508") || (vid=="054c" && pid=="03d5")) {
 				if (wParam == DBT_DEVICEARRIVAL) {
-					startController();
+					ResumeMovePoint(hWnd);
 				}
 				else if (wParam == DBT_DEVICEREMOVECOMPLETE) {
-					TerminateMovePoint();
+					//Kept warm; if the controller does not come back in place on arrival, it is restarted then
+					PauseMovePoint();
 				}
 			}
 			else {
@@ -230,7 +253,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
 		break;
 	//Move controllers sleep pretty much immediately after system suspend, 
-	//so we can simply terminate the actual controller thread
+	//so the controller is paused and checked for frames after resume
 	case WM_ENDSESSION:
 		if (wParam == TRUE) {
 			//shutting down
@@ -241,7 +264,10 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	case WM_POWERBROADCAST:
 		if (wParam == PBT_APMSUSPEND) {
 			//System suspending
-			TerminateMovePoint();
+			PauseMovePoint();
+		}
+		else if (wParam == PBT_APMRESUMEAUTOMATIC) {
+			ResumeMovePoint(hWnd);
 		}
 		return DefWindowProc(hWnd, message, wParam, lParam);
 		break;
@@ -345,8 +371,38 @@ DWORD WINAPI TerminateApp(DWORD dwPID, DWORD dwTimeout)
 	return dwRet;
 }
 
+//Posts a command to the running controller. Fails if there is none, it has stopped beating,
+//or it is still starting up and would drop the command. CONTROL_NONE posts nothing and only checks.
+BOOL sendControl(movepoint::controlCommand command) {
+	if (control == NULL || controllerProcInfo.dwProcessId == NULL || !MovePointStillRunning()) return false;
+	if ((DWORD)control->workerPid != controllerProcInfo.dwProcessId || !movepoint::controlAlive(control)) return false;
+	if (command == movepoint::CONTROL_NONE) return true;
+	if (control->state == movepoint::WORKER_STARTING) return false;
+
+	if (!movepoint::controlPost(control, command)) return false;
+	SetEvent(hControlWake);
+	return true;
+}
+
+//Keeps the process, its paired controllers and camera; falls back to terminating it
+void PauseMovePoint() {
+	if (!sendControl(movepoint::CONTROL_PAUSE)) TerminateMovePoint();
+}
+
+//Resumes a paused controller in place, or starts one if it is not running
+void ResumeMovePoint(HWND hWnd) {
+	if (sendControl(movepoint::CONTROL_RESUME)) {
+		resumeFrames = control->frames;
+		SetTimer(hWnd, IDT_RESUME_CHECK, RESUME_CHECK_MS, NULL);
+	}
+	else {
+		startController();
+	}
+}
+
 void TerminateMovePoint() {
-	TerminateApp(controllerProcInfo.dwProcessId, 0);
+	//Give it a moment to release the keys and buttons it holds down
+	TerminateApp(controllerProcInfo.dwProcessId, 500);
 	ZeroMemory(&controllerProcInfo, sizeof(_PROCESS_INFORMATION));
 }
 
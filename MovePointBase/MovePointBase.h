@@ -6,3 +6,6 @@
 #define TA_SUCCESS_CLEAN 1
 #define TA_SUCCESS_KILL 2
 #define TA_SUCCESS_16 3
+
+#define IDT_RESUME_CHECK 1
+#define RESUME_CHECK_MS 5000				// a resumed worker that sends no frame by then is restarted
@@ -0,0 +1,297 @@
+#include "stdafx.h"
+#include "AppProfiles.h"
+#include "win_actions.h"
+
+#include <ctype.h>
+
+using namespace win_actions;
+
+namespace movepoint {
+
+	//Registry value names, in appAction order
+	static const char* actionNames[ACTION_COUNT] = {
+		"zoomIn", "zoomOut", "back", "forward", "triangle", "circle", "square", "cross", "l"
+	};
+
+	struct NamedKey
+	{
+		const char* name;
+		BYTE vk;
+	};
+
+	static const NamedKey namedKeys[] = {
+		{ "tab", VK_TAB }, { "esc", VK_ESCAPE }, { "enter", VK_RETURN }, { "space", VK_SPACE },
+		{ "backspace", VK_BACK }, { "delete", VK_DELETE }, { "insert", VK_INSERT },
+		{ "left", VK_LEFT }, { "right", VK_RIGHT }, { "up", VK_UP }, { "down", VK_DOWN },
+		{ "pageup", VK_PRIOR }, { "pagedown", VK_NEXT }, { "home", VK_HOME }, { "end", VK_END },
+		{ "plus", VK_OEM_PLUS }, { "minus", VK_OEM_MINUS }, { "printscreen", VK_SNAPSHOT },
+		{ "lbutton", VK_LBUTTON }, { "rbutton", VK_RBUTTON }, { "mbutton", VK_MBUTTON },
+		{ "none", chordNone }
+	};
+
+	//Case-insensitive match against a semicolon separated list
+	static bool listContains(const char* list, const char* name) {
+		size_t len = strlen(name);
+		if (len == 0) return false;
+
+		const char* p = list;
+		while (*p != 0) {
+			const char* end = strchr(p, ';');
+			size_t itemLen = (end != NULL ? (size_t)(end - p) : strlen(p));
+			if (itemLen == len && _strnicmp(p, name, len) == 0) return true;
+			if (end == NULL) break;
+			p = end + 1;
+		}
+		return false;
+	}
+
+	/* "ctrl+shift+tab", "f5", "wheelup", "rbutton", "none". Letters and digits stand for
+	their own key. An empty string is the built-in behaviour. */
+	bool parseChord(const char* text, KeyChord & out) {
+		KeyChord c;
+		ZeroMemory(&c, sizeof(c));
+
+		char token[32];
+		const char* p = text;
+		while (*p != 0) {
+			const char* end = strchr(p, '+');
+			size_t len = (end != NULL ? (size_t)(end - p) : strlen(p));
+			if (len == 0 || len >= sizeof(token)) return false;
+			for (size_t i = 0; i < len; i++) token[i] = (char)tolower((unsigned char)p[i]);
+			token[len] = 0;
+
+			if (strcmp(token, "ctrl") == 0) c.modifiers |= CHORD_CTRL;
+			else if (strcmp(token, "alt") == 0) c.modifiers |= CHORD_ALT;
+			else if (strcmp(token, "shift") == 0) c.modifiers |= CHORD_SHIFT;
+			else if (strcmp(token, "win") == 0) c.modifiers |= CHORD_WIN;
+			else if (strcmp(token, "wheelup") == 0) c.wheel = 1;
+			else if (strcmp(token, "wheeldown") == 0) c.wheel = -1;
+			else if (len == 1 && isalnum((unsigned char)token[0])) c.vk = (BYTE)toupper((unsigned char)token[0]);
+			else if (token[0] == 'f' && isdigit((unsigned char)token[1]) && atoi(token + 1) >= 1 && atoi(token + 1) <= 24) c.vk = (BYTE)(VK_F1 + atoi(token + 1) - 1);
+			else {
+				bool found = false;
+				for (int i = 0; i < sizeof(namedKeys) / sizeof(namedKeys[0]); i++) {
+					if (strcmp(token, namedKeys[i].name) == 0) {
+						c.vk = namedKeys[i].vk;
+						found = true;
+						break;
+					}
+				}
+				if (!found) return false;
+			}
+
+			if (end == NULL) break;
+			p = end + 1;
+		}
+
+		out = c;
+		return true;
+	}
+
+	static void pressModifiers(BYTE modifiers, byte keyState) {
+		if (modifiers & CHORD_CTRL) keyPress(VK_CONTROL, keyState);
+		if (modifiers & CHORD_ALT) keyPress(VK_MENU, keyState);
+		if (modifiers & CHORD_SHIFT) keyPress(VK_SHIFT, keyState);
+		if (modifiers & CHORD_WIN) keyPress(VK_LWIN, keyState);
+	}
+
+	//Modifiers go down before the key and come up after it. A wheel notch is sent on the press.
+	void pressChord(const KeyChord & c, byte keyState) {
+		if (c.vk == chordNone) return;
+
+		if (keyState == 1) pressModifiers(c.modifiers, 1);
+
+		if (c.wheel != 0) {
+			if (keyState == 1) mouse_event(MOUSEEVENTF_WHEEL, 0, 0, c.wheel * WHEEL_DELTA, 0);
+		}
+		else if (c.vk == VK_LBUTTON) mousePress(1, keyState);
+		else if (c.vk == VK_MBUTTON) mousePress(2, keyState);
+		else if (c.vk == VK_RBUTTON) mousePress(3, keyState);
+		else if (c.vk != 0) keyPress(c.vk, keyState);
+
+		if (keyState == 0) pressModifiers(c.modifiers, 0);
+	}
+
+	AppProfiles::AppProfiles() {
+		ZeroMemory(held, sizeof(held));
+		addBuiltIns();
+		current = &profiles[0];
+	}
+
+	/* Starting points for the kinds of program that want something else. Any of them can be
+	replaced by a registry profile of the same name. */
+	void AppProfiles::addBuiltIns() {
+		static const char* builtIns[][3 + ACTION_COUNT] = {
+			//name, image names, window classes, then one chord per appAction
+			{ "default", "", "",
+				"", "", "", "", "", "", "", "", "" },
+			{ "presentation", "powerpnt.exe;pptview.exe", "screenClass",
+				"", "", "pageup", "pagedown", "", "b", "", "", "f5" },
+			{ "browser", "chrome.exe;msedge.exe;firefox.exe;opera.exe", "",
+				"", "", "", "", "", "", "", "", "ctrl+tab" },
+			{ "cad", "acad.exe;sldworks.exe;fusion360.exe;freecad.exe", "",
+				"wheelup", "wheeldown", "", "", "", "", "", "", "" },
+		};
+
+		for (int i = 0; i < sizeof(builtIns) / sizeof(builtIns[0]); i++) {
+			AppProfile p;
+			ZeroMemory(&p, sizeof(p));
+			strncpy(p.name, builtIns[i][0], sizeof(p.name) - 1);
+			strncpy(p.exeNames, builtIns[i][1], sizeof(p.exeNames) - 1);
+			strncpy(p.classNames, builtIns[i][2], sizeof(p.classNames) - 1);
+			for (int a = 0; a < ACTION_COUNT; a++) parseChord(builtIns[i][3 + a], p.chords[a]);
+			profiles.push_back(p);
+		}
+	}
+
+	//Before the shell event thread starts. The profile list does not change afterwards.
+	void AppProfiles::load() {
+		HKEY hKey;
+		if (RegOpenKeyEx(HKEY_CURRENT_USER, PROFILES_KEY, 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+			char name[sizeof(AppProfile::name)];
+			DWORD index = 0;
+			DWORD len = sizeof(name);
+			while (RegEnumKeyEx(hKey, index++, name, &len, NULL, NULL, NULL, NULL) == ERROR_SUCCESS) {
+				HKEY hProfile;
+				if (RegOpenKeyEx(hKey, name, 0, KEY_READ, &hProfile) == ERROR_SUCCESS) {
+					loadKey(hProfile, name);
+					RegCloseKey(hProfile);
+				}
+				len = sizeof(name);
+			}
+			RegCloseKey(hKey);
+		}
+
+		byWindow.clear();
+		byProcess.clear();
+		InterlockedExchangePointer((PVOID volatile *)&current, (PVOID)&profiles[0]);
+		print();
+	}
+
+	void AppProfiles::loadKey(HKEY hKey, const char* name) {
+		AppProfile* p = nullptr;
+		for (size_t i = 0; i < profiles.size(); i++) {
+			if (_stricmp(profiles[i].name, name) == 0) p = &profiles[i];
+		}
+		if (p == nullptr) {
+			AppProfile added;
+			ZeroMemory(&added, sizeof(added));
+			strncpy(added.name, name, sizeof(added.name) - 1);
+			profiles.push_back(added);
+			p = &profiles.back();
+		}
+
+		readStringFromReg(hKey, TEXT("exe"), p->exeNames, sizeof(p->exeNames));
+		readStringFromReg(hKey, TEXT("class"), p->classNames, sizeof(p->classNames));
+
+		char text[64];
+		for (int a = 0; a < ACTION_COUNT; a++) {
+			text[0] = 0;
+			if (readStringFromReg(hKey, (LPTSTR)actionNames[a], text, sizeof(text)) != ERROR_SUCCESS) continue;
+			if (!parseChord(text, p->chords[a])) printf("Profile %s: cannot read %s = \"%s\" \n", p->name, actionNames[a], text);
+		}
+	}
+
+	int AppProfiles::matchClass(const char* className) const {
+		for (size_t i = 1; i < profiles.size(); i++) {
+			if (listContains(profiles[i].classNames, className)) return (int)i;
+		}
+		return 0;
+	}
+
+	int AppProfiles::matchExe(const char* exeName) const {
+		for (size_t i = 1; i < profiles.size(); i++) {
+			if (listContains(profiles[i].exeNames, exeName)) return (int)i;
+		}
+		return 0;
+	}
+
+	//Shell event thread
+	int AppProfiles::resolve(HWND hWnd) {
+		std::unordered_map<HWND, int>::const_iterator w = byWindow.find(hWnd);
+		if (w != byWindow.end()) return w->second;
+
+		if (byWindow.size() >= profileCacheMax_d) {
+			//Process ids get reused too, and windows of a long-lived process come and go
+			byWindow.clear();
+			byProcess.clear();
+		}
+
+		char className[128];
+		int profile = 0;
+		if (GetClassName(hWnd, className, sizeof(className)) > 0) profile = matchClass(className);
+
+		if (profile == 0) {
+			DWORD pid = 0;
+			GetWindowThreadProcessId(hWnd, &pid);
+			std::unordered_map<DWORD, int>::const_iterator p = byProcess.find(pid);
+			if (p != byProcess.end()) {
+				profile = p->second;
+			}
+			else {
+				HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+				if (hProcess != NULL) {
+					char path[MAX_PATH];
+					DWORD size = sizeof(path);
+					if (QueryFullProcessImageName(hProcess, 0, path, &size)) {
+						const char* exeName = strrchr(path, '\\');
+						profile = matchExe(exeName != NULL ? exeName + 1 : path);
+					}
+					CloseHandle(hProcess);
+				}
+				byProcess[pid] = profile;
+			}
+		}
+
+		byWindow[hWnd] = profile;
+		return profile;
+	}
+
+	//Shell event thread. Returns true if a different profile is now active.
+	bool AppProfiles::foregroundChanged(HWND hWnd) {
+		if (hWnd == NULL || hWnd == lastForeground) return false;
+		lastForeground = hWnd;
+
+		HWND root = GetAncestor(hWnd, GA_ROOT);
+		const AppProfile* next = &profiles[resolve(root != NULL ? root : hWnd)];
+		if (next == current) return false;
+
+		InterlockedExchangePointer((PVOID volatile *)&current, (PVOID)next);
+		return true;
+	}
+
+	//Shell event thread. The handle may come back for another window, which has to be resolved again.
+	void AppProfiles::windowDestroyed(HWND hWnd) {
+		byWindow.erase(hWnd);
+		if (hWnd == lastForeground) lastForeground = NULL;
+	}
+
+	//Held action: returns false if the active profile leaves it to the built-in behaviour
+	bool AppProfiles::press(appAction action, byte keyState) {
+		if (keyState == 1) held[action] = current->chords[action];
+
+		const KeyChord & c = held[action];
+		if (c.vk == 0 && c.wheel == 0) return false;
+
+		pressChord(c, keyState);
+		if (keyState == 0) ZeroMemory(&held[action], sizeof(KeyChord));
+		return true;
+	}
+
+	//Click action: returns false if the active profile leaves it to the built-in behaviour
+	bool AppProfiles::click(appAction action) {
+		const KeyChord c = current->chords[action];
+		if (c.vk == 0 && c.wheel == 0) return false;
+
+		pressChord(c, 1);
+		pressChord(c, 0);
+		return true;
+	}
+
+	void AppProfiles::print() const {
+		printf("PROFILES:");
+		for (size_t i = 0; i < profiles.size(); i++) printf(" %s", profiles[i].name);
+		printf("\n");
+	}
+
+}
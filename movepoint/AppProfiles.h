@@ -0,0 +1,96 @@
+#pragma once
+#include "stdafx.h"
+
+#include <vector>
+#include <unordered_map>
+
+namespace movepoint {
+
+	//Default values
+	const int profileCacheMax_d = 256;			//Windows remembered before the cache starts over. Closed windows are dropped as they go.
+	#define PROFILES_KEY TEXT("SOFTWARE\\MOVEpoint\\Profiles")
+
+	//Button actions a profile can rebind. The value names in the registry are in AppProfiles.cpp.
+	enum appAction
+	{
+		ACTION_ZOOM_IN = 0,					//Zoom mode, up
+		ACTION_ZOOM_OUT = 1,				//Zoom mode, down
+		ACTION_BACK = 2,					//Zoom mode, left
+		ACTION_FORWARD = 3,					//Zoom mode, right
+		ACTION_TRIANGLE = 4,				//Mouse mode, held with the button
+		ACTION_CIRCLE = 5,					//Mouse mode, held with the button
+		ACTION_SQUARE = 6,					//Quick click
+		ACTION_CROSS = 7,					//Quick click
+		ACTION_L = 8,						//Quick click
+		ACTION_COUNT = 9
+	};
+
+	const BYTE chordNone = 0xFF;			//vk of a chord that does nothing
+
+	enum chordModifier
+	{
+		CHORD_CTRL = 1,
+		CHORD_ALT = 2,
+		CHORD_SHIFT = 4,
+		CHORD_WIN = 8
+	};
+
+	//Modifiers plus one key, mouse button or wheel notch. All zero = the built-in behaviour.
+	struct KeyChord
+	{
+		BYTE modifiers;
+		BYTE vk;
+		short wheel;						//+1 up, -1 down
+	};
+
+	struct AppProfile
+	{
+		char name[32];
+		char exeNames[128];					//Semicolon separated process image names, e.g. "chrome.exe;msedge.exe"
+		char classNames[128];				//Semicolon separated top-level window classes. Checked before the image name.
+		KeyChord chords[ACTION_COUNT];
+	};
+
+	bool parseChord(const char* text, KeyChord & out);
+	void pressChord(const KeyChord & c, byte keyState);
+
+	/* Button bindings per application. Profiles come from a few built-ins and from
+	HKCU\SOFTWARE\MOVEpoint\Profiles\<name>, one subkey each, and are fixed after load().
+
+	The shell event thread resolves the new foreground window when it changes and
+	publishes the matching profile by pointer, so button handlers read one pointer and
+	nothing is looked up per frame. Windows and processes already seen are cached, so
+	switching back and forth does not open the process again. */
+	class AppProfiles
+	{
+		std::vector<AppProfile> profiles;			//[0] is the default profile
+		const AppProfile* volatile current = nullptr;
+
+		//Shell event thread only
+		std::unordered_map<HWND, int> byWindow;
+		std::unordered_map<DWORD, int> byProcess;
+		HWND lastForeground = NULL;
+
+		//Button handlers only. The chord a press sent, so the release matches it even if the profile changed in between.
+		KeyChord held[ACTION_COUNT];
+
+		void addBuiltIns();
+		void loadKey(HKEY hKey, const char* name);
+		int resolve(HWND hWnd);
+		int matchClass(const char* className) const;
+		int matchExe(const char* exeName) const;
+
+	public:
+		AppProfiles();
+
+		void load();
+		bool foregroundChanged(HWND hWnd);
+		void windowDestroyed(HWND hWnd);
+		inline const AppProfile* get() const { return current; }
+
+		bool press(appAction action, byte keyState);
+		bool click(appAction action);
+		void print() const;
+	};
+
+}
@@ -0,0 +1,135 @@
+#include "stdafx.h"
+#include "ColorLut.h"
+
+namespace movepoint {
+
+	ColorLut::ColorLut() {
+		for (int i = 0; i < maxEyeControllers; i++) {
+			simTables[i] = NULL;
+			simActive[i] = false;
+		}
+	}
+
+	ColorLut::~ColorLut() {
+		freeTables();
+	}
+
+	void ColorLut::freeTables() {
+		delete[] hsvTable;
+		delete[] hsiTable;
+		hsvTable = NULL;
+		hsiTable = NULL;
+		for (int i = 0; i < maxEyeControllers; i++) {
+			delete[] simTables[i];
+			simTables[i] = NULL;
+		}
+	}
+
+	//Build the colour space tables. A change of quantization drops the controller targets.
+	void ColorLut::build(int inBits) {
+		inBits = max(min(inBits, lutBitsMax), lutBitsMin);
+		if (inBits == bits && hsvTable != NULL) return;
+
+		freeTables();
+		bits = inBits;
+		shift = 8 - bits;
+		entries = 1 << (3 * bits);
+
+		hsvTable = new LutColor[entries];
+		hsiTable = new LutColor[entries];
+		for (int i = 0; i < maxEyeControllers; i++) {
+			simTables[i] = new unsigned char[entries];
+			ZeroMemory(simTables[i], entries);
+			simActive[i] = false;
+		}
+
+		int levels = 1 << bits;
+		int half = (1 << shift) >> 1;
+		for (int r = 0; r < levels; r++) {
+			for (int g = 0; g < levels; g++) {
+				for (int b = 0; b < levels; b++) {
+					Move::ColorRgb rgb((r << shift) + half, (g << shift) + half, (b << shift) + half);
+					int i = (r << (2 * bits)) | (g << bits) | b;
+
+					Move::ColorHsv c(rgb);
+					hsvTable[i].h = (unsigned short)(c.h * 100 + 0.5f);
+					hsvTable[i].s = (unsigned char)(c.s * 255 + 0.5f);
+					hsvTable[i].v = (unsigned char)(c.v * 255 + 0.5f);
+
+					Move::ColorHsi d(rgb);
+					hsiTable[i].h = (unsigned short)(d.h * 100 + 0.5f);
+					hsiTable[i].s = (unsigned char)(max(min(d.s, 1.0f), 0.0f) * 255 + 0.5f);
+					hsiTable[i].v = (unsigned char)(d.i * 255 + 0.5f);
+				}
+			}
+		}
+
+		print();
+	}
+
+	bool ColorLut::isBuilt() const {
+		return hsvTable != NULL;
+	}
+
+	int ColorLut::getBits() const {
+		return bits;
+	}
+
+	int ColorLut::getEntries() const {
+		return entries;
+	}
+
+	size_t ColorLut::tableBytes() const {
+		if (hsvTable == NULL) return 0;
+		return (size_t)entries * (2 * sizeof(LutColor) + maxEyeControllers);
+	}
+
+	void ColorLut::print() const {
+		int active = 0;
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (simActive[i]) active++;
+		}
+		printf("COLOR LUT bits:%d  entries:%d  memory:%.1f KB  targets:%d\n",
+			bits, entries, tableBytes() / 1024.0, active);
+	}
+
+	//Only this controller's table is rebuilt, from the HSV table rather than from RGB
+	void ColorLut::setTarget(int moveId, Move::ColorHsv target) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return;
+		if (hsvTable == NULL) build();
+
+		target.s = 1;
+		target.v = 1;
+		unsigned char* table = simTables[moveId];
+		for (int i = 0; i < entries; i++) {
+			Move::ColorHsv c(hsvTable[i].h / 100.0f, hsvTable[i].s / 255.0f, hsvTable[i].v / 255.0f);
+			table[i] = (unsigned char)(target.similarity(c) + 0.5f);
+		}
+		simActive[moveId] = true;
+	}
+
+	void ColorLut::clearTarget(int moveId) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return;
+		simActive[moveId] = false;
+		if (simTables[moveId] != NULL) ZeroMemory(simTables[moveId], entries);
+	}
+
+	void ColorLut::clearTargets() {
+		for (int i = 0; i < maxEyeControllers; i++) clearTarget(i);
+	}
+
+	bool ColorLut::hasTarget(int moveId) const {
+		return moveId >= 0 && moveId < maxEyeControllers && simActive[moveId];
+	}
+
+	Move::ColorHsv ColorLut::hsv(int r, int g, int b) const {
+		const LutColor & c = hsvTable[index(r, g, b)];
+		return Move::ColorHsv(c.h / 100.0f, c.s / 255.0f, c.v / 255.0f);
+	}
+
+	Move::ColorHsi ColorLut::hsi(int r, int g, int b) const {
+		const LutColor & c = hsiTable[index(r, g, b)];
+		return Move::ColorHsi(c.h / 100.0f, c.s / 255.0f, c.v / 255.0f);
+	}
+
+}
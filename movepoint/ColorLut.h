@@ -0,0 +1,64 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "MoveColors.h"
+
+namespace movepoint {
+
+	//Default values
+	const int lutBits_d = 5;				//Bits kept per colour channel. 5 = 32K entries, 6 = 256K entries.
+	const int lutBitsMin = 3;
+	const int lutBitsMax = 7;
+
+	//Quantized colour. Hue in hundredths of a degree, saturation and value/intensity scaled to 0..255.
+	struct LutColor
+	{
+		unsigned short h;
+		unsigned char s, v;
+	};
+
+	/* Quantized RGB lookup tables replacing the per-pixel ColorHsv/ColorHsi constructors.
+	The HSV and HSI tables depend only on the quantization and are built once; each
+	controller additionally gets a table of similarity scores against its sphere colour,
+	rebuilt on its own whenever that colour changes. Entries are computed at bin centres. */
+	class ColorLut
+	{
+		int bits = 0, shift = 0, entries = 0;
+
+		LutColor* hsvTable = NULL;
+		LutColor* hsiTable = NULL;
+		unsigned char* simTables[maxEyeControllers];		//ColorHsv::similarity, rounded to 0..100
+		bool simActive[maxEyeControllers];
+
+		void freeTables();
+
+	public:
+		ColorLut();
+		~ColorLut();
+
+		void build(int inBits = lutBits_d);
+		bool isBuilt() const;
+		int getBits() const;
+		int getEntries() const;
+		size_t tableBytes() const;
+		void print() const;
+
+		void setTarget(int moveId, Move::ColorHsv target);
+		void clearTarget(int moveId);
+		void clearTargets();
+		bool hasTarget(int moveId) const;
+
+		inline int index(int r, int g, int b) const {
+			return ((r >> shift) << (2 * bits)) | ((g >> shift) << bits) | (b >> shift);
+		}
+		Move::ColorHsv hsv(int r, int g, int b) const;
+		Move::ColorHsi hsi(int r, int g, int b) const;
+		inline unsigned char similarity(int moveId, int r, int g, int b) const {
+			return simTables[moveId][index(r, g, b)];
+		}
+		inline const unsigned char* getSimilarityTable(int moveId) const {
+			return simTables[moveId];
+		}
+	};
+
+}
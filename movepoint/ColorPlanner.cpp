@@ -0,0 +1,178 @@
+#include "stdafx.h"
+#include "ColorPlanner.h"
+#include "MoveColors.h"
+
+#include <process.h>
+
+namespace movepoint {
+
+	ColorPlanner::ColorPlanner() {
+		ZeroMemory(histogram, sizeof(histogram));
+		ZeroMemory(hues, sizeof(hues));
+		ZeroMemory(planned, sizeof(planned));
+	}
+
+	ColorPlanner::~ColorPlanner() {
+		stop();
+	}
+
+	//Every other row and every fourth pixel is plenty for a histogram
+	void ColorPlanner::buildHistogram(const unsigned char* frame, int width, int height, const EyeResult* exclude) {
+		ZeroMemory(histogram, sizeof(histogram));
+		samples = 0;
+		if (frame == NULL) return;
+
+		for (int y = 0; y < height; y += 2) {
+			for (int x = 0; x < width; x += 4) {
+				//Leave out the spheres, otherwise their own colour reads as contamination
+				bool sphere = false;
+				for (int i = 0; exclude != nullptr && i < maxEyeControllers; i++) {
+					const SphereTrack & t = exclude->tracks[i];
+					if (!t.found) continue;
+					float dx = x - t.x, dy = y - t.y, r = t.radius * 1.5f + 2;
+					if (dx * dx + dy * dy < r * r) sphere = true;
+				}
+				if (sphere) continue;
+
+				samples++;
+				const unsigned char* px = frame + (y * width + x) * eyeBytesPerPixel;
+				Move::ColorHsv hsv(Move::ColorRgb(px[2], px[1], px[0]));
+				if (hsv.v < minValue || hsv.s == 0) continue;
+
+				int h = min((int)(hsv.h * plannerHueBins / 360), plannerHueBins - 1);
+				int s = min((int)(hsv.s * plannerSatBins), plannerSatBins - 1);
+				histogram[h][s]++;
+			}
+		}
+	}
+
+	//Share of the frame that would pass the segmentation cut for a sphere of this hue
+	float ColorPlanner::contamination(float hue) const {
+		if (samples == 0) return 0;
+
+		float passing = 0;
+		for (int h = 0; h < plannerHueBins; h++) {
+			float d = fabs((h + 0.5f) * 360 / plannerHueBins - hue);
+			d = min(d, 360 - d);
+			if (d >= 100) continue;
+
+			for (int s = 0; s < plannerSatBins; s++) {
+				float sat = (s + 0.5f) / plannerSatBins;
+				if ((100 - d) * sat >= minSimilarity) passing += histogram[h][s];
+			}
+		}
+		return passing / samples;
+	}
+
+	int ColorPlanner::plan(int numControllers) {
+		count = max(min(numControllers, maxEyeControllers), 0);
+		const int candidates = 72;
+
+		for (int i = 0; i < count; i++) {
+			float bestHue = 0, bestCost = 1e9f, bestSeparation = -1;
+			float fallbackHue = 0;
+
+			for (int c = 0; c < candidates; c++) {
+				float hue = c * 360.0f / candidates;
+				float separation = 360;
+				for (int j = 0; j < i; j++) {
+					float d = fabs(hue - hues[j]);
+					separation = min(separation, min(d, 360 - d));
+				}
+				if (separation > bestSeparation) {
+					bestSeparation = separation;
+					fallbackHue = hue;
+				}
+				if (separation < minSeparation) continue;
+
+				//Least contaminated wins; among equals, the one furthest from the other spheres
+				float cost = contamination(hue) - separation * 0.000001f;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestHue = hue;
+				}
+			}
+
+			//Too many controllers for the separation: spread them as far apart as possible
+			hues[i] = (bestCost < 1e9f ? bestHue : fallbackHue);
+			planned[i] = contamination(hues[i]);
+		}
+		return count;
+	}
+
+	bool ColorPlanner::needsReplan() const {
+		for (int i = 0; i < count; i++) {
+			float now = contamination(hues[i]);
+			if (now > planned[i] * contaminationRise_d && now > planned[i] + contaminationFloor_d) return true;
+		}
+		return false;
+	}
+
+	float ColorPlanner::getHue(int moveId) const {
+		return hues[moveId];
+	}
+
+	BOOL ColorPlanner::start(Move::IEyeController* inEye, EyePipeline* inPipeline, IColorListener* inListener, int numControllers) {
+		if (hThread != NULL || inEye == nullptr || inPipeline == nullptr) return false;
+
+		eye = inEye;
+		pipeline = inPipeline;
+		listener = inListener;
+		count = max(min(numControllers, maxEyeControllers), 0);
+
+		int width, height;
+		eye->getEyeDimensions(width, height);
+		frameCopy = new unsigned char[width * height * eyeBytesPerPixel];
+
+		hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		return hThread != NULL;
+	}
+
+	void ColorPlanner::stop() {
+		if (hThread == NULL) return;
+
+		//A plan in progress finishes first; frameCopy is freed below
+		SetEvent(hStop);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		CloseHandle(hStop);
+		hThread = NULL;
+		hStop = NULL;
+		delete[] frameCopy;
+		frameCopy = NULL;
+	}
+
+	unsigned int __stdcall ColorPlanner::threadProc(void *p_thread_data) {
+		ColorPlanner* self = static_cast<ColorPlanner*>(p_thread_data);
+		int width, height;
+		self->eye->getEyeDimensions(width, height);
+		bool first = true;
+
+		do {
+			//Frame and result from the same fusion pass, so the excluded spheres line up
+			EyeResult result;
+			if (!self->pipeline->snapshot(self->frameCopy, result, snapshotWaitMs_d)) continue;
+			self->buildHistogram(self->frameCopy, width, height, &result);
+
+			if (first || self->needsReplan()) {
+				self->plan(self->count);
+				self->print();
+				if (self->listener != nullptr) self->listener->colorsPlanned(self->count, self->hues);
+				first = false;
+			}
+		} while (WaitForSingleObject(self->hStop, self->replanMs) == WAIT_TIMEOUT);
+
+		return 0;
+	}
+
+	void ColorPlanner::print() const {
+		printf("COLORS planned for %d controller(s):", count);
+		for (int i = 0; i < count; i++) {
+			printf("  hue %.0f (%.2f%%)", hues[i], contamination(hues[i]) * 100);
+		}
+		printf("\n");
+	}
+
+}
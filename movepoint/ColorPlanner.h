@@ -0,0 +1,67 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "EyePipeline.h"
+
+namespace movepoint {
+
+	//Default values
+	const int plannerHueBins = 72;				//5 degrees each
+	const int plannerSatBins = 8;
+	const float minHueSeparation_d = 70;		//Degrees between sphere hues. Above 60 the similarity cut never confuses two spheres.
+	const DWORD replanMs_d = 5000;				//How often the scene is checked again
+	const float contaminationRise_d = 2;		//Re-plan once a hue's contamination grows this many times over its planned value...
+	const float contaminationFloor_d = 0.001f;	//...and by at least this share of the frame
+	const DWORD snapshotWaitMs_d = 500;			//How long to wait for a frame from the pipeline
+
+	//Receives new sphere colours on the planner thread
+	class IColorListener
+	{
+	public:
+		virtual void colorsPlanned(int count, const float* hues) {}
+	};
+
+	/* Picks sphere hues the room does not already contain. A hue/saturation histogram of
+	bright scene pixels (spheres themselves left out) gives, for every candidate hue, the
+	share of the frame that would pass the segmentation cut. Hues are chosen greedily,
+	least contaminated first, keeping them far enough apart not to match each other.
+	Frames come from the running pipeline, never straight from the camera. */
+	class ColorPlanner
+	{
+		float histogram[plannerHueBins][plannerSatBins];
+		float samples = 0;
+
+		int count = 0;
+		float hues[maxEyeControllers];
+		float planned[maxEyeControllers];			//Contamination of each hue when it was chosen
+
+		Move::IEyeController* eye = nullptr;
+		EyePipeline* pipeline = nullptr;
+		IColorListener* listener = nullptr;
+		HANDLE hThread = NULL;
+		HANDLE hStop = NULL;
+		unsigned char* frameCopy = NULL;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+
+	public:
+		float minSimilarity = segMinSimilarity_d;
+		float minValue = segMinValue_d;
+		float minSeparation = minHueSeparation_d;
+		DWORD replanMs = replanMs_d;
+
+		ColorPlanner();
+		~ColorPlanner();
+
+		void buildHistogram(const unsigned char* frame, int width, int height, const EyeResult* exclude = nullptr);
+		float contamination(float hue) const;
+		int plan(int numControllers);
+		bool needsReplan() const;
+		float getHue(int moveId) const;
+
+		BOOL start(Move::IEyeController* inEye, EyePipeline* inPipeline, IColorListener* inListener, int numControllers);
+		void stop();
+		void print() const;
+	};
+
+}
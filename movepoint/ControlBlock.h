@@ -0,0 +1,99 @@
+#pragma once
+#include <windows.h>
+
+//Shared with MovePointBase, so this header depends on nothing else in movepoint
+#define CONTROL_BLOCK_NAME TEXT("Local\\movepoint-control-124712857")
+#define CONTROL_WAKE_NAME TEXT("Local\\movepoint-control-wake-124712857")
+
+namespace movepoint {
+
+	const LONG controlVersion = 2;
+	const int controlMailboxSize = 8;
+	const DWORD controlHeartbeatMs = 250;		//The worker beats at least this often while its sensor thread makes progress
+	const DWORD controlStaleMs = 2000;			//No beat for this long: the worker is hung or gone
+
+	enum controlCommand
+	{
+		CONTROL_NONE = 0,
+		CONTROL_PAUSE = 1,						//Stop acting on the controller and give up the camera, keep the controllers
+		CONTROL_RESUME = 2,
+		CONTROL_RECALIBRATE = 3,				//Same as a long PS click
+		CONTROL_RELOAD = 4						//Read settings from the registry again
+	};
+
+	enum workerState
+	{
+		WORKER_STARTING = 0,					//Not taking commands yet
+		WORKER_RUNNING = 1,
+		WORKER_PAUSED = 2,
+		WORKER_STOPPED = 3
+	};
+
+	/* Lives in a named page-file mapping that both processes open; whichever comes first
+	creates it zeroed. The supervisor writes the mailbox and the worker everything else.
+	The mailbox is a ring with one writer and one reader, like SpscQueue, but indexed by
+	running counts so it needs no pointers and survives the worker restarting. */
+	struct ControlBlock
+	{
+		LONG version;
+		volatile LONG workerPid;
+		volatile LONG state;					//workerState
+		volatile LONG heartbeat;				//GetTickCount of the last beat; while running, only if frames advanced
+
+		volatile LONG posted;					//Commands written, supervisor owned
+		volatile LONG taken;					//Commands read, worker owned
+		volatile LONG mailbox[controlMailboxSize];
+
+		//Status counters
+		volatile LONG numMoves;
+		volatile LONG frames;
+		volatile LONG pauses;
+		volatile LONG resumes;
+		volatile LONG recalibrations;
+		volatile LONG reloads;
+		volatile LONG resumeMs;					//Resume to first tracked frame, last time round
+	};
+
+	//Supervisor side. Returns false when the mailbox is full.
+	inline bool controlPost(ControlBlock* block, controlCommand command) {
+		LONG p = block->posted;
+		if (p - block->taken >= controlMailboxSize) return false;
+
+		block->mailbox[p % controlMailboxSize] = command;
+		InterlockedExchange(&block->posted, p + 1);
+		return true;
+	}
+
+	//Worker side. Returns CONTROL_NONE when the mailbox is empty.
+	inline controlCommand controlTake(ControlBlock* block) {
+		LONG t = block->taken;
+		if (t == block->posted) return CONTROL_NONE;
+
+		controlCommand command = (controlCommand)block->mailbox[t % controlMailboxSize];
+		InterlockedExchange(&block->taken, t + 1);
+		return command;
+	}
+
+	//Either side
+	inline bool controlAlive(const ControlBlock* block) {
+		return block->workerPid != 0 && block->state != WORKER_STOPPED
+			&& GetTickCount() - (DWORD)block->heartbeat < controlStaleMs;
+	}
+
+	//Either side. Creates the mapping if the other process has not. Returns NULL on a version mismatch.
+	inline ControlBlock* controlOpen(HANDLE & hMapping) {
+		hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(ControlBlock), CONTROL_BLOCK_NAME);
+		if (hMapping == NULL) return NULL;
+
+		ControlBlock* block = (ControlBlock*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ControlBlock));
+		if (block != NULL) {
+			InterlockedCompareExchange((volatile LONG*)&block->version, controlVersion, 0);
+			if (block->version == controlVersion) return block;
+			UnmapViewOfFile(block);
+		}
+		CloseHandle(hMapping);
+		hMapping = NULL;
+		return NULL;
+	}
+
+}
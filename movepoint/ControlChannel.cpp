@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "ControlChannel.h"
+
+#include <process.h>
+
+namespace movepoint {
+
+	ControlChannel::~ControlChannel() {
+		stop();
+	}
+
+	BOOL ControlChannel::start(IControlListener* inListener) {
+		if (hThread != NULL) return true;
+
+		listener = inListener;
+		block = controlOpen(hMapping);
+		if (block == nullptr) return false;
+
+		hWake = CreateEvent(NULL, FALSE, FALSE, CONTROL_WAKE_NAME);
+		hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (hWake == NULL || hStop == NULL) {
+			stop();
+			return false;
+		}
+
+		//Commands left over from a worker that died are not ours to carry out
+		InterlockedExchange(&block->taken, block->posted);
+		InterlockedExchange(&block->heartbeat, (LONG)GetTickCount());
+		InterlockedExchange(&block->workerPid, (LONG)GetCurrentProcessId());
+		setState(WORKER_STARTING);
+
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		return hThread != NULL;
+	}
+
+	void ControlChannel::stop() {
+		if (hThread != NULL) {
+			SetEvent(hStop);
+			WaitForSingleObject(hThread, INFINITE);			//It writes the block until it returns
+			CloseHandle(hThread);
+			hThread = NULL;
+		}
+		if (block != nullptr) {
+			setState(WORKER_STOPPED);
+			InterlockedExchange(&block->workerPid, 0);
+			UnmapViewOfFile(block);
+			block = nullptr;
+		}
+		if (hWake != NULL) CloseHandle(hWake);
+		if (hStop != NULL) CloseHandle(hStop);
+		if (hMapping != NULL) CloseHandle(hMapping);
+		hWake = hStop = hMapping = NULL;
+	}
+
+	void ControlChannel::setState(workerState state) {
+		if (block != nullptr) InterlockedExchange(&block->state, state);
+	}
+
+	void ControlChannel::setMoves(int numMoves) {
+		if (block != nullptr) InterlockedExchange(&block->numMoves, numMoves);
+	}
+
+	void ControlChannel::setResumeMs(DWORD ms) {
+		if (block != nullptr) InterlockedExchange(&block->resumeMs, (LONG)ms);
+	}
+
+	//Sensor thread, every frame
+	void ControlChannel::frame() {
+		if (block != nullptr) InterlockedIncrement(&block->frames);
+	}
+
+	/* The beat vouches for the sensor thread, not for this one: while running it only comes
+	when frames have advanced, so a hung sensor thread goes stale. Paused, starting or
+	without controllers there are no frames to wait for. */
+	unsigned int __stdcall ControlChannel::threadProc(void *p_thread_data) {
+		ControlChannel* self = static_cast<ControlChannel*>(p_thread_data);
+		ControlBlock* block = self->block;
+		HANDLE events[2] = { self->hStop, self->hWake };
+		LONG lastFrames = block->frames;
+
+		do {
+			LONG frames = block->frames;
+			if (frames != lastFrames || block->state != WORKER_RUNNING || block->numMoves == 0) {
+				InterlockedExchange(&block->heartbeat, (LONG)GetTickCount());
+				lastFrames = frames;
+			}
+
+			controlCommand command;
+			while ((command = controlTake(block)) != CONTROL_NONE) {
+				switch (command) {
+				case CONTROL_PAUSE:
+					InterlockedIncrement(&block->pauses);
+					break;
+				case CONTROL_RESUME:
+					InterlockedIncrement(&block->resumes);
+					break;
+				case CONTROL_RECALIBRATE:
+					InterlockedIncrement(&block->recalibrations);
+					break;
+				case CONTROL_RELOAD:
+					InterlockedIncrement(&block->reloads);
+					break;
+				default:
+					continue;								//Unknown to this version
+				}
+				if (self->listener != nullptr) self->listener->commandReceived(command);
+			}
+		} while (WaitForMultipleObjects(2, events, FALSE, controlHeartbeatMs) != WAIT_OBJECT_0);
+		return 0;
+	}
+
+	void ControlChannel::print() const {
+		if (block == nullptr) {
+			printf("CONTROL no shared block\n");
+			return;
+		}
+		printf("CONTROL state:%ld  frames:%ld  pauses:%ld  resumes:%ld  recalibrations:%ld  reloads:%ld  resume:%ldms\n",
+			block->state, block->frames, block->pauses, block->resumes, block->recalibrations, block->reloads, block->resumeMs);
+	}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "stdafx.h"
+#include "ControlBlock.h"
+
+namespace movepoint {
+
+	//Receives supervisor commands on the control thread. Default implementation does nothing.
+	class IControlListener
+	{
+	public:
+		virtual void commandReceived(controlCommand command) {}
+	};
+
+	/* Worker side of the control block shared with MovePointBase. A background thread
+	beats the heartbeat, and takes commands from the mailbox as soon as the supervisor
+	signals the wake event, so a pause or resume arrives within milliseconds. Without a
+	supervisor the block is still created and simply never receives a command. */
+	class ControlChannel
+	{
+		HANDLE hMapping = NULL;
+		HANDLE hWake = NULL;
+		HANDLE hStop = NULL;
+		HANDLE hThread = NULL;
+		ControlBlock* block = nullptr;
+		IControlListener* listener = nullptr;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+
+	public:
+		~ControlChannel();
+		BOOL start(IControlListener* inListener);
+		void stop();
+		void setState(workerState state);
+		void setMoves(int numMoves);
+		void setResumeMs(DWORD ms);
+		void frame();
+		void print() const;
+	};
+
+}
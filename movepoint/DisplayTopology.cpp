@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "DisplayTopology.h"
+
+#include <algorithm>
+
+namespace movepoint {
+
+	//shcore.dll only exists on Windows 8.1 and later, so load it dynamically
+	typedef HRESULT(WINAPI *GetDpiForMonitorFn)(HMONITOR hmonitor, int dpiType, UINT *dpiX, UINT *dpiY);
+
+	static GetDpiForMonitorFn pGetDpiForMonitor = NULL;
+
+	struct EnumState
+	{
+		Topology* topo;
+		MonitorMap all[maxMonitors];
+		int count;
+	};
+
+	static BOOL CALLBACK enumMonitor(HMONITOR hMonitor, HDC hdc, LPRECT lprcMonitor, LPARAM dwData) {
+		EnumState* state = (EnumState*)dwData;
+		if (state->count >= maxMonitors) return FALSE;
+
+		MONITORINFO info;
+		info.cbSize = sizeof(info);
+		if (!GetMonitorInfo(hMonitor, &info)) return TRUE;
+
+		MonitorMap & m = state->all[state->count++];
+		ZeroMemory(&m, sizeof(m));
+		m.handle = hMonitor;
+		m.rect = info.rcMonitor;
+		m.workArea = info.rcWork;
+		m.dpi = 96;
+
+		UINT dpiX, dpiY;
+		if (pGetDpiForMonitor != NULL && pGetDpiForMonitor(hMonitor, 0, &dpiX, &dpiY) == S_OK) {		//MDT_EFFECTIVE_DPI
+			m.dpi = dpiX;
+		}
+		return TRUE;
+	}
+
+	DisplayTopology::DisplayTopology() {
+		InitializeCriticalSection(&writeLock);
+		ZeroMemory((void*)refs, sizeof(refs));
+
+		HMODULE shcore = LoadLibrary(TEXT("shcore.dll"));
+		if (shcore != NULL) pGetDpiForMonitor = (GetDpiForMonitorFn)GetProcAddress(shcore, "GetDpiForMonitor");
+	}
+
+	DisplayTopology::~DisplayTopology() {
+		DeleteCriticalSection(&writeLock);
+	}
+
+	//weights: comma separated, one per monitor from left to right. Missing entries are 1, 0 excludes a monitor.
+	void DisplayTopology::rebuild(LPCTSTR weights) {
+
+		EnterCriticalSection(&writeLock);
+
+		EnumState state;
+		state.count = 0;
+		EnumDisplayMonitors(NULL, NULL, enumMonitor, (LPARAM)&state);
+
+		//Left to right, then top to bottom
+		std::sort(state.all, state.all + state.count, [](const MonitorMap & a, const MonitorMap & b) {
+			return (a.rect.left != b.rect.left ? a.rect.left < b.rect.left : a.rect.top < b.rect.top);
+		});
+
+		const TCHAR* w = (weights != NULL ? weights : TEXT(""));
+		for (int i = 0; i < state.count; i++) {
+			state.all[i].weight = 1;
+			if (*w != 0) {
+				state.all[i].weight = max((float)atof(w), 0);
+				while (*w != 0 && *w != ',') w++;
+				if (*w == ',') w++;
+			}
+		}
+
+		//Neither current nor pinned. Readers pin for at most a frame, so this does not wait long.
+		Topology* topo = nullptr;
+		while (topo == nullptr) {
+			for (int i = 0; i < numSlots && topo == nullptr; i++) {
+				int k = (nextSlot + i) % numSlots;
+				if (&slots[k] != current && refs[k] == 0) {
+					topo = &slots[k];
+					nextSlot = (k + 1) % numSlots;
+				}
+			}
+			if (topo == nullptr) Sleep(0);
+		}
+		ZeroMemory(topo, sizeof(Topology));
+
+		topo->virtualRect.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+		topo->virtualRect.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+		topo->virtualRect.right = topo->virtualRect.left + GetSystemMetrics(SM_CXVIRTUALSCREEN);
+		topo->virtualRect.bottom = topo->virtualRect.top + GetSystemMetrics(SM_CYVIRTUALSCREEN);
+
+		//Share of the control region follows physical width, so pointing speed is uniform across DPIs
+		float total = 0;
+		for (int i = 0; i < state.count; i++) {
+			MonitorMap & m = state.all[i];
+			if (m.weight > 0) {
+				topo->monitors[topo->numMonitors++] = m;
+				total += m.weight * (m.rect.right - m.rect.left) * 96.0f / m.dpi;
+			}
+			else {
+				topo->numExcluded++;
+			}
+		}
+
+		//Never end up with nothing to point at
+		if (topo->numMonitors == 0) {
+			for (int i = 0; i < state.count; i++) {
+				topo->monitors[i] = state.all[i];
+				topo->monitors[i].weight = 1;
+				total += (state.all[i].rect.right - state.all[i].rect.left) * 96.0f / state.all[i].dpi;
+			}
+			topo->numMonitors = state.count;
+			topo->numExcluded = 0;
+		}
+
+		float vw = (float)max(topo->virtualRect.right - topo->virtualRect.left, 2);
+		float vh = (float)max(topo->virtualRect.bottom - topo->virtualRect.top, 2);
+		float kx = mouseAbsRange / (vw - 1);
+		float ky = mouseAbsRange / (vh - 1);
+		float start = 0;
+
+		for (int i = 0; i < topo->numMonitors; i++) {
+			MonitorMap & m = topo->monitors[i];
+			float share = (total > 0 ? m.weight * (m.rect.right - m.rect.left) * 96.0f / m.dpi / total : 1);
+
+			m.sliceStart = start;
+			m.sliceEnd = (i == topo->numMonitors - 1 ? 1 : start + share);
+			start = m.sliceEnd;
+
+			float slice = max(m.sliceEnd - m.sliceStart, 0.000001f);
+			m.ax = kx * (m.rect.right - m.rect.left - 1) / slice;
+			m.bx = kx * (m.rect.left - topo->virtualRect.left) - m.ax * m.sliceStart;
+			m.ay = ky * (m.rect.bottom - m.rect.top - 1);
+			m.by = ky * (m.rect.top - topo->virtualRect.top);
+		}
+
+		topo->whRatio = vw / vh;
+		topo->version = ++version;
+
+		//Publish. Readers pick up the new layout on their next frame.
+		InterlockedExchangePointer((PVOID volatile *)&current, topo);
+
+		LeaveCriticalSection(&writeLock);
+	}
+
+	//Any thread. NULL before the first rebuild. The layout stays unchanged until release().
+	const Topology* DisplayTopology::acquire() const {
+		for (;;) {
+			Topology* topo = current;
+			if (topo == nullptr) return nullptr;
+			int i = (int)(topo - slots);
+			InterlockedIncrement(&refs[i]);
+			if (topo == current) return topo;
+			InterlockedDecrement(&refs[i]);
+		}
+	}
+
+	void DisplayTopology::release(const Topology* topo) const {
+		if (topo != nullptr) InterlockedDecrement(&refs[topo - slots]);
+	}
+
+	void DisplayTopology::print() const {
+		const Topology* topo = acquire();
+		if (topo == nullptr) return;
+
+		printf("DISPLAY version:%ld  monitors:%d  excluded:%d\n", topo->version, topo->numMonitors, topo->numExcluded);
+		for (int i = 0; i < topo->numMonitors; i++) {
+			const MonitorMap & m = topo->monitors[i];
+			printf("  %d: %d,%d %dx%d  dpi:%u  weight:%.2f  slice:%.2f-%.2f\n", i,
+				m.rect.left, m.rect.top, m.rect.right - m.rect.left, m.rect.bottom - m.rect.top,
+				m.dpi, m.weight, m.sliceStart, m.sliceEnd);
+		}
+		release(topo);
+	}
+
+}
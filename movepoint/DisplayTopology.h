@@ -0,0 +1,69 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	const int maxMonitors = 16;
+	const LONG mouseAbsRange = 65535;		//Range of MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK coordinates
+
+	struct MonitorMap
+	{
+		HMONITOR handle;
+		RECT rect;							//Monitor area in virtual desktop pixels
+		RECT workArea;						//Same, without the taskbar
+		UINT dpi;
+		float weight;
+		float sliceStart, sliceEnd;			//Part of the control region (normalized x) mapped to this monitor
+		float ax, bx, ay, by;				//Absolute mouse coordinate = a * normalized + b
+	};
+
+	struct Topology
+	{
+		long version;
+		int numMonitors;					//Monitors that take part in the mapping, left to right
+		int numExcluded;					//Monitors with zero weight
+		MonitorMap monitors[maxMonitors];
+		RECT virtualRect;
+		float whRatio;
+
+		inline int monitorAt(float u) const {
+			int i = 0;
+			while (i < numMonitors - 1 && u >= monitors[i].sliceEnd) i++;
+			return i;
+		}
+
+		//Normalized control region position to absolute mouse coordinates
+		inline POINT map(float u, float v) const {
+			const MonitorMap & m = monitors[monitorAt(u)];
+			POINT p;
+			p.x = (LONG)(m.ax * u + m.bx + 0.5f);
+			p.y = (LONG)(m.ay * v + m.by + 0.5f);
+			return p;
+		}
+	};
+
+	/* Monitor layout with a precomputed transform per monitor. Each monitor gets a slice of
+	the control region proportional to its physical width and user weight. Rebuilds fill a
+	slot no reader has pinned and publish it with one pointer swap, so the sensor thread
+	never waits. Readers hold a layout between acquire() and release(), as with SettingsStore. */
+	class DisplayTopology
+	{
+		static const int numSlots = 6;		//Current, one pinned per reading thread, and spares
+
+		Topology slots[numSlots];
+		mutable volatile LONG refs[numSlots];
+		Topology* volatile current = nullptr;
+		int nextSlot = 0;
+		long version = 0;
+		CRITICAL_SECTION writeLock;
+
+	public:
+		DisplayTopology();
+		~DisplayTopology();
+		void rebuild(LPCTSTR weights);
+		const Topology* acquire() const;
+		void release(const Topology* topo) const;
+		void print() const;
+	};
+
+}
@@ -0,0 +1,226 @@
+#include "stdafx.h"
+#include "DragEngine.h"
+
+#include <process.h>
+
+namespace movepoint {
+
+	//dwmapi.dll is missing on XP and composition can be off on Windows 7, so load it dynamically
+	typedef HRESULT(WINAPI *DwmFlushFn)();
+	typedef HRESULT(WINAPI *DwmIsCompositionEnabledFn)(BOOL *pfEnabled);
+	typedef HRESULT(WINAPI *DwmGetWindowAttributeFn)(HWND hwnd, DWORD dwAttribute, PVOID pvAttribute, DWORD cbAttribute);
+
+	static DwmFlushFn pDwmFlush = NULL;
+	static DwmIsCompositionEnabledFn pDwmIsCompositionEnabled = NULL;
+	static DwmGetWindowAttributeFn pDwmGetWindowAttribute = NULL;
+
+	//No activation, no Z order or size change, and no waiting on a busy application
+	static const UINT dragFlags = SWP_NOSIZE | SWP_NOZORDER | SWP_NOOWNERZORDER | SWP_NOACTIVATE | SWP_ASYNCWINDOWPOS | SWP_DEFERERASE;
+
+	DragEngine::DragEngine() {
+		InitializeCriticalSection(&stateLock);
+		ZeroMemory(&state, sizeof(state));
+		ZeroMemory(&pending, sizeof(pending));
+
+		HMODULE dwmapi = LoadLibrary(TEXT("dwmapi.dll"));
+		if (dwmapi != NULL) {
+			pDwmFlush = (DwmFlushFn)GetProcAddress(dwmapi, "DwmFlush");
+			pDwmIsCompositionEnabled = (DwmIsCompositionEnabledFn)GetProcAddress(dwmapi, "DwmIsCompositionEnabled");
+			pDwmGetWindowAttribute = (DwmGetWindowAttributeFn)GetProcAddress(dwmapi, "DwmGetWindowAttribute");
+		}
+	}
+
+	DragEngine::~DragEngine() {
+		stop();
+		DeleteCriticalSection(&stateLock);
+	}
+
+	BOOL DragEngine::start(const DisplayTopology* inDisplay) {
+		if (hThread != NULL) return true;
+
+		display = inDisplay;
+
+		DEVMODE mode;
+		ZeroMemory(&mode, sizeof(mode));
+		mode.dmSize = sizeof(mode);
+		if (EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1) {
+			refreshMs = max(1000 / mode.dmDisplayFrequency, (DWORD)1);
+		}
+
+		hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		return hThread != NULL;
+	}
+
+	void DragEngine::stop() {
+		if (hThread == NULL) return;
+
+		SetEvent(hStop);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		CloseHandle(hWake);
+		CloseHandle(hStop);
+		hThread = hWake = hStop = NULL;
+	}
+
+	//Button handlers. The window follows the cursor from the next refresh on.
+	void DragEngine::begin(HWND target, POINT grab, SIZE size) {
+		EnterCriticalSection(&stateLock);
+		state.target = target;
+		state.grab = grab;
+		state.size = size;
+		state.active = (target != NULL);
+		LeaveCriticalSection(&stateLock);
+
+		if (hWake != NULL) SetEvent(hWake);
+	}
+
+	void DragEngine::end() {
+		EnterCriticalSection(&stateLock);
+		state.active = false;
+		LeaveCriticalSection(&stateLock);
+	}
+
+	//Any thread. Carried out straight away, between drag refreshes.
+	void DragEngine::place(HWND target, placeAction action, const RECT & rect) {
+		EnterCriticalSection(&stateLock);
+		pending.target = target;
+		pending.action = action;
+		pending.rect = rect;
+		LeaveCriticalSection(&stateLock);
+
+		if (hWake != NULL) SetEvent(hWake);
+	}
+
+	void DragEngine::apply(const Placement & p) {
+		switch (p.action) {
+		case PLACE_RECT:
+		case PLACE_OUTER: {
+			//A maximized or minimized window has to be normal before it can be placed
+			bool normal = !IsZoomed(p.target) && !IsIconic(p.target);
+			if (!normal) ShowWindowAsync(p.target, SW_SHOWNOACTIVATE);
+
+			//Windows 10 frames have invisible resize borders; size the visible frame, not the border
+			RECT r = p.rect;
+			RECT outer, visible;
+			if (p.action == PLACE_RECT && normal && pDwmGetWindowAttribute != NULL && GetWindowRect(p.target, &outer)
+				&& SUCCEEDED(pDwmGetWindowAttribute(p.target, 9, &visible, sizeof(visible)))) {		//DWMWA_EXTENDED_FRAME_BOUNDS
+				r.left -= visible.left - outer.left;
+				r.top -= visible.top - outer.top;
+				r.right += outer.right - visible.right;
+				r.bottom += outer.bottom - visible.bottom;
+			}
+			SetWindowPos(p.target, NULL, r.left, r.top, r.right - r.left, r.bottom - r.top,
+				SWP_NOZORDER | SWP_NOOWNERZORDER | SWP_NOACTIVATE | SWP_ASYNCWINDOWPOS);
+			break;
+		}
+		case PLACE_MAXIMIZE:
+			ShowWindowAsync(p.target, SW_MAXIMIZE);
+			break;
+		case PLACE_MINIMIZE:
+			ShowWindowAsync(p.target, SW_MINIMIZE);
+			break;
+		case PLACE_RESTORE:
+			ShowWindowAsync(p.target, SW_RESTORE);
+			break;
+		default:
+			return;
+		}
+		placeCount++;
+	}
+
+	//0 turns snapping off
+	void DragEngine::setSnap(int px) {
+		InterlockedExchange(&snapPx, max(px, 0));
+	}
+
+	//Returns after the next composed frame, or one refresh interval without composition
+	void DragEngine::waitForRefresh() {
+		BOOL composing = FALSE;
+		if (pDwmFlush != NULL && pDwmIsCompositionEnabled != NULL && SUCCEEDED(pDwmIsCompositionEnabled(&composing)) && composing) {
+			if (SUCCEEDED(pDwmFlush())) return;
+		}
+		WaitForSingleObject(hStop, refreshMs);
+	}
+
+	//Pull each axis to the nearest work area edge within reach
+	void DragEngine::snap(LONG & x, LONG & y, const SIZE & size) const {
+		LONG reach = snapPx;
+		if (reach <= 0 || display == nullptr) return;
+		const Topology* topo = display->acquire();
+		if (topo == nullptr) return;
+
+		LONG bestX = reach, bestY = reach;
+		LONG dx = 0, dy = 0;
+		for (int i = 0; i < topo->numMonitors; i++) {
+			const RECT & wa = topo->monitors[i].workArea;
+			LONG candX[2] = { wa.left - x, wa.right - (x + size.cx) };
+			LONG candY[2] = { wa.top - y, wa.bottom - (y + size.cy) };
+			for (int k = 0; k < 2; k++) {
+				if (abs(candX[k]) < bestX) {
+					bestX = abs(candX[k]);
+					dx = candX[k];
+				}
+				if (abs(candY[k]) < bestY) {
+					bestY = abs(candY[k]);
+					dy = candY[k];
+				}
+			}
+		}
+		display->release(topo);
+		x += dx;
+		y += dy;
+	}
+
+	unsigned int __stdcall DragEngine::threadProc(void *p_thread_data) {
+		DragEngine* self = static_cast<DragEngine*>(p_thread_data);
+		HANDLE events[2] = { self->hStop, self->hWake };
+		POINT last = { LONG_MIN, LONG_MIN };
+		HWND lastTarget = NULL;
+
+		while (WaitForSingleObject(self->hStop, 0) != WAIT_OBJECT_0) {
+			DragState s;
+			Placement p;
+			EnterCriticalSection(&self->stateLock);
+			s = self->state;
+			p = self->pending;
+			self->pending.action = PLACE_NONE;
+			LeaveCriticalSection(&self->stateLock);
+
+			if (p.action != PLACE_NONE) self->apply(p);
+
+			//Idle until the next drag begins or something is to be placed
+			if (!s.active) {
+				if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) break;
+				continue;
+			}
+			if (s.target != lastTarget) {
+				lastTarget = s.target;
+				last.x = last.y = LONG_MIN;
+			}
+
+			self->waitForRefresh();
+			self->frameCount++;
+
+			POINT cursor;
+			if (!GetPhysicalCursorPos(&cursor)) continue;
+			LONG x = cursor.x - s.grab.x;
+			LONG y = cursor.y - s.grab.y;
+			self->snap(x, y, s.size);
+			if (x == last.x && y == last.y) continue;
+
+			SetWindowPos(s.target, NULL, x, y, 0, 0, dragFlags);
+			last.x = x;
+			last.y = y;
+			self->moveCount++;
+		}
+		return 0;
+	}
+
+	void DragEngine::print() const {
+		printf("DRAG refresh:%lums  snap:%ldpx  moves:%lu  frames:%lu  placements:%lu  dwm:%d\n", refreshMs, snapPx, moveCount, frameCount, placeCount, pDwmFlush != NULL);
+	}
+
+}
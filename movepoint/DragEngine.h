@@ -0,0 +1,82 @@
+#pragma once
+#include "stdafx.h"
+#include "DisplayTopology.h"
+
+namespace movepoint {
+
+	//Default values
+	const int dragSnapPx_d = 16;				//Window edges closer than this to a work area edge stick to it
+	const int dragFallbackHz_d = 60;			//Pace used when the display reports no refresh rate
+
+	enum placeAction
+	{
+		PLACE_NONE = 0,
+		PLACE_RECT = 1,						//Move and size to the rectangle's visible frame
+		PLACE_MAXIMIZE = 2,
+		PLACE_MINIMIZE = 3,
+		PLACE_RESTORE = 4,
+		PLACE_OUTER = 5						//Move and size to the rectangle as GetWindowRect reports it
+	};
+
+	/* Moves the dragged window once per display refresh. The sensor runs faster than the
+	screen, and a repainting MoveWindow per sensor frame floods the application with
+	WM_MOVE and paint work it can never show. This thread waits for DWM to compose a frame
+	(or sleeps one refresh interval when composition is off), samples the cursor, and
+	issues a single asynchronous SetWindowPos if the window has to move.
+
+	Snapping uses the monitor work areas DisplayTopology already keeps, so it costs a few
+	comparisons per refresh.
+
+	The same thread carries out one-off placements, such as snapping to a zone, so the
+	sensor thread never waits on another application's window. */
+	class DragEngine
+	{
+		struct DragState
+		{
+			HWND target;
+			POINT grab;							//Cursor position inside the window
+			SIZE size;
+			bool active;
+		};
+
+		struct Placement
+		{
+			HWND target;
+			placeAction action;
+			RECT rect;
+		};
+
+		HANDLE hThread = NULL;
+		HANDLE hWake = NULL;
+		HANDLE hStop = NULL;
+		CRITICAL_SECTION stateLock;
+		DragState state;
+		Placement pending;						//Only the latest placement is kept
+		const DisplayTopology* display = nullptr;
+		volatile LONG snapPx = dragSnapPx_d;
+		DWORD refreshMs = 1000 / dragFallbackHz_d;
+
+		//Drag thread only
+		unsigned long moveCount = 0;
+		unsigned long frameCount = 0;
+		unsigned long placeCount = 0;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+		void waitForRefresh();
+		void snap(LONG & x, LONG & y, const SIZE & size) const;
+		void apply(const Placement & p);
+
+	public:
+		DragEngine();
+		~DragEngine();
+
+		BOOL start(const DisplayTopology* inDisplay);
+		void stop();
+		void begin(HWND target, POINT grab, SIZE size);
+		void end();
+		void place(HWND target, placeAction action, const RECT & rect);
+		void setSnap(int px);
+		void print() const;
+	};
+
+}
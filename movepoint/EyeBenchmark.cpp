@@ -0,0 +1,260 @@
+#include "stdafx.h"
+#include "EyeBenchmark.h"
+#include "EyeSegmenter.h"
+#include "SphereTracker.h"
+#include "SphereFit.h"
+#include "SyntheticEye.h"
+#include "EyePipeline.h"
+#include "ColorPlanner.h"
+#include "FrameCodec.h"
+#include "EyeCalibration.h"
+
+namespace movepoint {
+
+	static const char* pathName(segmentPath path) {
+		switch (path) {
+		case SEGMENT_AVX2: return "AVX2";
+		case SEGMENT_SSE41: return "SSE4.1";
+		default: return "scalar";
+		}
+	}
+
+	//Default synthetic scene with two more spheres, so every controller slot is busy
+	static void loadBenchScene(SyntheticEye & eye, int width, int height) {
+		eye.loadDefaultScene();
+
+		SyntheticSphere c = { 30, 240, 40, 0.04f * width, 0.5f * width, 0.5f * height, 0.3f * width, 0.35f * height, 0.17f, 0.21f, 3, 1, 0.3f * 0.04f * width, 0.07f };
+		SyntheticSphere d = { 240, 220, 20, 0.03f * width, 0.5f * width, 0.5f * height, 0.4f * width, 0.2f * height, 0.23f, 0.19f, 4.5f, 2, 0, 0 };
+		eye.addSphere(c);
+		eye.addSphere(d);
+	}
+
+	//Magenta, cyan, green and yellow, as in loadBenchScene
+	template <class T> static void setBenchTargets(T & target) {
+		target.setTarget(0, 255, 0, 255);
+		target.setTarget(1, 0, 255, 255);
+		target.setTarget(2, 0, 255, 0);
+		target.setTarget(3, 255, 255, 0);
+	}
+
+	//Default synthetic scene: window tracking and sphere fitting against ground truth
+	static void benchTracker(EyeSegmenter & segmenter, int width, int height) {
+		SyntheticEye eye(width, height);
+		loadBenchScene(eye, width, height);
+
+		SphereTracker tracker;
+		SphereFit fitter;
+		double elapsed = 0, fitElapsed = 0, error = 0, fitError = 0, radiusError = 0;
+		int measured = 0, fitted = 0, visible = 0;
+
+		for (int f = 0; f < benchFrames_d; f++) {
+			const unsigned char* frame = eye.getEyeBuffer();
+			SyntheticTruth truth = eye.getTruth(0);
+
+			double start = eyeTimeMs();
+			tracker.update(segmenter, frame);
+			elapsed += eyeTimeMs() - start;
+
+			//Only score frames where most of the sphere can be seen
+			if (truth.visible < 0.9f) continue;
+			visible++;
+
+			const SphereTrack & t0 = tracker.getTrack(0);
+			if (!t0.found) continue;
+			error += sqrt((t0.x - truth.x) * (t0.x - truth.x) + (t0.y - truth.y) * (t0.y - truth.y));
+			measured++;
+
+			if (t0.coarse) continue;
+			start = eyeTimeMs();
+			SphereFitResult fit = fitter.fit(segmenter.getMaskBuffer(0), width, height, t0.roi);
+			fitElapsed += eyeTimeMs() - start;
+			if (fit.valid) {
+				fitError += sqrt((fit.x - truth.x) * (fit.x - truth.x) + (fit.y - truth.y) * (fit.y - truth.y));
+				radiusError += fabs(fit.radius - truth.radius);
+				fitted++;
+			}
+		}
+
+		const TrackerStats & stats = tracker.getStats();
+		printf("  tracker %7.3f ms/frame  workload:%.1f%%  searches:%ld  found:%d/%d  centroid error:%.2f px\n",
+			elapsed / benchFrames_d, tracker.workload() * 100, stats.searches, measured, visible, (measured > 0 ? error / measured : 0));
+		printf("  fit     %7.3f ms/frame  fitted:%d  centre error:%.3f px  radius error:%.3f px\n",
+			fitElapsed / max(fitted, 1), fitted, (fitted > 0 ? fitError / fitted : 0), (fitted > 0 ? radiusError / fitted : 0));
+	}
+
+	//Contamination of the default sphere hues against the planned ones, on the synthetic room
+	static void benchPlanner(int width, int height) {
+		SyntheticEye eye(width, height);
+		eye.loadDefaultScene();
+		eye.getEyeBuffer();
+
+		EyeResult spheres;
+		ZeroMemory(&spheres, sizeof(spheres));
+		for (int i = 0; i < eye.getSphereCount(); i++) {
+			const SyntheticTruth & t = eye.getTruth(i);
+			spheres.tracks[i].found = true;
+			spheres.tracks[i].x = t.x;
+			spheres.tracks[i].y = t.y;
+			spheres.tracks[i].radius = t.radius;
+		}
+
+		ColorPlanner planner;
+		planner.buildHistogram(eye.getEyeBuffer(), width, height, &spheres);
+		printf("  planner default hues 300 180: %.2f%% %.2f%% of the frame\n", planner.contamination(300) * 100, planner.contamination(180) * 100);
+		double start = eyeTimeMs();
+		planner.plan(eye.getSphereCount());
+		printf("  planner %7.3f ms  ", eyeTimeMs() - start);
+		planner.print();
+	}
+
+	//Focal length recovered from a still sphere rendered at the prompted distances by a lens with a known focal length
+	static void benchCalibration(EyeSegmenter & segmenter, int width, int height) {
+		const float trueFocal = 600;
+		EyeCalibration cal;
+		cal.setResolution(width, height);
+		float radiusAt[calDistances + 1];
+		float distances[calDistances + 1] = { calDistanceCm_d[0], calDistanceCm_d[1], calDistanceCm_d[2], 125 };
+
+		for (int d = 0; d <= calDistances; d++) {
+			float z = distances[d], r = cal.sphereRadius;
+			SyntheticEye eye(width, height);
+			SyntheticSphere sphere = { 255, 0, 255, trueFocal * width / 640 * r / sqrtf(z * z - r * r),
+				width * 0.4f, height * 0.6f, 0, 0, 0, 0, 0, 0, 0, 0 };
+			eye.addSphere(sphere);
+
+			SphereTracker tracker;
+			SphereFit fitter;
+			float sum = 0;
+			int fitted = 0;
+			for (int f = 0; f < 20; f++) {
+				tracker.update(segmenter, eye.getEyeBuffer());
+				const SphereTrack & t = tracker.getTrack(0);
+				if (!t.found || t.coarse) continue;
+				SphereFitResult fit = fitter.fit(segmenter.getMaskBuffer(0), width, height, t.roi);
+				if (fit.valid) {
+					sum += fit.radius;
+					fitted++;
+				}
+			}
+			radiusAt[d] = (fitted > 0 ? sum / fitted : 0);
+			if (d < calDistances) cal.addSample(z, radiusAt[d]);
+		}
+
+		bool solved = cal.solve();
+		printf("  camera  focal %.1f px (true %.0f)  radius bias %.2f px  depth at 125 cm: %.1f cm%s\n", cal.getIntrinsics().fx, trueFocal,
+			cal.getIntrinsics().radiusBias, cal.depth(radiusAt[calDistances]), (solved ? "" : "  NOT SOLVED"));
+	}
+
+	//Lossless recording codec on moving synthetic frames: ratio, speed, and a round trip
+	static void benchCodec(int width, int height) {
+		SyntheticEye eye(width, height);
+		eye.loadDefaultScene();
+		int n = width * height;
+		unsigned char* encoded = (unsigned char*)malloc(frameCodecBound(n));
+		unsigned char* decoded = (unsigned char*)_aligned_malloc(n * eyeBytesPerPixel, 32);
+		double encodeMs = 0, decodeMs = 0, bytes = 0;
+		int frames = 30, exact = 0;
+
+		for (int f = 0; f < frames; f++) {
+			const unsigned char* frame = eye.getEyeBuffer();
+			double start = eyeTimeMs();
+			int size = encodeFrame(frame, n, encoded);
+			encodeMs += eyeTimeMs() - start;
+			bytes += size;
+
+			start = eyeTimeMs();
+			bool ok = decodeFrame(encoded, size, decoded, n);
+			decodeMs += eyeTimeMs() - start;
+			if (ok && memcmp(frame, decoded, n * eyeBytesPerPixel) == 0) exact++;
+		}
+		printf("  codec   %7.3f ms encode  %7.3f ms decode  ratio %.2f  lossless %d/%d\n", encodeMs / frames, decodeMs / frames,
+			(double)n * eyeBytesPerPixel * frames / bytes, exact, frames);
+
+		free(encoded);
+		_aligned_free(decoded);
+	}
+
+	//Whole pipeline on the low resolution 120 Hz mode. Capture time includes rendering the synthetic frames.
+	static void benchPipeline() {
+		SyntheticEye eye(320, 240);
+		eye.fps = 120;
+		loadBenchScene(eye, 320, 240);
+
+		EyePipeline pipeline;
+		setBenchTargets(pipeline);
+		if (!pipeline.start(&eye)) return;
+		Sleep(3000);
+		pipeline.print();
+		pipeline.stop();
+	}
+
+	static void benchPass(EyeSegmenter & segmenter, const unsigned char* frame, unsigned char* reference, int n, const char* name, bool isReference) {
+		segmenter.segment(frame);
+
+		//Vector paths may disagree with the SDK maths on pixels scoring exactly the similarity cut
+		int mismatches = 0, hits = 0;
+		for (int i = 0; i < benchControllers_d; i++) {
+			unsigned char* mask = segmenter.getMaskBuffer(i);
+			if (isReference) {
+				memcpy(reference + i * n, mask, n);
+			}
+			else {
+				for (int j = 0; j < n; j++) {
+					if (mask[j] != reference[i * n + j]) mismatches++;
+				}
+			}
+			for (int j = 0; j < n; j++) {
+				if (mask[j] != 0) hits++;
+			}
+		}
+
+		double start = eyeTimeMs();
+		for (int f = 0; f < benchFrames_d; f++) segmenter.segment(frame);
+		double perFrame = (eyeTimeMs() - start) / benchFrames_d;
+
+		printf("  %-7s %7.3f ms/frame  %7.1f Mpx/s  hits:%d  mismatches:%d\n", name,
+			perFrame, n / perFrame / 1000, hits, mismatches);
+	}
+
+	void runEyeBenchmark() {
+		int width = benchWidth_d, height = benchHeight_d;
+		int n = width * height;
+
+		unsigned char* frame = (unsigned char*)_aligned_malloc(n * eyeBytesPerPixel, 32);
+		unsigned char* reference = new unsigned char[n * benchControllers_d];
+		SyntheticEye eye(width, height);
+		loadBenchScene(eye, width, height);
+		memcpy(frame, eye.getEyeBuffer(), n * eyeBytesPerPixel);
+
+		EyeSegmenter segmenter;
+		segmenter.resize(width, height);
+		setBenchTargets(segmenter);
+
+		printf("EYE BENCHMARK %dx%d, %d frames, %d controllers\n", width, height, benchFrames_d, benchControllers_d);
+
+		segmentPath best = EyeSegmenter::bestPath();
+		for (int p = SEGMENT_SCALAR; p <= best; p++) {
+			segmenter.setPath((segmentPath)p);
+			benchPass(segmenter, frame, reference, n, pathName((segmentPath)p), p == SEGMENT_SCALAR);
+		}
+
+		//Lookup tables trade accuracy at colour boundaries for cache footprint
+		for (int bits = lutBitsMin + 1; bits <= lutBitsMax - 1; bits++) {
+			char name[16];
+			sprintf_s(name, "LUT %d", bits);
+			segmenter.setLookup(true, bits);
+			benchPass(segmenter, frame, reference, n, name, false);
+		}
+
+		segmenter.setLookup(false);
+		benchTracker(segmenter, width, height);
+		benchCalibration(segmenter, width, height);
+		benchPlanner(width, height);
+		benchCodec(width, height);
+		benchPipeline();
+
+		delete[] reference;
+		_aligned_free(frame);
+	}
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	const int benchWidth_d = 640;			//PS Eye VGA mode
+	const int benchHeight_d = 480;
+	const int benchFrames_d = 300;
+	const int benchControllers_d = 4;		//As many as the camera tracks at once (maxEyeControllers)
+
+	//Times every segmentation path the CPU supports on a generated frame and checks them against the scalar path
+	void runEyeBenchmark();
+
+}
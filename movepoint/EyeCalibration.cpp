@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include "EyeCalibration.h"
+
+#include <math.h>
+
+namespace movepoint {
+
+	EyeCalibration::EyeCalibration() {
+		reset();
+	}
+
+	void EyeCalibration::reset() {
+		intrinsics.fx = intrinsics.fy = eyeFocal640_d;
+		intrinsics.cx = 320;
+		intrinsics.cy = 240;
+		intrinsics.radiusBias = 0;
+		clearSamples();
+	}
+
+	//The 320x240 mode sees the same field of view, so the model only needs scaling
+	void EyeCalibration::setResolution(int width, int height) {
+		if (width <= 0 || height <= 0) return;
+		scaleX = 640.0f / width;
+		scaleY = 480.0f / height;
+	}
+
+	//Zero fields keep their current value, so a partial set from the registry works
+	void EyeCalibration::setIntrinsics(const EyeIntrinsics & in) {
+		if (in.fx > 0) intrinsics.fx = in.fx;
+		if (in.fy > 0) intrinsics.fy = in.fy;
+		if (in.cx > 0) intrinsics.cx = in.cx;
+		if (in.cy > 0) intrinsics.cy = in.cy;
+		intrinsics.radiusBias = in.radiusBias;
+	}
+
+	const EyeIntrinsics & EyeCalibration::getIntrinsics() const {
+		return intrinsics;
+	}
+
+	void EyeCalibration::clearSamples() {
+		numSamples = 0;
+	}
+
+	bool EyeCalibration::addSample(float distanceCm, float radiusPx) {
+		if (numSamples >= calDistances || distanceCm <= sphereRadius || radiusPx <= 0) return false;
+
+		sampleDistance[numSamples] = distanceCm;
+		sampleRadius[numSamples] = radiusPx * scaleX;
+		numSamples++;
+		return true;
+	}
+
+	int EyeCalibration::sampleCount() const {
+		return numSamples;
+	}
+
+	/* r = f * R / sqrt(Z^2 - R^2) + bias is exact for a sphere seen head on. With u the
+	R / sqrt(Z^2 - R^2) term that is linear in f and bias, so least squares over the
+	samples gives both; a single sample gives f alone. */
+	bool EyeCalibration::solve() {
+		if (numSamples == 0) return false;
+
+		float f, bias = 0;
+		float u[calDistances];
+		for (int i = 0; i < numSamples; i++) {
+			float z = sampleDistance[i];
+			u[i] = sphereRadius / sqrtf(z * z - sphereRadius * sphereRadius);
+		}
+
+		if (numSamples == 1) {
+			f = sampleRadius[0] / u[0];
+		}
+		else {
+			float su = 0, sr = 0, suu = 0, sur = 0;
+			for (int i = 0; i < numSamples; i++) {
+				su += u[i];
+				sr += sampleRadius[i];
+				suu += u[i] * u[i];
+				sur += u[i] * sampleRadius[i];
+			}
+			float det = numSamples * suu - su * su;
+			if (fabs(det) < 1e-12f) return false;				//All at the same distance
+			f = (numSamples * sur - su * sr) / det;
+			bias = (sr - f * su) / numSamples;
+		}
+
+		if (f < minFocal640 || f > maxFocal640) {
+			printf("Camera calibration rejected: focal length %.0f px is not plausible. \n", f);
+			return false;
+		}
+
+		intrinsics.fx = intrinsics.fy = f;
+		intrinsics.radiusBias = bias;
+		return true;
+	}
+
+	//Distance from the camera to the sphere centre in centimetres
+	float EyeCalibration::depth(float radiusPx) const {
+		float r = max(radiusPx * scaleX - intrinsics.radiusBias, 0.5f);
+		float d = intrinsics.fx * sphereRadius / r;
+		return sqrtf(d * d + sphereRadius * sphereRadius);
+	}
+
+	Move::Vec3 EyeCalibration::toMetric(float x, float y, float radiusPx) const {
+		float z = depth(radiusPx);
+		//The camera faces the user, so the user's right is the image's left
+		return Move::Vec3((intrinsics.cx - x * scaleX) * z / intrinsics.fx, (intrinsics.cy - y * scaleY) * z / intrinsics.fy, z);
+	}
+
+	void EyeCalibration::print() const {
+		printf("CAMERA scale:%.1f  focal:%.1f %.1f  centre:%.1f %.1f  radius bias:%.2f  samples:%d\n", scaleX,
+			intrinsics.fx, intrinsics.fy, intrinsics.cx, intrinsics.cy, intrinsics.radiusBias, numSamples);
+	}
+
+}
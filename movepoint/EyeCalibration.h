@@ -0,0 +1,61 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+
+namespace movepoint {
+
+	//Default values
+	const float sphereDiameterCm = 4.5f;			//The PS Move sphere
+	const float eyeFocal640_d = 540;				//PS Eye focal length in pixels at 640 wide, wide (red dot) zoom setting
+	const int calDistances = 3;
+	const float calDistanceCm_d[calDistances] = { 100, 150, 200 };	//Prompted distances from the camera to the sphere
+	const float minFocal640 = 200, maxFocal640 = 2000;	//Anything outside is a bad sample, not a lens
+	const double metricMaxAgeMs_d = 50;			//Older camera results are not used for the position
+
+	//Pinhole model of the camera, in pixels of the 640x480 mode. Pixels are assumed square unless set from outside.
+	struct EyeIntrinsics
+	{
+		float fx, fy;						//Focal length in pixels
+		float cx, cy;						//Principal point in pixels
+		float radiusBias;					//Segmentation grows or shrinks the sphere by about this many pixels
+	};
+
+	/* Turns a sphere's image position and radius into centimetres from the camera. The
+	radius gives depth, since the sphere's real size is known; depth and the pinhole model
+	give the other two axes. X grows to the user's right, Y upwards and Z away from the
+	camera, so with the camera below the screen the axes match MoveManager's positions.
+
+	Focal length comes from holding the sphere at measured distances: radius against
+	inverse distance is a straight line whose slope is the focal length times the sphere
+	radius and whose offset is the segmentation bias. Values from a checkerboard
+	calibration done elsewhere can be entered directly instead. */
+	class EyeCalibration
+	{
+		EyeIntrinsics intrinsics;
+		float scaleX = 1, scaleY = 1;		//From camera pixels to 640x480 pixels
+
+		int numSamples = 0;
+		float sampleDistance[calDistances];
+		float sampleRadius[calDistances];
+
+	public:
+		float sphereRadius = sphereDiameterCm / 2;
+
+		EyeCalibration();
+
+		void reset();
+		void setResolution(int width, int height);
+		void setIntrinsics(const EyeIntrinsics & in);
+		const EyeIntrinsics & getIntrinsics() const;
+
+		void clearSamples();
+		bool addSample(float distanceCm, float radiusPx);
+		int sampleCount() const;
+		bool solve();
+
+		float depth(float radiusPx) const;
+		Move::Vec3 toMetric(float x, float y, float radiusPx) const;
+		void print() const;
+	};
+
+}
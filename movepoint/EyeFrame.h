@@ -0,0 +1,44 @@
+#pragma once
+#include "stdafx.h"
+
+#include <math.h>
+
+namespace movepoint {
+
+	const int eyeBytesPerPixel = 4;			//PS Eye colour frames come from CL-Eye as BGRA
+	const int maxEyeControllers = 4;			//Controllers the camera can track at once
+
+	//Pixel rectangle, right and bottom exclusive
+	struct EyeRect
+	{
+		int left, top, right, bottom;
+	};
+
+	//High resolution timestamp in milliseconds, for benchmarks and stage timing
+	inline double eyeTimeMs() {
+		static LARGE_INTEGER freq = { 0 };
+		LARGE_INTEGER now;
+		if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&now);
+		return (double)now.QuadPart * 1000 / freq.QuadPart;
+	}
+
+	//Fully saturated, full value colour of a hue in degrees
+	inline void hueToRgb(float hue, int & r, int & g, int & b) {
+		float h = fmod(fmod(hue, 360.0f) + 360, 360.0f) / 60;
+		float x = 1 - fabs(fmod(h, 2.0f) - 1);
+		float rf = 0, gf = 0, bf = 0;
+		switch ((int)h) {
+		case 0: rf = 1; gf = x; break;
+		case 1: rf = x; gf = 1; break;
+		case 2: gf = 1; bf = x; break;
+		case 3: gf = x; bf = 1; break;
+		case 4: rf = x; bf = 1; break;
+		default: rf = 1; bf = x; break;
+		}
+		r = (int)(rf * 255 + 0.5f);
+		g = (int)(gf * 255 + 0.5f);
+		b = (int)(bf * 255 + 0.5f);
+	}
+
+}
@@ -0,0 +1,401 @@
+#include "stdafx.h"
+#include "EyePipeline.h"
+#include "FrameExport.h"
+#include "SessionRecorder.h"
+
+#include <process.h>
+#include <mmsystem.h>
+
+namespace movepoint {
+
+	static const char* stageNames[numStages] = { "capture", "segment", "fit", "fuse" };
+
+	EyePipeline::EyePipeline() {
+		InitializeCriticalSection(&colorLock);
+		InitializeCriticalSection(&snapshotLock);
+		hSnapshot = CreateEvent(NULL, TRUE, FALSE, NULL);
+		ZeroMemory(pool, sizeof(pool));
+		ZeroMemory(hThreads, sizeof(hThreads));
+		ZeroMemory(pendingState, sizeof(pendingState));
+		ZeroMemory(&latest, sizeof(latest));
+		ZeroMemory(stats, sizeof(stats));
+	}
+
+	EyePipeline::~EyePipeline() {
+		stop();
+		CloseHandle(hSnapshot);
+		DeleteCriticalSection(&snapshotLock);
+		DeleteCriticalSection(&colorLock);
+	}
+
+	void EyePipeline::allocate() {
+		for (int i = 0; i < poolSize; i++) {
+			pool[i].pixels = (unsigned char*)_aligned_malloc(width * height * eyeBytesPerPixel, 32);
+			for (int j = 0; j < maxEyeControllers; j++) {
+				pool[i].masks[j] = (unsigned char*)_aligned_malloc(width * height, 32);
+			}
+		}
+	}
+
+	void EyePipeline::release() {
+		for (int i = 0; i < poolSize; i++) {
+			if (pool[i].pixels != NULL) _aligned_free(pool[i].pixels);
+			for (int j = 0; j < maxEyeControllers; j++) {
+				if (pool[i].masks[j] != NULL) _aligned_free(pool[i].masks[j]);
+			}
+		}
+		ZeroMemory(pool, sizeof(pool));
+	}
+
+	BOOL EyePipeline::start(Move::IEyeController* inEye, IEyeListener* inListener) {
+		if (running || inEye == nullptr) return false;
+
+		eye = inEye;
+		listener = inListener;
+		eye->getEyeDimensions(width, height);
+		if (width <= 0 || height <= 0) return false;
+
+		allocate();
+		if (exporter != nullptr && !exporter->open(width, height)) exporter = nullptr;
+		segmenter.resize(width, height);
+		tracker.reset();
+		ZeroMemory(stats, sizeof(stats));
+		for (int i = 0; i < poolSize; i++) freeQueue.push(&pool[i]);
+
+		timeBeginPeriod(1);			//Capture pacing sleeps in 1 ms steps
+		startMs = eyeTimeMs();
+		running = 1;
+
+		unsigned(__stdcall *procs[numStages])(void*) = { captureProc, segmentProc, fitProc, fuseProc };
+		for (int s = 0; s < numStages; s++) {
+			unsigned int thread_id = 0;
+			hThreads[s] = (HANDLE)_beginthreadex(NULL, 0, procs[s], this, 0, &thread_id);
+			if (hThreads[s] != NULL) pinThread(hThreads[s], s);
+		}
+
+		printf("Camera pipeline started: %dx%d at %d Hz. \n", width, height, captureHz);
+		return true;
+	}
+
+	void EyePipeline::stop() {
+		if (!running) return;
+
+		InterlockedExchange(&running, 0);
+		segmentQueue.wake();
+		fitQueue.wake();
+		fuseQueue.wake();
+
+		//No timeout: every stage sees running within stageWaitMs_d or a frame period, and
+		//the pool below must not be freed while any of them could still touch it
+		for (int s = 0; s < numStages; s++) {
+			if (hThreads[s] == NULL) continue;
+			WaitForSingleObject(hThreads[s], INFINITE);
+			CloseHandle(hThreads[s]);
+			hThreads[s] = NULL;
+		}
+		timeEndPeriod(1);
+
+		//Threads are gone, so draining from here cannot race
+		EyeFrameBuffer* frame;
+		while (freeQueue.pop(frame));
+		while (segmentQueue.pop(frame));
+		while (fitQueue.pop(frame));
+		while (fuseQueue.pop(frame));
+		release();
+		if (exporter != nullptr) exporter->close();
+	}
+
+	bool EyePipeline::isRunning() const {
+		return running != 0;
+	}
+
+	//Takes effect on the next start
+	void EyePipeline::setExport(FrameExport* inExport) {
+		if (!running) exporter = inExport;
+	}
+
+	//Takes effect on the next start. The recorder must be paused or stopped only after this pipeline.
+	void EyePipeline::setRecorder(SessionRecorder* inRecorder) {
+		if (!running) recorder = inRecorder;
+	}
+
+	/* Any thread. Copies the next frame that gets through fusion, and its result, into the
+	caller's buffers; pixels holds a whole frame. False if none came within timeoutMs. */
+	bool EyePipeline::snapshot(unsigned char* pixels, EyeResult & result, DWORD timeoutMs) {
+		if (!running) return false;
+
+		EnterCriticalSection(&snapshotLock);
+		snapshotPixels = pixels;
+		snapshotResult = &result;
+		ResetEvent(hSnapshot);
+		InterlockedExchange(&snapshotState, 1);
+
+		bool taken = WaitForSingleObject(hSnapshot, timeoutMs) == WAIT_OBJECT_0;
+		if (!taken && InterlockedCompareExchange(&snapshotState, 0, 1) != 1) {
+			WaitForSingleObject(hSnapshot, INFINITE);		//Fusion is copying it right now
+			taken = true;
+		}
+		LeaveCriticalSection(&snapshotLock);
+		return taken;
+	}
+
+	//One stage per core from core 1 on, leaving core 0 to the sensor thread. Not pinned without a core to spare.
+	void EyePipeline::pinThread(HANDLE hThread, int stage) {
+		if (!pinThreads) return;
+
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		int cores = (int)info.dwNumberOfProcessors;
+		if (cores <= numStages) return;
+
+		SetThreadAffinityMask(hThread, (DWORD_PTR)1 << (stage + 1));
+	}
+
+	void EyePipeline::setTarget(int moveId, int r, int g, int b) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return;
+
+		EnterCriticalSection(&colorLock);
+		pendingRgb[moveId][0] = r;
+		pendingRgb[moveId][1] = g;
+		pendingRgb[moveId][2] = b;
+		pendingState[moveId] = 1;
+		InterlockedExchange(&colorsChanged, 1);
+		InterlockedOr(&targetMask, 1 << moveId);
+		LeaveCriticalSection(&colorLock);
+	}
+
+	void EyePipeline::clearTargets() {
+		EnterCriticalSection(&colorLock);
+		for (int i = 0; i < maxEyeControllers; i++) pendingState[i] = 2;
+		InterlockedExchange(&colorsChanged, 1);
+		InterlockedExchange(&targetMask, 0);
+		LeaveCriticalSection(&colorLock);
+	}
+
+	//Any thread. Without a target colour the controller's sphere is never segmented or fitted.
+	bool EyePipeline::hasTarget(int moveId) const {
+		return moveId >= 0 && moveId < maxEyeControllers && (targetMask & (1 << moveId)) != 0;
+	}
+
+	//0 switches back to the SIMD kernels
+	void EyePipeline::setLookup(int bits) {
+		EnterCriticalSection(&colorLock);
+		pendingLutBits = bits;
+		InterlockedExchange(&colorsChanged, 1);
+		LeaveCriticalSection(&colorLock);
+	}
+
+	//Segmentation thread, between frames
+	void EyePipeline::applyColors() {
+		EnterCriticalSection(&colorLock);
+		InterlockedExchange(&colorsChanged, 0);
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (pendingState[i] == 1) segmenter.setTarget(i, pendingRgb[i][0], pendingRgb[i][1], pendingRgb[i][2]);
+			else if (pendingState[i] == 2) segmenter.clearTarget(i);
+			pendingState[i] = 0;
+		}
+		if (pendingLutBits >= 0) {
+			segmenter.setLookup(pendingLutBits > 0, pendingLutBits);
+			pendingLutBits = -1;
+		}
+		LeaveCriticalSection(&colorLock);
+	}
+
+	void EyePipeline::sampleQueue(int stage, const FrameQueue & queue) {
+		stats[stage].queueSum += queue.size() + 1;		//Including the frame just taken
+		stats[stage].queueSamples++;
+	}
+
+	unsigned int __stdcall EyePipeline::captureProc(void *p_thread_data) {
+		EyePipeline* self = static_cast<EyePipeline*>(p_thread_data);
+		StageStats & st = self->stats[STAGE_CAPTURE];
+		int frameBytes = self->width * self->height * eyeBytesPerPixel;
+		EyeFrameBuffer* spare = NULL;
+		double next = eyeTimeMs();
+
+		while (self->running) {
+			//Pace to the capture rate, without bursting to catch up after a stall
+			double period = 1000.0 / max(self->captureHz, 1);
+			next += period;
+			double now = eyeTimeMs();
+			if (now > next + period) next = now;
+			while ((now = eyeTimeMs()) < next) {
+				if (next - now > 1.5) Sleep(1);
+				else YieldProcessor();
+			}
+
+			EyeFrameBuffer* frame = spare;
+			spare = NULL;
+			if (frame == NULL && !self->freeQueue.pop(frame)) {
+				st.drops++;				//Every frame is still in flight
+				continue;
+			}
+
+			double start = eyeTimeMs();
+			const unsigned char* source = self->eye->getEyeBuffer();
+			if (source == NULL) {
+				spare = frame;
+				continue;
+			}
+			memcpy(frame->pixels, source, frameBytes);
+			frame->seq = self->nextSeq++;
+			frame->captureMs = start;
+			frame->skipped = false;
+			if (self->recorder != nullptr) self->recorder->captured(frame->pixels, start);
+
+			self->segmentQueue.push(frame);		//Never full: it holds the whole pool
+			st.processed++;
+			st.busyMs += eyeTimeMs() - start;
+		}
+		return 0;
+	}
+
+	unsigned int __stdcall EyePipeline::segmentProc(void *p_thread_data) {
+		EyePipeline* self = static_cast<EyePipeline*>(p_thread_data);
+		StageStats & st = self->stats[STAGE_SEGMENT];
+		EyeFrameBuffer* frame;
+
+		while (self->running) {
+			if (!self->segmentQueue.wait(frame, stageWaitMs_d)) continue;
+			self->sampleQueue(STAGE_SEGMENT, self->segmentQueue);
+			double start = eyeTimeMs();
+
+			if (self->segmentQueue.size() > 0) {
+				frame->skipped = true;			//A newer frame is already waiting
+				st.drops++;
+			}
+			else {
+				if (self->colorsChanged) self->applyColors();
+				self->tracker.update(self->segmenter, frame->pixels);
+
+				//The segmenter's masks are reused next frame, so keep a copy of each window
+				for (int i = 0; i < maxEyeControllers; i++) {
+					const SphereTrack & t = self->tracker.getTrack(i);
+					frame->tracks[i] = t;
+					if (!t.found || t.coarse) continue;
+
+					const unsigned char* mask = self->segmenter.getMaskBuffer(i);
+					for (int y = t.roi.top; y < t.roi.bottom; y++) {
+						int offset = y * self->width + t.roi.left;
+						memcpy(frame->masks[i] + offset, mask + offset, t.roi.right - t.roi.left);
+					}
+				}
+				st.processed++;
+			}
+
+			self->fitQueue.push(frame);
+			st.busyMs += eyeTimeMs() - start;
+		}
+		return 0;
+	}
+
+	unsigned int __stdcall EyePipeline::fitProc(void *p_thread_data) {
+		EyePipeline* self = static_cast<EyePipeline*>(p_thread_data);
+		StageStats & st = self->stats[STAGE_FIT];
+		EyeFrameBuffer* frame;
+
+		while (self->running) {
+			if (!self->fitQueue.wait(frame, stageWaitMs_d)) continue;
+			self->sampleQueue(STAGE_FIT, self->fitQueue);
+			double start = eyeTimeMs();
+
+			if (!frame->skipped && self->fitQueue.size() > 0) {
+				frame->skipped = true;
+				st.drops++;
+			}
+			if (!frame->skipped) {
+				for (int i = 0; i < maxEyeControllers; i++) {
+					const SphereTrack & t = frame->tracks[i];
+					if (t.found && !t.coarse) {
+						frame->fits[i] = self->fitter.fit(frame->masks[i], self->width, self->height, t.roi);
+					}
+					else {
+						ZeroMemory(&frame->fits[i], sizeof(SphereFitResult));
+					}
+				}
+				st.processed++;
+			}
+
+			self->fuseQueue.push(frame);
+			st.busyMs += eyeTimeMs() - start;
+		}
+		return 0;
+	}
+
+	unsigned int __stdcall EyePipeline::fuseProc(void *p_thread_data) {
+		EyePipeline* self = static_cast<EyePipeline*>(p_thread_data);
+		StageStats & st = self->stats[STAGE_FUSE];
+		EyeFrameBuffer* frame;
+
+		while (self->running) {
+			if (!self->fuseQueue.wait(frame, stageWaitMs_d)) continue;
+			self->sampleQueue(STAGE_FUSE, self->fuseQueue);
+			double start = eyeTimeMs();
+
+			if (!frame->skipped) {
+				self->publish(frame);
+				if (self->listener != nullptr) self->listener->eyeUpdated(self->latest);
+				if (self->exporter != nullptr) self->exporter->publish(*frame);		//After the listener: viewers come second to tracking
+				if (self->snapshotState == 1 && InterlockedCompareExchange(&self->snapshotState, 2, 1) == 1) {
+					memcpy(self->snapshotPixels, frame->pixels, self->width * self->height * eyeBytesPerPixel);
+					*self->snapshotResult = self->latest;
+					InterlockedExchange(&self->snapshotState, 0);
+					SetEvent(self->hSnapshot);
+				}
+				st.processed++;
+			}
+
+			self->freeQueue.push(frame);
+			st.busyMs += eyeTimeMs() - start;
+		}
+		return 0;
+	}
+
+	//Fusion thread only
+	void EyePipeline::publish(const EyeFrameBuffer* frame) {
+		InterlockedIncrement(&resultSeq);
+		latest.seq = frame->seq;
+		latest.captureMs = frame->captureMs;
+		latest.doneMs = eyeTimeMs();
+		memcpy(latest.tracks, frame->tracks, sizeof(latest.tracks));
+		memcpy(latest.fits, frame->fits, sizeof(latest.fits));
+		InterlockedIncrement(&resultSeq);
+	}
+
+	//Any thread. Retries instead of blocking when the fusion stage is mid-write.
+	bool EyePipeline::getLatest(EyeResult & out) const {
+		for (int tries = 0; tries < 100; tries++) {
+			LONG before = resultSeq;
+			if (before & 1) {
+				YieldProcessor();
+				continue;
+			}
+			MemoryBarrier();
+			out = latest;
+			MemoryBarrier();
+			if (resultSeq == before) return before != 0;
+		}
+		return false;
+	}
+
+	const StageStats & EyePipeline::getStats(int stage) const {
+		return stats[stage];
+	}
+
+	void EyePipeline::print() const {
+		if (!running) return;
+
+		double elapsed = max(eyeTimeMs() - startMs, 1.0);
+		EyeResult result;
+		double latency = (getLatest(result) ? result.doneMs - result.captureMs : 0);
+
+		printf("PIPELINE %.1f fps  latency:%.1fms\n", stats[STAGE_FUSE].processed * 1000 / elapsed, latency);
+		for (int s = 0; s < numStages; s++) {
+			const StageStats & st = stats[s];
+			printf("  %-8s frames:%ld  drops:%ld  queue:%.2f  busy:%.0f%%\n", stageNames[s], st.processed, st.drops,
+				(st.queueSamples > 0 ? st.queueSum / st.queueSamples : 0), st.busyMs * 100 / elapsed);
+		}
+		if (exporter != nullptr) exporter->print();
+	}
+
+}
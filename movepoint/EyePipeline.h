@@ -0,0 +1,149 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "EyeSegmenter.h"
+#include "SphereTracker.h"
+#include "SphereFit.h"
+#include "SpscQueue.h"
+
+namespace movepoint {
+
+	//Default values
+	const int eyePoolSize_d = 3;			//Frames in flight. Three lets capture, segmentation and fitting overlap.
+	const int captureHz_d = 120;			//Capture rate. The PS Eye runs 120 Hz at 320x240.
+	const DWORD stageWaitMs_d = 10;			//Longest an idle stage sleeps before checking for shutdown
+
+	enum pipelineStage
+	{
+		STAGE_CAPTURE = 0,
+		STAGE_SEGMENT = 1,
+		STAGE_FIT = 2,
+		STAGE_FUSE = 3,
+		numStages = 4
+	};
+
+	//One pooled frame. Buffers are allocated once when the pipeline starts and reused.
+	struct EyeFrameBuffer
+	{
+		unsigned char* pixels;
+		unsigned char* masks[maxEyeControllers];	//Only valid inside tracks[i].roi
+		long long seq;
+		double captureMs;
+		bool skipped;								//A stage fell behind and dropped it; later stages pass it on untouched
+		SphereTrack tracks[maxEyeControllers];
+		SphereFitResult fits[maxEyeControllers];
+	};
+
+	struct EyeResult
+	{
+		long long seq;
+		double captureMs, doneMs;
+		SphereTrack tracks[maxEyeControllers];
+		SphereFitResult fits[maxEyeControllers];
+	};
+
+	struct StageStats
+	{
+		long processed;
+		long drops;
+		double busyMs;
+		double queueSum;					//Input queue length summed at every frame, for the mean occupancy
+		long queueSamples;
+	};
+
+	class FrameExport;
+	class SessionRecorder;
+
+	//Receives every fused result on the fusion thread. Default implementation does nothing.
+	class IEyeListener
+	{
+	public:
+		virtual void eyeUpdated(const EyeResult & result) {}
+	};
+
+	/* Camera processing as four threads (capture, segmentation, fitting, fusion) joined by
+	lock-free single-producer queues. Frames come from a fixed pool and go back to capture
+	after fusion; when every frame is in flight capture drops the camera frame instead of
+	waiting, and a stage with newer frames queued behind the current one skips it. The
+	latest result sits behind a sequence lock, so readers never wait on the pipeline.
+	Capture is the only caller of the camera's getEyeBuffer(), which is not safe to share:
+	the recorder gets every captured frame and the colour planner asks for a snapshot. */
+	class EyePipeline
+	{
+		static const int poolSize = eyePoolSize_d;
+		typedef SpscQueue<EyeFrameBuffer*, poolSize + 1> FrameQueue;
+
+		EyeFrameBuffer pool[poolSize];
+		FrameQueue freeQueue, segmentQueue, fitQueue, fuseQueue;
+		HANDLE hThreads[numStages];
+		volatile LONG running = 0;
+		double startMs = 0;
+
+		Move::IEyeController* eye = nullptr;
+		IEyeListener* listener = nullptr;
+		FrameExport* exporter = nullptr;
+		SessionRecorder* recorder = nullptr;
+		int width = 0, height = 0;
+		long long nextSeq = 0;
+
+		EyeSegmenter segmenter;
+		SphereTracker tracker;
+		SphereFit fitter;
+
+		//Colour changes from other threads, applied by the segmentation stage between frames
+		CRITICAL_SECTION colorLock;
+		volatile LONG colorsChanged = 0;
+		int pendingRgb[maxEyeControllers][3];
+		int pendingState[maxEyeControllers];		//0 = unchanged, 1 = set, 2 = clear
+		int pendingLutBits = -1;
+		volatile LONG targetMask = 0;				//Bit per controller with a target colour, as last set
+
+		//One frame copied out by the fusion stage on request: 0 = none wanted, 1 = wanted, 2 = copying
+		CRITICAL_SECTION snapshotLock;
+		HANDLE hSnapshot = NULL;
+		volatile LONG snapshotState = 0;
+		unsigned char* snapshotPixels = NULL;
+		EyeResult* snapshotResult = nullptr;
+
+		//Latest result behind a sequence lock: odd while the fusion stage is writing it
+		volatile LONG resultSeq = 0;
+		EyeResult latest;
+
+		StageStats stats[numStages];
+
+		static unsigned int __stdcall captureProc(void *p_thread_data);
+		static unsigned int __stdcall segmentProc(void *p_thread_data);
+		static unsigned int __stdcall fitProc(void *p_thread_data);
+		static unsigned int __stdcall fuseProc(void *p_thread_data);
+
+		void allocate();
+		void release();
+		void pinThread(HANDLE hThread, int stage);
+		void applyColors();
+		void sampleQueue(int stage, const FrameQueue & queue);
+		void publish(const EyeFrameBuffer* frame);
+
+	public:
+		int captureHz = captureHz_d;
+		bool pinThreads = true;
+
+		EyePipeline();
+		~EyePipeline();
+		BOOL start(Move::IEyeController* inEye, IEyeListener* inListener = nullptr);
+		void stop();
+		bool isRunning() const;
+		void setExport(FrameExport* inExport);
+		void setRecorder(SessionRecorder* inRecorder);
+		bool snapshot(unsigned char* pixels, EyeResult & result, DWORD timeoutMs);
+
+		void setTarget(int moveId, int r, int g, int b);
+		void clearTargets();
+		bool hasTarget(int moveId) const;
+		void setLookup(int bits);
+
+		bool getLatest(EyeResult & out) const;
+		const StageStats & getStats(int stage) const;
+		void print() const;
+	};
+
+}
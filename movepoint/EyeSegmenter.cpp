@@ -0,0 +1,367 @@
+#include "stdafx.h"
+#include "EyeSegmenter.h"
+#include "MoveColors.h"
+
+#include <intrin.h>
+#include <smmintrin.h>
+#include <immintrin.h>
+
+namespace movepoint {
+
+	EyeSegmenter::EyeSegmenter() {
+		for (int i = 0; i < maxEyeControllers; i++) {
+			targetHue[i] = 0;
+			targetActive[i] = false;
+			masks[i] = NULL;
+		}
+		path = bestPath();
+	}
+
+	EyeSegmenter::~EyeSegmenter() {
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (masks[i] != NULL) _aligned_free(masks[i]);
+		}
+	}
+
+	void EyeSegmenter::setTarget(int moveId, int r, int g, int b) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return;
+		targetHue[moveId] = Move::ColorHsv(Move::ColorRgb(r, g, b)).h;
+		targetActive[moveId] = true;
+		if (useLut) lut.setTarget(moveId, Move::ColorHsv(targetHue[moveId], 1, 1));
+		else lut.clearTarget(moveId);				//Rebuilt for the new hue when the tables are used again
+	}
+
+	void EyeSegmenter::clearTarget(int moveId) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return;
+		targetActive[moveId] = false;
+		lut.clearTarget(moveId);
+	}
+
+	//The SDK picks the colours itself, so whatever we were matching against is stale
+	void EyeSegmenter::setAutomaticColors(bool use) {
+		if (!use) return;
+		for (int i = 0; i < maxEyeControllers; i++) clearTarget(i);
+	}
+
+	bool EyeSegmenter::hasTarget(int moveId) const {
+		return moveId >= 0 && moveId < maxEyeControllers && targetActive[moveId];
+	}
+
+	float EyeSegmenter::getTargetHue(int moveId) const {
+		return targetHue[moveId];
+	}
+
+	void EyeSegmenter::resize(int inWidth, int inHeight) {
+		if (inWidth == width && inHeight == height) return;
+
+		width = inWidth;
+		height = inHeight;
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (masks[i] != NULL) _aligned_free(masks[i]);
+			masks[i] = (unsigned char*)_aligned_malloc(width * height + 32, 32);		//Slack for the last vector store
+			ZeroMemory(masks[i], width * height);
+		}
+	}
+
+	int EyeSegmenter::getWidth() const {
+		return width;
+	}
+
+	int EyeSegmenter::getHeight() const {
+		return height;
+	}
+
+	unsigned char* EyeSegmenter::getMaskBuffer(int moveId) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return NULL;
+		return masks[moveId];
+	}
+
+	void EyeSegmenter::setPath(segmentPath inPath) {
+		path = min(inPath, bestPath());
+	}
+
+	segmentPath EyeSegmenter::getPath() const {
+		return path;
+	}
+
+	void EyeSegmenter::setLookup(bool use, int bits) {
+		useLut = use;
+		if (!use) return;
+
+		lut.build(bits);
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (targetActive[i] && !lut.hasTarget(i)) lut.setTarget(i, Move::ColorHsv(targetHue[i], 1, 1));
+		}
+	}
+
+	bool EyeSegmenter::getLookup() const {
+		return useLut;
+	}
+
+	const ColorLut & EyeSegmenter::getLut() const {
+		return lut;
+	}
+
+	segmentPath EyeSegmenter::bestPath() {
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+
+		//AVX2 also needs the OS to save the upper halves of the registers
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		if (avx2) return SEGMENT_AVX2;
+		if (sse41) return SEGMENT_SSE41;
+		return SEGMENT_SCALAR;
+	}
+
+	void EyeSegmenter::segment(const unsigned char* frame) {
+		if (frame == NULL || width == 0) return;
+		segmentRun(frame, 0, width * height, allTargets);
+	}
+
+	//Only rows inside the rectangle are touched; the rest of each mask keeps its old contents
+	void EyeSegmenter::segment(const unsigned char* frame, const EyeRect & roi, unsigned int targets, int rowStep) {
+		if (frame == NULL || width == 0) return;
+
+		int left = max(roi.left, 0), right = min(roi.right, width);
+		int top = max(roi.top, 0), bottom = min(roi.bottom, height);
+		if (right <= left) return;
+
+		for (int y = top; y < bottom; y += max(rowStep, 1)) {
+			segmentRun(frame, y * width + left, right - left, targets);
+		}
+	}
+
+	void EyeSegmenter::segmentRun(const unsigned char* frame, int start, int count, unsigned int targets) {
+		if (useLut) {
+			segmentLut(frame, start, count, targets);
+			return;
+		}
+
+		switch (path) {
+		case SEGMENT_AVX2:
+			segmentAVX2(frame, start, count, targets);
+			break;
+		case SEGMENT_SSE41:
+			segmentSSE41(frame, start, count, targets);
+			break;
+		default:
+			segmentScalar(frame, start, count, targets);
+			break;
+		}
+	}
+
+	//Reference path: the SDK's per-pixel ColorHsv conversion and similarity score
+	void EyeSegmenter::segmentScalar(const unsigned char* frame, int start, int count, unsigned int targets) {
+		bool active[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) active[i] = targetActive[i] && (targets & (1 << i)) != 0;
+
+		Move::ColorHsv refs[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) refs[i] = Move::ColorHsv(targetHue[i], 1, 1);
+
+		int end = start + count;
+		for (int p = start; p < end; p++) {
+			const unsigned char* px = frame + p * eyeBytesPerPixel;
+			Move::ColorHsv hsv(Move::ColorRgb(px[2], px[1], px[0]));
+			bool bright = hsv.v >= minValue;
+
+			for (int i = 0; i < maxEyeControllers; i++) {
+				if (!active[i]) continue;
+				masks[i][p] = (bright && refs[i].similarity(hsv) >= minSimilarity ? 255 : 0);
+			}
+		}
+	}
+
+	//One table read per pixel and controller, no colour space math at all
+	void EyeSegmenter::segmentLut(const unsigned char* frame, int start, int count, unsigned int targets) {
+		bool active[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) active[i] = targetActive[i] && (targets & (1 << i)) != 0;
+
+		unsigned char cut = (unsigned char)ceil(minSimilarity);
+		const unsigned char* tables[maxEyeControllers];
+		unsigned char* out[maxEyeControllers];
+		int numActive = 0;
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (!active[i]) continue;
+			tables[numActive] = lut.getSimilarityTable(i);
+			out[numActive++] = masks[i];
+		}
+
+		int end = start + count;
+		for (int p = start; p < end; p++) {
+			const unsigned char* px = frame + p * eyeBytesPerPixel;
+			int idx = lut.index(px[2], px[1], px[0]);
+			for (int i = 0; i < numActive; i++) {
+				out[i][p] = (tables[i][idx] >= cut ? 255 : 0);
+			}
+		}
+	}
+
+	//Same decision as the vector paths, for the pixels left over at the end of a run
+	static inline bool classifyTail(const unsigned char* px, float hue, float minMax, float minSim) {
+		float b = px[0], g = px[1], r = px[2];
+		float maxC = max(max(r, g), b);
+		float delta = maxC - min(min(r, g), b);
+		if (maxC < minMax || delta * 100 < minSim * maxC || delta <= 0) return false;
+
+		float h = (r == maxC ? 60 * (g - b) / delta : (g == maxC ? 120 + 60 * (b - r) / delta : 240 + 60 * (r - g) / delta));
+		if (h < 0) h += 360;
+		float d = fabs(h - hue);
+		d = min(d, 360 - d);
+		return (100 - d) * delta / maxC >= minSim;
+	}
+
+	void EyeSegmenter::segmentSSE41(const unsigned char* frame, int start, int count, unsigned int targets) {
+		bool active[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) active[i] = targetActive[i] && (targets & (1 << i)) != 0;
+
+		const __m128i byteMask = _mm_set1_epi32(0xff);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1);
+		const __m128 c60 = _mm_set1_ps(60);
+		const __m128 c100 = _mm_set1_ps(100);
+		const __m128 c120 = _mm_set1_ps(120);
+		const __m128 c240 = _mm_set1_ps(240);
+		const __m128 c360 = _mm_set1_ps(360);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 vMin = _mm_set1_ps(minValue * 255);
+		const __m128 sMin = _mm_set1_ps(minSimilarity / 100);
+		const __m128 simMin = _mm_set1_ps(minSimilarity);
+
+		__m128 th[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) th[i] = _mm_set1_ps(targetHue[i]);
+
+		int end = start + count;
+		int p = start;
+		for (; p + 4 <= end; p += 4) {
+			__m128i px = _mm_loadu_si128((const __m128i*)(frame + p * eyeBytesPerPixel));
+			__m128 b = _mm_cvtepi32_ps(_mm_and_si128(px, byteMask));
+			__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), byteMask));
+			__m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), byteMask));
+
+			__m128 maxC = _mm_max_ps(_mm_max_ps(r, g), b);
+			__m128 delta = _mm_sub_ps(maxC, _mm_min_ps(_mm_min_ps(r, g), b));
+
+			//Early rejection: too dark, or too grey for any hue to reach the similarity cut
+			__m128 valid = _mm_and_ps(_mm_cmpge_ps(maxC, vMin), _mm_cmpge_ps(delta, _mm_mul_ps(sMin, maxC)));
+			valid = _mm_and_ps(valid, _mm_cmpgt_ps(delta, zero));
+			if (_mm_movemask_ps(valid) == 0) {
+				for (int i = 0; i < maxEyeControllers; i++) {
+					if (active[i]) *(int*)(masks[i] + p) = 0;
+				}
+				continue;
+			}
+
+			__m128 inv = _mm_div_ps(c60, _mm_max_ps(delta, one));
+			__m128 hR = _mm_mul_ps(_mm_sub_ps(g, b), inv);
+			__m128 hG = _mm_add_ps(c120, _mm_mul_ps(_mm_sub_ps(b, r), inv));
+			__m128 hB = _mm_add_ps(c240, _mm_mul_ps(_mm_sub_ps(r, g), inv));
+			__m128 h = _mm_blendv_ps(hB, hG, _mm_cmpeq_ps(g, maxC));
+			h = _mm_blendv_ps(h, hR, _mm_cmpeq_ps(r, maxC));
+			h = _mm_add_ps(h, _mm_and_ps(_mm_cmplt_ps(h, zero), c360));
+			__m128 s = _mm_div_ps(delta, _mm_max_ps(maxC, one));
+
+			for (int i = 0; i < maxEyeControllers; i++) {
+				if (!active[i]) continue;
+
+				__m128 d = _mm_and_ps(_mm_sub_ps(h, th[i]), absMask);
+				d = _mm_min_ps(d, _mm_sub_ps(c360, d));
+				__m128 sim = _mm_mul_ps(_mm_sub_ps(c100, d), s);
+				__m128i m = _mm_castps_si128(_mm_and_ps(valid, _mm_cmpge_ps(sim, simMin)));
+
+				m = _mm_packs_epi32(m, m);
+				m = _mm_packs_epi16(m, m);
+				*(int*)(masks[i] + p) = _mm_cvtsi128_si32(m);
+			}
+		}
+
+		for (; p < end; p++) {
+			for (int i = 0; i < maxEyeControllers; i++) {
+				if (!active[i]) continue;
+				masks[i][p] = (classifyTail(frame + p * eyeBytesPerPixel, targetHue[i], minValue * 255, minSimilarity) ? 255 : 0);
+			}
+		}
+	}
+
+	void EyeSegmenter::segmentAVX2(const unsigned char* frame, int start, int count, unsigned int targets) {
+		bool active[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) active[i] = targetActive[i] && (targets & (1 << i)) != 0;
+
+		const __m256i byteMask = _mm256_set1_epi32(0xff);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1);
+		const __m256 c60 = _mm256_set1_ps(60);
+		const __m256 c100 = _mm256_set1_ps(100);
+		const __m256 c120 = _mm256_set1_ps(120);
+		const __m256 c240 = _mm256_set1_ps(240);
+		const __m256 c360 = _mm256_set1_ps(360);
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		const __m256 vMin = _mm256_set1_ps(minValue * 255);
+		const __m256 sMin = _mm256_set1_ps(minSimilarity / 100);
+		const __m256 simMin = _mm256_set1_ps(minSimilarity);
+
+		__m256 th[maxEyeControllers];
+		for (int i = 0; i < maxEyeControllers; i++) th[i] = _mm256_set1_ps(targetHue[i]);
+
+		int end = start + count;
+		int p = start;
+		for (; p + 8 <= end; p += 8) {
+			__m256i px = _mm256_loadu_si256((const __m256i*)(frame + p * eyeBytesPerPixel));
+			__m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(px, byteMask));
+			__m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask));
+			__m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask));
+
+			__m256 maxC = _mm256_max_ps(_mm256_max_ps(r, g), b);
+			__m256 delta = _mm256_sub_ps(maxC, _mm256_min_ps(_mm256_min_ps(r, g), b));
+
+			__m256 valid = _mm256_and_ps(_mm256_cmp_ps(maxC, vMin, _CMP_GE_OQ), _mm256_cmp_ps(delta, _mm256_mul_ps(sMin, maxC), _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(delta, zero, _CMP_GT_OQ));
+			if (_mm256_movemask_ps(valid) == 0) {
+				for (int i = 0; i < maxEyeControllers; i++) {
+					if (active[i]) *(long long*)(masks[i] + p) = 0;
+				}
+				continue;
+			}
+
+			__m256 inv = _mm256_div_ps(c60, _mm256_max_ps(delta, one));
+			__m256 hR = _mm256_mul_ps(_mm256_sub_ps(g, b), inv);
+			__m256 hG = _mm256_add_ps(c120, _mm256_mul_ps(_mm256_sub_ps(b, r), inv));
+			__m256 hB = _mm256_add_ps(c240, _mm256_mul_ps(_mm256_sub_ps(r, g), inv));
+			__m256 h = _mm256_blendv_ps(hB, hG, _mm256_cmp_ps(g, maxC, _CMP_EQ_OQ));
+			h = _mm256_blendv_ps(h, hR, _mm256_cmp_ps(r, maxC, _CMP_EQ_OQ));
+			h = _mm256_add_ps(h, _mm256_and_ps(_mm256_cmp_ps(h, zero, _CMP_LT_OQ), c360));
+			__m256 s = _mm256_div_ps(delta, _mm256_max_ps(maxC, one));
+
+			for (int i = 0; i < maxEyeControllers; i++) {
+				if (!active[i]) continue;
+
+				__m256 d = _mm256_and_ps(_mm256_sub_ps(h, th[i]), absMask);
+				d = _mm256_min_ps(d, _mm256_sub_ps(c360, d));
+				__m256 sim = _mm256_mul_ps(_mm256_sub_ps(c100, d), s);
+				__m256i m = _mm256_castps_si256(_mm256_and_ps(valid, _mm256_cmp_ps(sim, simMin, _CMP_GE_OQ)));
+
+				__m128i m16 = _mm_packs_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+				_mm_storel_epi64((__m128i*)(masks[i] + p), _mm_packs_epi16(m16, m16));
+			}
+		}
+		_mm256_zeroupper();
+
+		for (; p < end; p++) {
+			for (int i = 0; i < maxEyeControllers; i++) {
+				if (!active[i]) continue;
+				masks[i][p] = (classifyTail(frame + p * eyeBytesPerPixel, targetHue[i], minValue * 255, minSimilarity) ? 255 : 0);
+			}
+		}
+	}
+
+}
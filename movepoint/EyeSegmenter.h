@@ -0,0 +1,71 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "ColorLut.h"
+
+namespace movepoint {
+
+	//Default values
+	const float segMinValue_d = 0.7f;			//Pixels darker than this are never the sphere (same cut as ColorHsv::similarity)
+	const float segMinSimilarity_d = 40;		//Minimum ColorHsv::similarity score (0..100) for a mask pixel
+
+	const unsigned int allTargets = (1 << maxEyeControllers) - 1;
+
+	enum segmentPath
+	{
+		SEGMENT_SCALAR = 0,
+		SEGMENT_SSE41 = 1,
+		SEGMENT_AVX2 = 2
+	};
+
+	/* Classifies whole PS Eye frames against each controller's target hue and writes one
+	byte mask per controller (255 = sphere colour). Pixels failing the value or saturation
+	cut are rejected before any hue math, four (SSE4.1) or eight (AVX2) at a time. */
+	class EyeSegmenter
+	{
+		float targetHue[maxEyeControllers];
+		bool targetActive[maxEyeControllers];
+
+		unsigned char* masks[maxEyeControllers];
+		int width = 0, height = 0;
+		segmentPath path;
+
+		ColorLut lut;
+		bool useLut = false;
+
+		//Classify pixels start..start+count-1 for the controllers in the targets bit mask
+		void segmentRun(const unsigned char* frame, int start, int count, unsigned int targets);
+		void segmentScalar(const unsigned char* frame, int start, int count, unsigned int targets);
+		void segmentLut(const unsigned char* frame, int start, int count, unsigned int targets);
+		void segmentSSE41(const unsigned char* frame, int start, int count, unsigned int targets);
+		void segmentAVX2(const unsigned char* frame, int start, int count, unsigned int targets);
+
+	public:
+		float minValue = segMinValue_d;
+		float minSimilarity = segMinSimilarity_d;
+
+		EyeSegmenter();
+		~EyeSegmenter();
+
+		void setTarget(int moveId, int r, int g, int b);
+		void clearTarget(int moveId);
+		void setAutomaticColors(bool use);
+		bool hasTarget(int moveId) const;
+		float getTargetHue(int moveId) const;
+
+		void resize(int inWidth, int inHeight);
+		void segment(const unsigned char* frame);
+		void segment(const unsigned char* frame, const EyeRect & roi, unsigned int targets = allTargets, int rowStep = 1);
+		int getWidth() const;
+		int getHeight() const;
+		unsigned char* getMaskBuffer(int moveId);
+
+		static segmentPath bestPath();
+		void setPath(segmentPath inPath);
+		segmentPath getPath() const;
+		void setLookup(bool use, int bits = lutBits_d);
+		bool getLookup() const;
+		const ColorLut & getLut() const;
+	};
+
+}
@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "FrameCodec.h"
+
+namespace movepoint {
+
+	//Tags. The two bit ones sit in the top bits; the full byte ones take two values of the run range.
+	static const unsigned char opIndex = 0x00;
+	static const unsigned char opDiff = 0x40;
+	static const unsigned char opLuma = 0x80;
+	static const unsigned char opRun = 0xC0;
+	static const unsigned char opColor = 0xFE;
+	static const unsigned char opColorAlpha = 0xFF;
+	static const int maxRun = 62;
+
+	//Pixels are BGRA in memory, compared as one 32 bit value
+	static inline unsigned int pixelHash(unsigned int px) {
+		unsigned int b = px & 0xFF, g = (px >> 8) & 0xFF, r = (px >> 16) & 0xFF, a = px >> 24;
+		return (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+	}
+
+	int encodeFrame(const unsigned char* pixels, int count, unsigned char* out) {
+		unsigned int cache[64];
+		ZeroMemory(cache, sizeof(cache));
+		const unsigned int* px = (const unsigned int*)pixels;
+		unsigned int prev = 0xFF000000;
+		unsigned char* o = out;
+		int run = 0;
+
+		for (int i = 0; i < count; i++) {
+			unsigned int cur = px[i];
+			if (cur == prev) {
+				if (++run == maxRun) {
+					*o++ = opRun | (run - 1);
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0) {
+				*o++ = opRun | (run - 1);
+				run = 0;
+			}
+
+			unsigned int h = pixelHash(cur);
+			if (cache[h] == cur) {
+				*o++ = opIndex | h;
+			}
+			else if ((cur >> 24) == (prev >> 24)) {
+				cache[h] = cur;
+				int db = (int)(cur & 0xFF) - (int)(prev & 0xFF);
+				int dg = (int)((cur >> 8) & 0xFF) - (int)((prev >> 8) & 0xFF);
+				int dr = (int)((cur >> 16) & 0xFF) - (int)((prev >> 16) & 0xFF);
+				db = (signed char)db;
+				dg = (signed char)dg;
+				dr = (signed char)dr;
+				int dr_dg = dr - dg, db_dg = db - dg;
+
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					*o++ = opDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+				}
+				else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+					*o++ = opLuma | (dg + 32);
+					*o++ = ((dr_dg + 8) << 4) | (db_dg + 8);
+				}
+				else {
+					*o++ = opColor;
+					*o++ = (cur >> 16) & 0xFF;
+					*o++ = (cur >> 8) & 0xFF;
+					*o++ = cur & 0xFF;
+				}
+			}
+			else {
+				cache[h] = cur;
+				*o++ = opColorAlpha;
+				memcpy(o, &cur, 4);
+				o += 4;
+			}
+			prev = cur;
+		}
+		if (run > 0) *o++ = opRun | (run - 1);
+
+		return (int)(o - out);
+	}
+
+	bool decodeFrame(const unsigned char* in, int bytes, unsigned char* pixels, int count) {
+		unsigned int cache[64];
+		ZeroMemory(cache, sizeof(cache));
+		unsigned int* px = (unsigned int*)pixels;
+		unsigned int prev = 0xFF000000;
+		const unsigned char* end = in + bytes;
+		int i = 0;
+
+		while (i < count && in < end) {
+			unsigned char op = *in++;
+
+			if (op == opColor) {
+				if (end - in < 3) return false;
+				prev = (prev & 0xFF000000) | (in[0] << 16) | (in[1] << 8) | in[2];
+				in += 3;
+			}
+			else if (op == opColorAlpha) {
+				if (end - in < 4) return false;
+				memcpy(&prev, in, 4);
+				in += 4;
+			}
+			else if ((op & 0xC0) == opIndex) {
+				prev = cache[op];
+				px[i++] = prev;
+				continue;				//Already in the cache
+			}
+			else if ((op & 0xC0) == opDiff) {
+				int dr = ((op >> 4) & 3) - 2, dg = ((op >> 2) & 3) - 2, db = (op & 3) - 2;
+				unsigned int r = (((prev >> 16) & 0xFF) + dr) & 0xFF;
+				unsigned int g = (((prev >> 8) & 0xFF) + dg) & 0xFF;
+				unsigned int b = ((prev & 0xFF) + db) & 0xFF;
+				prev = (prev & 0xFF000000) | (r << 16) | (g << 8) | b;
+			}
+			else if ((op & 0xC0) == opLuma) {
+				if (in >= end) return false;
+				int dg = (op & 0x3F) - 32;
+				int dr = dg + ((*in >> 4) & 0x0F) - 8;
+				int db = dg + (*in & 0x0F) - 8;
+				in++;
+				unsigned int r = (((prev >> 16) & 0xFF) + dr) & 0xFF;
+				unsigned int g = (((prev >> 8) & 0xFF) + dg) & 0xFF;
+				unsigned int b = ((prev & 0xFF) + db) & 0xFF;
+				prev = (prev & 0xFF000000) | (r << 16) | (g << 8) | b;
+			}
+			else {
+				int run = (op & 0x3F) + 1;
+				if (run > count - i) return false;
+				while (run-- > 0) px[i++] = prev;
+				continue;
+			}
+
+			cache[pixelHash(prev)] = prev;
+			px[i++] = prev;
+		}
+		return i == count && in == end;
+	}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+
+namespace movepoint {
+
+	/* Lossless frame compression in the style of QOI: each pixel becomes a run, a reference
+	into a 64 entry cache of recent colours, a small difference from the previous pixel, or
+	the raw bytes. One pass, no tables to build, and several hundred MB/s on one core, so a
+	recorder keeps up with the camera without a codec library. */
+
+	//Worst case output for count pixels
+	inline int frameCodecBound(int count) {
+		return count * (eyeBytesPerPixel + 1) + 8;
+	}
+
+	//Returns the number of bytes written to out, which must hold frameCodecBound(count)
+	int encodeFrame(const unsigned char* pixels, int count, unsigned char* out);
+
+	//False if the data is damaged or does not decode to exactly count pixels
+	bool decodeFrame(const unsigned char* in, int bytes, unsigned char* pixels, int count);
+
+}
@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "FrameExport.h"
+
+namespace movepoint {
+
+	//Slots start on cache lines so the producer and a reader never share one across slots
+	static int alignUp(int bytes) {
+		return (bytes + 63) & ~63;
+	}
+
+	FrameExport::FrameExport() {
+	}
+
+	FrameExport::~FrameExport() {
+		close();
+	}
+
+	BOOL FrameExport::open(int width, int height) {
+		if (view != NULL) close();
+		slots = max(slots, 2);
+
+		int pixelOffset = alignUp(sizeof(ExportSlot));
+		int maskOffset = pixelOffset + alignUp(width * height * eyeBytesPerPixel);
+		int slotBytes = maskOffset + alignUp(width * height * maxEyeControllers);
+		int slotOffset = alignUp(sizeof(ExportHeader));
+		DWORD total = slotOffset + slotBytes * slots;
+
+		hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, total, EXPORT_MAPPING_NAME);
+		if (hMapping == NULL) {
+			printf("Frame export: could not create the shared memory (error %lu). \n", GetLastError());
+			return false;
+		}
+		view = (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, total);
+		if (view == NULL) {
+			CloseHandle(hMapping);
+			hMapping = NULL;
+			return false;
+		}
+
+		//A reader may already hold the mapping open from an earlier run, so lay it out afresh
+		ZeroMemory(view, total);
+		header = (ExportHeader*)view;
+		header->width = width;
+		header->height = height;
+		header->slots = slots;
+		header->slotOffset = slotOffset;
+		header->slotBytes = slotBytes;
+		header->pixelOffset = pixelOffset;
+		header->maskOffset = maskOffset;
+		header->latest = -1;
+		header->version = exportVersion;
+		MemoryBarrier();
+		header->magic = exportMagic;			//Last, so readers never see a half written header
+		next = 0;
+
+		printf("Frame export: %d slots of %dx%d, %lu KB shared. \n", slots, width, height, total / 1024);
+		return true;
+	}
+
+	void FrameExport::close() {
+		if (view != NULL) {
+			header->magic = 0;
+			UnmapViewOfFile(view);
+		}
+		if (hMapping != NULL) CloseHandle(hMapping);
+		view = NULL;
+		header = NULL;
+		hMapping = NULL;
+	}
+
+	bool FrameExport::isOpen() const {
+		return view != NULL;
+	}
+
+	ExportSlot* FrameExport::slotAt(int index) const {
+		return (ExportSlot*)(view + header->slotOffset + index * header->slotBytes);
+	}
+
+	//Fusion thread only
+	void FrameExport::publish(const EyeFrameBuffer & frame) {
+		if (view == NULL) return;
+
+		int width = header->width;
+		ExportSlot* slot = slotAt(next);
+		unsigned char* base = (unsigned char*)slot;
+
+		InterlockedIncrement(&slot->seq);			//Odd: readers holding this slot will fail release()
+		slot->frameSeq = frame.seq;
+		slot->captureMs = frame.captureMs;
+		memcpy(base + header->pixelOffset, frame.pixels, width * header->height * eyeBytesPerPixel);
+
+		for (int i = 0; i < maxEyeControllers; i++) {
+			const SphereTrack & t = frame.tracks[i];
+			const SphereFitResult & f = frame.fits[i];
+			ExportTrack & e = slot->tracks[i];
+			e.found = t.found;
+			e.x = t.x;
+			e.y = t.y;
+			e.radius = t.radius;
+			e.fitX = f.x;
+			e.fitY = f.y;
+			e.fitRadius = f.radius;
+			e.fitQuality = (f.valid ? f.quality : 0);
+			e.roi = t.roi;
+
+			//Only the window holds a current mask; outside it the pipeline never wrote one
+			if (!t.found || t.coarse) {
+				ZeroMemory(&e.roi, sizeof(e.roi));
+				continue;
+			}
+			unsigned char* mask = base + header->maskOffset + i * width * header->height;
+			for (int y = t.roi.top; y < t.roi.bottom; y++) {
+				int offset = y * width + t.roi.left;
+				memcpy(mask + offset, frame.masks[i] + offset, t.roi.right - t.roi.left);
+			}
+		}
+
+		InterlockedIncrement(&slot->seq);
+		InterlockedExchange(&header->latest, next);
+		InterlockedIncrement(&header->published);
+		next = (next + 1) % header->slots;
+	}
+
+	void FrameExport::print() const {
+		if (view == NULL) return;
+		printf("EXPORT slots:%d  published:%ld  latest:%ld\n", header->slots, header->published, header->latest);
+	}
+
+	FrameExportReader::~FrameExportReader() {
+		close();
+	}
+
+	BOOL FrameExportReader::open() {
+		close();
+		hMapping = OpenFileMapping(FILE_MAP_READ, FALSE, EXPORT_MAPPING_NAME);
+		if (hMapping == NULL) return false;
+
+		view = (const unsigned char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL || getHeader()->magic != exportMagic || getHeader()->version != exportVersion) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void FrameExportReader::close() {
+		if (view != NULL) UnmapViewOfFile(view);
+		if (hMapping != NULL) CloseHandle(hMapping);
+		view = NULL;
+		hMapping = NULL;
+	}
+
+	const ExportHeader* FrameExportReader::getHeader() const {
+		return (const ExportHeader*)view;
+	}
+
+	//NULL when nothing has been published yet or the producer is mid-write on the newest slot
+	const ExportSlot* FrameExportReader::acquire(LONG & seq) const {
+		if (view == NULL) return NULL;
+
+		const ExportHeader* header = getHeader();
+		LONG latest = header->latest;
+		if (header->magic != exportMagic || latest < 0 || latest >= header->slots) return NULL;
+
+		const ExportSlot* slot = (const ExportSlot*)(view + header->slotOffset + latest * header->slotBytes);
+		seq = slot->seq;
+		MemoryBarrier();
+		return ((seq & 1) == 0 ? slot : NULL);
+	}
+
+	bool FrameExportReader::release(const ExportSlot* slot, LONG seq) const {
+		MemoryBarrier();
+		return slot != NULL && slot->seq == seq && getHeader()->magic == exportMagic;
+	}
+
+	const unsigned char* FrameExportReader::getPixels(const ExportSlot* slot) const {
+		return (const unsigned char*)slot + getHeader()->pixelOffset;
+	}
+
+	const unsigned char* FrameExportReader::getMask(const ExportSlot* slot, int moveId) const {
+		const ExportHeader* header = getHeader();
+		return (const unsigned char*)slot + header->maskOffset + moveId * header->width * header->height;
+	}
+
+}
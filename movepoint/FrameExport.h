@@ -0,0 +1,92 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "EyePipeline.h"
+
+namespace movepoint {
+
+	//Default values
+	const int exportSlots_d = 4;					//Frames kept in the ring. A reader has slots-1 frame times to finish with one.
+	const DWORD exportMagic = 0x4645504D;			//'MPEF'
+	const DWORD exportVersion = 1;
+	#define EXPORT_MAPPING_NAME TEXT("Local\\MOVEpointEyeFrames")
+
+	//Per controller, as the pipeline saw it. The mask is only written inside roi.
+	struct ExportTrack
+	{
+		int found;
+		float x, y, radius;
+		float fitX, fitY, fitRadius, fitQuality;
+		EyeRect roi;
+	};
+
+	/* Start of every slot. seq is odd while the producer is writing the slot and moves on
+	by two with every frame, so a reader that sees the same even value before and after
+	using the slot knows nothing changed underneath it. */
+	struct ExportSlot
+	{
+		volatile LONG seq;
+		LONG reserved;
+		long long frameSeq;
+		double captureMs;
+		ExportTrack tracks[maxEyeControllers];
+	};
+
+	//Start of the mapping. Slots follow at slotOffset, slotBytes apart.
+	struct ExportHeader
+	{
+		DWORD magic;
+		DWORD version;
+		int width, height;
+		int slots;
+		int slotOffset, slotBytes;
+		int pixelOffset, maskOffset;				//From the start of a slot. Masks are width*height bytes, one per controller.
+		volatile LONG latest;						//Newest complete slot, -1 before the first frame
+		volatile LONG published;					//Frames written since the mapping was created
+	};
+
+	/* Publishes camera frames and sphere masks to a named shared-memory ring, so viewers and
+	recorders in other processes can read them in place. The fusion stage writes one slot
+	per frame and moves on; it never waits for, or even knows about, readers. */
+	class FrameExport
+	{
+		HANDLE hMapping = NULL;
+		unsigned char* view = NULL;
+		ExportHeader* header = NULL;
+		int next = 0;
+
+		ExportSlot* slotAt(int index) const;
+
+	public:
+		int slots = exportSlots_d;
+
+		FrameExport();
+		~FrameExport();
+
+		BOOL open(int width, int height);
+		void close();
+		bool isOpen() const;
+		void publish(const EyeFrameBuffer & frame);
+		void print() const;
+	};
+
+	/* Reading side, for other processes. acquire() hands out the newest slot and its
+	sequence number; the data is only trustworthy if release() still returns true. */
+	class FrameExportReader
+	{
+		HANDLE hMapping = NULL;
+		const unsigned char* view = NULL;
+
+	public:
+		~FrameExportReader();
+
+		BOOL open();
+		void close();
+		const ExportHeader* getHeader() const;
+		const ExportSlot* acquire(LONG & seq) const;
+		bool release(const ExportSlot* slot, LONG seq) const;
+		const unsigned char* getPixels(const ExportSlot* slot) const;
+		const unsigned char* getMask(const ExportSlot* slot, int moveId) const;
+	};
+
+}
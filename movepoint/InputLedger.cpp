@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include "InputLedger.h"
+#include "win_actions.h"
+
+#include <process.h>
+
+using namespace win_actions;
+
+namespace movepoint {
+
+	InputLedger::InputLedger() {
+		ZeroMemory(seenUp, sizeof(seenUp));
+	}
+
+	InputLedger::~InputLedger() {
+		stop();
+	}
+
+	BOOL InputLedger::start() {
+		if (hThread != NULL) return true;
+
+		hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		return hThread != NULL;
+	}
+
+	void InputLedger::stop() {
+		if (hThread == NULL) return;
+
+		SetEvent(hStop);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		CloseHandle(hStop);
+		hThread = hStop = NULL;
+	}
+
+	//Sensor thread, every frame
+	void InputLedger::frame(int buttons) {
+		LONG now = (LONG)GetTickCount();
+		InterlockedExchange(&lastFrame, now);
+		if (buttons != 0) InterlockedExchange(&lastPressed, now);
+	}
+
+	//Any thread
+	UINT InputLedger::releaseAll(const char* reason) {
+		UINT count = releaseInput();
+		if (count > 0) {
+			InterlockedIncrement(&releaseCount);
+			printf("INPUT released %u held keys and buttons: %s\n", count, reason);
+		}
+		return count;
+	}
+
+	//False while a desktop we cannot open, such as the UAC prompt, has the input
+	static bool ownsInput() {
+		HDESK hDesk = OpenInputDesktop(0, FALSE, DESKTOP_READOBJECTS);
+		if (hDesk == NULL) return false;
+		CloseDesktop(hDesk);
+		return true;
+	}
+
+	void InputLedger::reconcile() {
+		byte keys[256];
+		int count = heldInput(keys, 256);
+		if (count == 0) return;
+
+		//GetAsyncKeyState reads every key as up on another desktop; start counting again when we are back
+		if (!ownsInput()) {
+			ZeroMemory(seenUp, sizeof(seenUp));
+			count = 0;
+		}
+
+		//Dropped only when seen up twice in a row; a key just pressed may not have reached the system yet
+		for (int i = 0; i < count; i++) {
+			byte vk = keys[i];
+			if (vk == VK_LBUTTON || vk == VK_MBUTTON || vk == VK_RBUTTON) continue;		//Swapped buttons make these unreliable
+			bool up = (GetAsyncKeyState(vk) & 0x8000) == 0;
+			if (up && seenUp[vk]) {
+				forgetInput(vk);
+				forgetCount++;
+				up = false;
+			}
+			seenUp[vk] = up;
+		}
+
+		DWORD now = GetTickCount();
+		DWORD frameAge = now - (DWORD)lastFrame;
+		DWORD pressAge = now - (DWORD)lastPressed;
+		if (lastFrame != 0 && frameAge > inputStaleMs_d) releaseAll("controller lost");
+		else if (lastFrame != 0 && pressAge > inputIdleMs_d) releaseAll("no controller button down");
+	}
+
+	unsigned int __stdcall InputLedger::threadProc(void *p_thread_data) {
+		InputLedger* self = static_cast<InputLedger*>(p_thread_data);
+
+		while (WaitForSingleObject(self->hStop, inputReconcileMs_d) == WAIT_TIMEOUT) {
+			self->reconcile();
+		}
+		return 0;
+	}
+
+	void InputLedger::print() const {
+		byte keys[256];
+		int count = heldInput(keys, 256);
+		printf("INPUT held:%d  forgotten:%lu  releases:%ld\n", count, forgetCount, releaseCount);
+	}
+
+}
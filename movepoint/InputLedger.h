@@ -0,0 +1,45 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	//Default values
+	const DWORD inputReconcileMs_d = 200;		//How often held input is checked
+	const DWORD inputIdleMs_d = 500;			//Input still held this long after the last controller button went up is stuck
+	const DWORD inputStaleMs_d = 1000;			//No controller frame for this long: the controller is gone
+
+	/* Watches the keys and mouse buttons win_actions has pressed and not released. Every
+	hold the button handlers make (Alt while app switching, the left button while dragging,
+	a profile chord held with its button) lasts only while some controller button is down,
+	so anything still held once all buttons have been up for a while lost its release edge.
+	That, and a controller that stops sending frames, releases everything in one SendInput
+	call. Keys the system already reports up, because the user pressed and released them
+	too, are simply dropped from the ledger.
+
+	Shutdown, suspend and session changes release everything directly through releaseAll(). */
+	class InputLedger
+	{
+		HANDLE hThread = NULL;
+		HANDLE hStop = NULL;
+		volatile LONG lastFrame = 0;			//Tick counts from the sensor thread
+		volatile LONG lastPressed = 0;
+		volatile LONG releaseCount = 0;
+
+		//Ledger thread only
+		bool seenUp[256];						//Reported up by the system on the last check
+		unsigned long forgetCount = 0;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+		void reconcile();
+
+	public:
+		InputLedger();
+		~InputLedger();
+		BOOL start();
+		void stop();
+		void frame(int buttons);
+		UINT releaseAll(const char* reason);
+		void print() const;
+	};
+
+}
@@ -4,16 +4,37 @@
 	MoveObserver::MoveObserver()
 	{
 		setupConsole();					//setting up the console window
+		InitializeCriticalSection(&lifecycleLock);
 
 		checkAdminRights();				//check if program has admin rights and prompt if not
+		control.start(this);			//heartbeat and commands shared with MovePointBase
 
+		cfg = settings.acquire();
 		initValues();					//intial values for variables
 		restoreDefaults();				//default settings
 		readSettings();					//read settings from registry
+		settings.start();				//registry edits from outside and asynchronous saves
+		appProfiles.load();				//per-application button bindings
+
+		shell.start(this);				//display change and foreground window notifications
+		targets.start();				//window under the cursor, looked up in the background
+		drag.start(&display);			//window dragging paced by the display refresh
+		snapLayout.init(&display, &drag);
+		desktops.start();				//virtual desktops through the shell, or shortcuts
+		inputLedger.start();			//releases keys left held down
 
 		move = Move::createDevice();
 		pairNewMoves();					//This pairs any unpaired controllers via USB
+		restoreWarmState();				//orientation baseline and noise floor from the last run
 		initializeSystem();
+		control.setMoves(numMoves);
+
+		//Commands and session events are ignored until now; a lock that came in meanwhile takes effect here
+		EnterCriticalSection(&lifecycleLock);
+		started = true;
+		control.setState(WORKER_RUNNING);
+		if (sessionLocked) suspend("session locked");
+		LeaveCriticalSection(&lifecycleLock);
 
 	}
 
@@ -48,8 +69,20 @@
 
 		if (numMoves > 0) {
 			move->unsubsribe(this);
+			colorPlanner.stop();
+			eyePipeline.stop();			//Feeds the recorder
+			recorder.stop();
+			clearFitQuality();
 			move->closeCamera();
 		}
+		settings.stop();
+		warm.stop();
+		inputLedger.stop();
+		inputLedger.releaseAll("shutting down");
+		control.stop();
+		desktops.stop();
+		drag.stop();
+		targets.stop();
 		move->closeMoves();
 		delete move;			//<--This would throw an exception
 		move = nullptr;
@@ -60,6 +93,7 @@
 #ifdef DEBUG
 		printf("MOVE id:%d   button pressed: %d\n", moveId, (int)keyCode);
 #endif
+		keyMoveId = moveId;
 		moveKeyProc(keyCode, 1);
 
 	}
@@ -75,18 +109,77 @@
 	void MoveObserver::moveUpdated(int moveId, Move::MoveData data)
 	{
 
-		//Update position info
-		curPosNorm.x = max(min((data.position.x - ctrlRegion.left) / (ctrlRegion.right - ctrlRegion.left), 1), 0);
-		curPosNorm.y = (1 - max(min((data.position.y - ctrlRegion.bottom) / (ctrlRegion.top - ctrlRegion.bottom), 1), 0));
-		curPosNorm.z = data.position.z;
+		cur_FT = fetchFileTime();
+		recorder.recordMove(moveId, data);
+		inputLedger.frame(data.buttons);
+		control.frame();
+
+		//Released here, after the last frame that got past the check below has injected its input
+		const char* release = (const char*)InterlockedExchangePointer((PVOID volatile *)&releaseReason, NULL);
+		if (release != nullptr) {
+			drag.end();
+			inputLedger.releaseAll(release);
+		}
+		if (paused) return;
+
+		//First frame after a pause: button releases may have been missed and the controller has moved
+		bool resumed = InterlockedExchange(&resumePending, 0) != 0;
+		if (resumed) {
+			resetModes();
+			for (int i = 0; i < maxEyeControllers; i++) trackers[i].reset();	//History from before the pause would call the sphere frozen
+			resumeFrom = lastRaw;
+		}
+		if (InterlockedExchange(&recalibratePending, 0) != 0 && controllerOn) {
+			takeInitReading = true;
+			calibrateRegion();
+		}
+
+		//Settings published since the last frame take effect here, never halfway through one
+		if (settings.getSerial() != appliedSerial) calSettings();
+		if (cfg->metricPosition) metricPos(moveId, data.position);
+
+		//Is the camera still seeing the sphere? Judged on the raw position: the median repeats
+		//stored samples exactly, which the freeze detector would take for a lost sphere.
+		TrackingQuality & tracking = trackingOf(moveId);
+		trackState = tracking.update(data, cur_FT);
+		Move::Vec3 raw = data.position;
+
+		//Reject single-frame camera glitches before the cursor sees the position
+		data.position = outlierFilter.filter(data.position);
+
+		if (!tracking.isLost()) {
+			//Update position info
+			curPosNorm.x = max(min((data.position.x - cfg->ctrlRegion.left) / (cfg->ctrlRegion.right - cfg->ctrlRegion.left), 1), 0);
+			curPosNorm.y = (1 - max(min((data.position.y - cfg->ctrlRegion.bottom) / (cfg->ctrlRegion.top - cfg->ctrlRegion.bottom), 1), 0));
+			curPosNorm.z = data.position.z;
+
+			//Update moving average
+			avgPos.x = posWeight.x * data.position.x + (1 - posWeight.x) * avgPos.x;
+			avgPos.y = posWeight.y * data.position.y + (1 - posWeight.y) * avgPos.y;
+			avgPos.z = posWeight.z * data.position.z + (1 - posWeight.z) * avgPos.z;
+
+			//Measure the noise floor while the controller is held still
+			if (cfg->autoTune) {
+				//Still means the gyro is quiet and the position stays within the largest allowed dead zone
+				bool still = data.angularVelocity.length() < stillAngular_d
+					&& fabs(data.position.x - avgPos.x) < cfg->thresholdMax && fabs(data.position.y - avgPos.y) < cfg->thresholdMax;
+				if (noise.update(data.position, still)) applyNoiseEstimate();
+			}
 
-		//Update moving average
-		avgPos.x = curPosWeight * data.position.x + (1 - curPosWeight) * avgPos.x;
-		avgPos.y = curPosWeight * data.position.y + (1 - curPosWeight) * avgPos.y;
-		avgPos.z = curPosWeight * data.position.z + (1 - curPosWeight) * avgPos.z;
+			if (trackState == TRACKING_REACQUIRED || resumed) {
+				avgPos = data.position;						//Don't let the average drag the cursor from the old position
+				reanchorCursor();
+			}
+			//The SDK repeats the last camera position until the camera sees the sphere again
+			bool fresh = eyeFrames != resumeEyeFrames
+				|| raw.x != resumeFrom.x || raw.y != resumeFrom.y || raw.z != resumeFrom.z;
+			if (resumeStart != 0 && fresh) noteCursorMove();
+		}
+		lastRaw = raw;
 
 		if (oldPos.x < -10000) updatePos(data);			//Update previous position
 		if (takeInitReading) takeInitOrient(data);		//Initial orientation
+		if (!tracking.isLost()) checkpointWarmState();
 
 														//Check if we are in calibration mode
 		if (calibrationMode > 0) {
@@ -94,8 +187,6 @@
 		}
 		else if (scrollMode || snapMode || mouseMode || dragMode || keyboardMode) {
 
-			cur_FT = fetchFileTime();
-
 			//Check if we are in scroll mode
 			if (scrollMode && (double)(cur_FT.QuadPart - lHandler_FT.QuadPart) > myScrollDelay) {
 				scroll(moveId, data);
@@ -106,10 +197,7 @@
 			}
 			//Check if we are in mouse mode
 			else if ((mouseMode || dragMode || dragMode2) && (double)(cur_FT.QuadPart - moveHandler_FT.QuadPart) > myMoveDelay) {
-				moveCursor(moveId, data);
-				if (dragMode || dragMode2) {
-					dragWindow(moveId);
-				}
+				moveCursor(moveId, data);		//In drag mode the drag engine moves the window after the cursor
 			}
 			else if (keyboardMode && (double)(cur_FT.QuadPart - keyboardClick_FT.QuadPart) > myMoveDelay) {
 				moveArrows(moveId, data);
@@ -121,6 +209,7 @@
 			printDebugMessage(moveId, data);
 		}
 
+		lastOrient = data.orientation;
 	}
 
 	void MoveObserver::navKeyPressed(int navId, Move::MoveButton keyCode)
@@ -144,6 +233,185 @@
 	void MoveObserver::extraStableY(BOOL stabilize) {
 		stableY = stabilize;
 	}
+	//The sensor thread picks these up with the next frame
+	void MoveObserver::setOutlierFilter(outlierMode mode) {
+		Settings s;
+		settings.copy(s);
+		s.prefilterMode = mode;
+		settings.publish(s);
+	}
+	void MoveObserver::setCursorProfile(pointerProfile profile) {
+		Settings s;
+		settings.copy(s);
+		s.cursorProfile = profile;
+		settings.publish(s);
+	}
+
+	//Sphere colours go to the SDK and to our own segmenter, which only rebuilds that controller's tables
+	void MoveObserver::setSphereColor(int moveId, int r, int g, int b) {
+		move->getEye()->setColor(moveId, r, g, b);
+		eyePipeline.setTarget(moveId, r, g, b);
+	}
+	void MoveObserver::useAutomaticColors(bool use) {
+		move->getEye()->useAutomaticColors(use);
+		if (use) eyePipeline.clearTargets();
+	}
+
+	//Called on the camera pipeline's fusion thread, once per camera frame
+	void MoveObserver::eyeUpdated(const EyeResult & result) {
+		for (int i = 0; i < maxEyeControllers; i++) {
+			if (result.tracks[i].roi.right == 0) continue;		//No target colour for this controller
+			trackers[i].setFitQuality(result.fits[i].valid ? result.fits[i].quality : 0);
+		}
+		InterlockedIncrement(&eyeFrames);
+	}
+
+	//Called on the colour planner thread
+	void MoveObserver::colorsPlanned(int count, const float* hues) {
+		for (int i = 0; i < count; i++) {
+			int r, g, b;
+			hueToRgb(hues[i], r, g, b);
+			setSphereColor(i, r, g, b);
+		}
+	}
+
+	//Called on the shell event thread. Tracking keeps running on the old layout until the new one is published.
+	void MoveObserver::displayChanged() {
+		const Settings* c = settings.acquire();
+		display.rebuild(c->monitorWeights);
+		settings.release(c);
+		printf("%d Display layout changed. \n", ++curConsoleLine);
+	}
+
+	//Called on the shell event thread. Button handlers pick up the new profile on their next press.
+	void MoveObserver::foregroundChanged(HWND hWnd) {
+		if (appProfiles.foregroundChanged(hWnd)) printf("%d Profile: %s \n", ++curConsoleLine, appProfiles.get()->name);
+	}
+
+	//Called on the shell event thread for every window that goes away
+	void MoveObserver::windowDestroyed(HWND hWnd) {
+		appProfiles.windowDestroyed(hWnd);
+	}
+
+	/* Shell thread. Nothing may stay held down while the session is away or the process is going.
+	Before the constructor is done only the lock state is kept, as the camera and controllers
+	are still being opened. */
+	void MoveObserver::sessionChanged(sessionEvent event) {
+		EnterCriticalSection(&lifecycleLock);
+		switch (event) {
+		case SESSION_LOCK:
+			sessionLocked = true;
+			if (started) suspend("session locked");
+			break;
+		case SESSION_UNLOCK:
+			sessionLocked = false;
+			if (started) resume();
+			break;
+		case SESSION_SUSPEND:
+			if (started) suspend("system suspending");
+			break;
+		case SESSION_RESUME:
+			//A session locked on the way down resumes when it is unlocked
+			if (started && !sessionLocked) resume();
+			break;
+		case SESSION_END:
+			inputLedger.releaseAll("session ending");
+			break;
+		case SESSION_CLOSE:
+			//MovePointBase terminates the process shortly after asking
+			inputLedger.releaseAll("closing");
+			break;
+		default:
+			break;
+		}
+		LeaveCriticalSection(&lifecycleLock);
+	}
+
+	//Control thread. Nothing is posted before WORKER_RUNNING, but a command left from before start is dropped.
+	void MoveObserver::commandReceived(controlCommand command) {
+		if (!started) return;
+
+		switch (command) {
+		case CONTROL_PAUSE:
+			suspend("paused by MovePointBase");
+			break;
+		case CONTROL_RESUME:
+			//MovePointBase also resumes on wake from sleep, which may come back to a locked session
+			EnterCriticalSection(&lifecycleLock);
+			if (!sessionLocked) resume();
+			LeaveCriticalSection(&lifecycleLock);
+			break;
+		case CONTROL_RECALIBRATE:
+			InterlockedExchange(&recalibratePending, 1);
+			break;
+		case CONTROL_RELOAD:
+			settings.requestReload();
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* Any thread. Frames and buttons are ignored and the camera is given up until resume().
+	The controllers stay paired and open, and calibration, the orientation baseline and the
+	filters keep their state, so resuming needs no pairing, calibration or warm-up. */
+	void MoveObserver::suspend(const char* reason) {
+		EnterCriticalSection(&lifecycleLock);
+		if (!paused) {
+			paused = true;
+			InterlockedExchange64(&resumeStart, 0);
+			InterlockedExchangePointer((PVOID volatile *)&releaseReason, (PVOID)reason);	//If no frame comes, InputLedger lets go on its own
+			if (controllerOn) closeCamera();
+			control.setState(WORKER_PAUSED);
+			printf("%d Suspended: %s \n", ++curConsoleLine, reason);
+		}
+		LeaveCriticalSection(&lifecycleLock);
+	}
+
+	void MoveObserver::resume() {
+		EnterCriticalSection(&lifecycleLock);
+		if (paused) {
+			LARGE_INTEGER now;
+			QueryPerformanceCounter(&now);
+			resumeEyeFrames = eyeFrames;
+
+			//Without the camera the cursor cannot move; carry on, MovePointBase restarts us if nothing comes
+			if (controllerOn && !openCamera()) printf("%d Camera did not come back after resume \n", ++curConsoleLine);
+
+			InterlockedExchange(&resumePending, 1);
+			InterlockedExchange64(&resumeStart, now.QuadPart);
+			paused = false;
+			control.setState(WORKER_RUNNING);
+		}
+		LeaveCriticalSection(&lifecycleLock);
+	}
+
+	/* Sensor thread, on the first camera position after resume(): a new fit from our pipeline,
+	or an SDK position that is not the one from before the pause. From here the cursor follows
+	the controller again. Measured to this frame rather than to an actual cursor move, which
+	waits for the user to move past the dead zone. */
+	void MoveObserver::noteCursorMove() {
+		LONGLONG start = InterlockedExchange64(&resumeStart, 0);
+		if (start == 0) return;
+
+		LARGE_INTEGER now, freq;
+		QueryPerformanceCounter(&now);
+		QueryPerformanceFrequency(&freq);
+		lastResumeMs = (DWORD)((now.QuadPart - start) * 1000 / freq.QuadPart);
+		control.setResumeMs(lastResumeMs);
+		printf("%d Resumed: first camera position after %lu ms%s \n", ++curConsoleLine, lastResumeMs,
+			lastResumeMs > resumeTargetMs_d ? " (slower than target)" : "");
+	}
+
+	//Sensor thread. Back to plain mouse mode, as if every button had been released.
+	void MoveObserver::resetModes() {
+		drag.end();
+		mouseMode = true;
+		scrollMode = dragMode = dragMode2 = keyboardMode = false;
+		appSwitchMode = appSwitchMode2 = zoomMode = snapMode = desktopMode = false;
+		squarePressed = crossPressed = trianglePressed = circlePressed = movePressed = LPressed = false;
+		snapped = SNAP_NONE;
+	}
 
 	void MoveObserver::updatePos(Move::MoveData data)
 	{
@@ -155,6 +423,7 @@
 
 	void MoveObserver::moveKeyProc(Move::MoveButton keyCode, byte keyState)
 	{
+		if (paused) return;
 		switch (keyCode)
 		{
 		case Move::B_NONE:
@@ -292,7 +561,7 @@
 			//keyPress(VK_CONTROL, keyState);
 		}
 		else if (mouseMode) {
-			mousePress(3, keyState);
+			if (!appProfiles.press(ACTION_TRIANGLE, keyState)) mousePress(3, keyState);
 		}
 		else if (keyboardMode) {
 			keyPress(VK_TAB, keyState);
@@ -323,7 +592,7 @@
 			}
 		}
 		else if (mouseMode) {
-			mousePress(2, keyState);
+			if (!appProfiles.press(ACTION_CIRCLE, keyState)) mousePress(2, keyState);
 		}
 		else if (keyboardMode) {
 			keyPress(VK_SNAPSHOT, keyState);
@@ -387,7 +656,7 @@
 				}
 				//Quick click
 				else {
-					keyboardClick(VK_LWIN);
+					if (!appProfiles.click(ACTION_SQUARE)) keyboardClick(VK_LWIN);
 				}
 			}
 
@@ -417,7 +686,7 @@
 		if (keyState == 1) {
 			if (squarePressed) {
 				//If square button is pressed, try closing current desktop (only works in Windows 10)
-				killDesktop();
+				desktops.post(DESKTOP_REMOVE);
 				snapped = SNAP_CLOSE;
 			}
 		}
@@ -438,13 +707,18 @@
 				}
 			}
 			else {
-				if (calibrationMode > 0) {
+				if (calibrationMode >= 6) {
+					//The screen area is measured already; keep it and the old camera values
+					printf("Camera calibration skipped. \n");
+					finishCalibration();
+				}
+				else if (calibrationMode > 0) {
 					calibrationMode = 0;
 					printf("Calibration canceled. \n");
 				}
 				else {
 					//Quick click is interpreted as Esc
-					keyboardClick(VK_ESCAPE);
+					if (!appProfiles.click(ACTION_CROSS)) keyboardClick(VK_ESCAPE);
 				}
 			}
 		}
@@ -478,7 +752,9 @@
 					initCamera();
 				}
 				else {
-					move->closeCamera();
+					drag.end();
+					inputLedger.releaseAll("controller off");
+					closeCamera();
 				}
 			}
 		}
@@ -510,11 +786,13 @@
 		}
 		else if (dragMode && keyState == 0) {
 			//Exit drag mode when Move button is released
+			drag.end();
 			dragMode = false;
 			mouseMode = true;
 
 		}
 		else if (dragMode2 && keyState == 0) {
+			drag.end();
 			dragMode2 = false;
 			mouseMode = true;
 			mousePress(1, 0);
@@ -589,7 +867,10 @@
 			}
 			//Quick click show task view in Win10, otherwise maximizes or restores app window. 
 			else if ((double)(fetchFileTime().QuadPart - lHandler_FT.QuadPart) <= myScrollDelay) {
-				if (IsWindows10OrGreater) {
+				if (appProfiles.click(ACTION_L)) {
+					//The application's own binding
+				}
+				else if (IsWindows10OrGreater) {
 					showTaskView();			//launch task view
 				}
 				else {
@@ -624,19 +905,33 @@
 
 		if (!controllerOn) return;
 
-		float xPosWeight, yPosWeight, distWeight;
+		float xPosWeight, yPosWeight, distWeight, speedGain;
 
-		distWeight = min(1, max(0, (1 / log(max(fabs(data.position.x), fabs(data.position.y)) + 2))*max(1,data.position.z/70)));
+		//Gains come from lookup tables baked for the current profile
+		distWeight = transfer.distanceGain(data.position);
+		TrackingQuality & tracking = trackingOf(moveId);
+		speedGain = transfer.speedGain(tracking.speed());
 
-		if (!tiltMode) {
+		if (tracking.isLost()) {
+			moveCursorRelative(moveId, data);
+		}
+		else if (!tiltMode) {
+
+			xPosWeight = max(min(fabs(data.position.x - avgPos.x) * invThreshold.x * speedGain * (stableX ? distWeight : 1), 1), 0);
+			yPosWeight = max(min(fabs(data.position.y - avgPos.y) * invThreshold.y * speedGain * (stableY ? distWeight : 1), 1), 0);
 
-			xPosWeight = max(min(fabs(data.position.x - avgPos.x) / mouseThreshold * (stableX ? distWeight : 1), 1), 0);
-			yPosWeight = max(min(fabs(data.position.y - avgPos.y) / mouseThreshold * (stableY ? distWeight : 1), 1), 0);
+			const Topology* topo = display.acquire();
+			POINT target = topo->map(curPosNorm.x, curPosNorm.y);
+			display.release(topo);
 
-			cursorPos.x = round((1 - xPosWeight) * cursorPos.x + xPosWeight * (curPosNorm.x * screenSize.right + screenSize.left));
-			cursorPos.y = round((1 - yPosWeight) * cursorPos.y + yPosWeight * (curPosNorm.y * screenSize.bottom + screenSize.top));
+			cursorPos.x = round((1 - xPosWeight) * cursorPos.x + xPosWeight * (target.x + anchorOffset.x));
+			cursorPos.y = round((1 - yPosWeight) * cursorPos.y + yPosWeight * (target.y + anchorOffset.y));
 
-			mouse_event(MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE, cursorPos.x, cursorPos.y, 0, 0);
+			//Offset left over from a dropout is only absorbed while the hand is moving, so it never shows as a jump
+			anchorOffset.x *= 1 - (1 - anchorDecay_d) * xPosWeight;
+			anchorOffset.y *= 1 - (1 - anchorDecay_d) * yPosWeight;
+
+			mouse_event(MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_VIRTUALDESK, cursorPos.x, cursorPos.y, 0, 0);
 
 			//SetPhysicalCursorPos doesn't work for handwritting
 			//SetPhysicalCursorPos(cursorPos.x, cursorPos.y);
@@ -668,6 +963,94 @@
 		SetPhysicalCursorPos(cursorPos.x, cursorPos.y);
 	}
 
+	//Move cursor by change in orientation while the camera cannot see the sphere
+	void MoveObserver::moveCursorRelative(int moveId, Move::MoveData data) {
+
+		if (!controllerOn) return;
+
+		cursorPos.x = round(cursorPos.x - (data.orientation.v.y - lastOrient.v.y) * orientGain_d * mouseAbsRange);
+		cursorPos.y = round(cursorPos.y - (data.orientation.v.x - lastOrient.v.x) * orientGain_d * mouseAbsRange);
+
+		cursorPos.x = max(min(cursorPos.x, mouseAbsRange), 0);
+		cursorPos.y = max(min(cursorPos.y, mouseAbsRange), 0);
+
+		mouse_event(MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_MOVE | MOUSEEVENTF_VIRTUALDESK, cursorPos.x, cursorPos.y, 0, 0);
+	}
+
+	//Derive per-axis dead zones and moving average weights from the measured noise floor
+	void MoveObserver::applyNoiseEstimate() {
+		if (!cfg->autoTune || !noise.hasEstimate()) return;
+
+		noise.thresholdMin = cfg->thresholdMin;
+		noise.thresholdMax = cfg->thresholdMax;
+
+		Move::Vec3 sigma = noise.getSigma();
+		axisThreshold.x = noise.threshold(sigma.x);
+		axisThreshold.y = noise.threshold(sigma.y);
+		axisThreshold.z = noise.threshold(sigma.z);
+		invThreshold = Move::Vec3(1 / axisThreshold.x, 1 / axisThreshold.y, 1 / axisThreshold.z);
+
+		posWeight.x = noise.weight(cfg->curPosWeight, cfg->mouseThreshold, sigma.x);
+		posWeight.y = noise.weight(cfg->curPosWeight, cfg->mouseThreshold, sigma.y);
+		posWeight.z = noise.weight(cfg->curPosWeight, cfg->mouseThreshold, sigma.z);
+
+		scrollScale.x = noise.scrollScale(cfg->mouseThreshold, sigma.x);
+		scrollScale.y = noise.scrollScale(cfg->mouseThreshold, sigma.y);
+		scrollScale.z = 1;
+	}
+
+	/* Startup, before the sensor thread runs. A checkpoint from the same controllers, camera
+	and calibration replaces the initial orientation reading and the first noise windows. */
+	void MoveObserver::restoreWarmState() {
+		if (!warm.open()) return;
+
+		WarmData w;
+		if (warm.restore(calibrationKey, w)) {
+			avgPos = w.avgPos;
+			if (w.haveOrient) {
+				avgOrient = w.avgOrient;
+				takeInitReading = false;
+			}
+			if (w.noiseEstimates > 0) {
+				noise.restore(w.noiseSigma, w.noiseEstimates);
+				applyNoiseEstimate();
+			}
+			printf("Warm state restored, %ld noise estimate(s). \n", w.noiseEstimates);
+		}
+		warm.start();
+	}
+
+	//Sensor thread. Hands the state to the checkpoint thread; no I/O here.
+	void MoveObserver::checkpointWarmState() {
+		WarmData w;
+		ZeroMemory(&w, sizeof(w));
+		w.calibration = calibrationKey;
+		w.avgOrient = avgOrient;
+		w.haveOrient = !takeInitReading;
+		w.avgPos = avgPos;
+		w.noiseSigma = noise.getSigma();
+		w.noiseEstimates = (noise.hasEstimate() ? noise.getEstimateCount() : 0);
+		warm.update(w);
+	}
+
+	TrackingQuality & MoveObserver::trackingOf(int moveId) {
+		return trackers[max(min(moveId, maxEyeControllers - 1), 0)];
+	}
+
+	//Once the camera pipeline stops, its last fit must not keep counting as poor
+	void MoveObserver::clearFitQuality() {
+		for (int i = 0; i < maxEyeControllers; i++) trackers[i].clearFitQuality();
+	}
+
+	//Keep the cursor where it is when optical tracking returns. The offset to the absolute position is absorbed in moveCursor.
+	void MoveObserver::reanchorCursor() {
+		const Topology* topo = display.acquire();
+		POINT target = topo->map(curPosNorm.x, curPosNorm.y);
+		display.release(topo);
+		anchorOffset.x = (float)(cursorPos.x - target.x);
+		anchorOffset.y = (float)(cursorPos.y - target.y);
+	}
+
 	//Scrolling subroutine
 	void MoveObserver::scroll(int moveId, Move::MoveData data) {
 		//TO DO: Should give preference to up-down in scroll mode but left-right in desktop mode
@@ -675,24 +1058,28 @@
 		if (!controllerOn) return;
 
 		//set the desirable movement threshold
-		DWORD myWDelta = floor(WHEEL_DELTA * scrollPercent + 0.5);
-		float myThreshold = scrollThreshold * scrollPercent;
+		DWORD myWDelta = floor(WHEEL_DELTA * cfg->scrollPercent + 0.5);
+		float myThreshold = cfg->scrollThreshold * cfg->scrollPercent;
 		if (appSwitchMode) {
-			myThreshold = appScrollThreshold;
+			myThreshold = cfg->appScrollThreshold;
 		}
 		else if (snapMode || desktopMode || zoomMode) {
-			myThreshold = appScrollThreshold * 1.5;
+			myThreshold = cfg->appScrollThreshold * 1.5;
 		}
 
+		//Per axis, widened or narrowed with the noise floor when auto tuning
+		float yThreshold = myThreshold * scrollScale.y;
+		float xThreshold = myThreshold * scrollScale.x;
+
 		//scroll up?
-		if (data.position.y > oldPos.y + myThreshold || data.position.y >= ctrlRegion.top) {
+		if (data.position.y > oldPos.y + yThreshold || data.position.y >= cfg->ctrlRegion.top) {
 
-			if (data.position.y >= ctrlRegion.top
-				&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + data.position.y - ctrlRegion.top)))
+			if (data.position.y >= cfg->ctrlRegion.top
+				&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + data.position.y - cfg->ctrlRegion.top)))
 				return;	//Do nothing if the request is coming in too fast)
 
 			if (snapMode) {
-				if (oldPos.y < ctrlRegion.bottom) {
+				if (oldPos.y < cfg->ctrlRegion.bottom) {
 					desktop(VK_UP);
 				}
 				else {
@@ -712,14 +1099,14 @@
 			updatePos(data);
 		}
 		//scroll down?
-		else if (data.position.y < oldPos.y - myThreshold || data.position.y <= ctrlRegion.bottom) {
+		else if (data.position.y < oldPos.y - yThreshold || data.position.y <= cfg->ctrlRegion.bottom) {
 
-			if (data.position.y <= ctrlRegion.bottom
-				&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + ctrlRegion.bottom - data.position.y)))
+			if (data.position.y <= cfg->ctrlRegion.bottom
+				&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + cfg->ctrlRegion.bottom - data.position.y)))
 				return;	//Do nothing if the request is coming in too fast)
 
 			if (snapMode) {
-				if (oldPos.y > ctrlRegion.top) {
+				if (oldPos.y > cfg->ctrlRegion.top) {
 					desktop(VK_DOWN);
 				}
 				else {
@@ -739,14 +1126,14 @@
 			updatePos(data);
 		}
 		//scroll left?
-		else if (data.position.x < oldPos.x - myThreshold || data.position.x <= ctrlRegion.left) {
+		else if (data.position.x < oldPos.x - xThreshold || data.position.x <= cfg->ctrlRegion.left) {
 			if (snapMode) {
 
-				if (data.position.x <= ctrlRegion.left
-					&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + ctrlRegion.left - data.position.x)))
+				if (data.position.x <= cfg->ctrlRegion.left
+					&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + cfg->ctrlRegion.left - data.position.x)))
 					return;	//Do nothing if the request is coming in too fast)				
 
-				if (oldPos.x > ctrlRegion.right) {
+				if (oldPos.x > cfg->ctrlRegion.right) {
 					desktop(VK_LEFT);
 				}
 				else {
@@ -766,14 +1153,14 @@
 			updatePos(data);
 		}
 		//scroll right?
-		else if (data.position.x > oldPos.x + myThreshold || data.position.x >= ctrlRegion.right) {
+		else if (data.position.x > oldPos.x + xThreshold || data.position.x >= cfg->ctrlRegion.right) {
 
-			if (data.position.x >= ctrlRegion.right
-				&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + data.position.x - ctrlRegion.right)))
+			if (data.position.x >= cfg->ctrlRegion.right
+				&& (double)(fetchFileTime().QuadPart - old_FT.QuadPart) <= autoThreshold / (1 + exp(-3 + data.position.x - cfg->ctrlRegion.right)))
 				return;	//Do nothing if the request is coming in too fast)		
 
 			if (snapMode) {
-				if (oldPos.x < ctrlRegion.left) {
+				if (oldPos.x < cfg->ctrlRegion.left) {
 					desktop(VK_RIGHT);
 				}
 				else {
@@ -820,59 +1207,66 @@
 			break;
 		}
 
-		SetForegroundWindow(myTarget);	//target was acquired with square button press
-		keyPress(VK_LWIN, 1);
-		keyboardClick(keyCode);
-		keyPress(VK_LWIN, 0);
+		//target was acquired with square button press. The zone is worked out here and placed on the drag thread.
+		if (!snapLayout.snap(myTarget, keyCode)) snapped = SNAP_FAILED;
 
 	}
 
 	void MoveObserver::zoom(int keyCode) {
 		switch (keyCode) {
 		case VK_UP:
-			keyPress(VK_CONTROL, 1);
-			mouse_event(MOUSEEVENTF_WHEEL, 0, 0, WHEEL_DELTA, 0);
-			keyPress(VK_CONTROL, 0);
+			if (!appProfiles.click(ACTION_ZOOM_IN)) {
+				keyPress(VK_CONTROL, 1);
+				mouse_event(MOUSEEVENTF_WHEEL, 0, 0, WHEEL_DELTA, 0);
+				keyPress(VK_CONTROL, 0);
+			}
 			printf("%d Zooming up. \n", ++curConsoleLine);
 			break;
 		case VK_DOWN:
-			keyPress(VK_CONTROL, 1);
-			mouse_event(MOUSEEVENTF_WHEEL, 0, 0, -1 * WHEEL_DELTA, 0);
-			keyPress(VK_CONTROL, 0);
+			if (!appProfiles.click(ACTION_ZOOM_OUT)) {
+				keyPress(VK_CONTROL, 1);
+				mouse_event(MOUSEEVENTF_WHEEL, 0, 0, -1 * WHEEL_DELTA, 0);
+				keyPress(VK_CONTROL, 0);
+			}
 			printf("%d Zooming down. \n", ++curConsoleLine);
 			break;
 		case VK_LEFT:
 			if (snapped == SNAP_LEFT) return;		//This prevents multiple actions in one movement
 			snapped = SNAP_LEFT;
-			keyPress(VK_MENU, 1);
-			keyboardClick(keyCode);
-			keyPress(VK_MENU, 0);
+			if (!appProfiles.click(ACTION_BACK)) {
+				keyPress(VK_MENU, 1);
+				keyboardClick(keyCode);
+				keyPress(VK_MENU, 0);
+			}
 			printf("%d Back. \n", ++curConsoleLine);
 			break;
 		case VK_RIGHT:
 			if (snapped == SNAP_RIGHT) return;
 			snapped = SNAP_RIGHT;
-			keyPress(VK_MENU, 1);
-			keyboardClick(keyCode);
-			keyPress(VK_MENU, 0);
+			if (!appProfiles.click(ACTION_FORWARD)) {
+				keyPress(VK_MENU, 1);
+				keyboardClick(keyCode);
+				keyPress(VK_MENU, 0);
+			}
 			printf("%d Forward. \n", ++curConsoleLine);
 			break;
 		}
 	}
 
+	//In snap mode the window being snapped goes along to the next desktop
 	void MoveObserver::desktop(int keyCode) {
 		switch (keyCode) {
 		case VK_UP:
 			if (snapped == SNAP_UP) return;			//This prevents multiple actions in one movement
 			snapped = SNAP_UP;
-			newDesktop();
+			desktops.post(DESKTOP_NEW);
 			break;
 
 		case VK_DOWN:
 			if (snapped == SNAP_DOWN) return;
 			snapped = SNAP_DOWN;
 			if (IsWindows10OrGreater) {
-				killDesktop();
+				desktops.post(DESKTOP_REMOVE);
 			}
 			else {
 				showDesktop();
@@ -882,33 +1276,26 @@
 		case VK_LEFT:
 			if (snapped == SNAP_LEFT) return;
 			snapped = SNAP_LEFT;
-			nextDesktop();
+			if (snapMode && myTarget != NULL) desktops.post(DESKTOP_CARRY_NEXT, myTarget);
+			else desktops.post(DESKTOP_NEXT);
 			break;
 
 		case VK_RIGHT:
 			if (snapped == SNAP_RIGHT) return;
 			snapped = SNAP_RIGHT;
-			prevDesktop();
+			if (snapMode && myTarget != NULL) desktops.post(DESKTOP_CARRY_PREV, myTarget);
+			else desktops.post(DESKTOP_PREV);
 			break;
 		}
 	}
 
 
-	//Drag subroutine
-	void MoveObserver::dragWindow(int moveId) {
-
-		if (!controllerOn) return;
-
-		BOOL retVal;
-		POINT myCurPPos;
-
-		GetPhysicalCursorPos(&myCurPPos);
-		retVal = MoveWindow(myTarget, myCurPPos.x - winCurDiff.x, myCurPPos.y - winCurDiff.y, tSize.x, tSize.y, true);
-	}
-
-	//Get handle to the window below cursor and send it to foreground
+	//Get handle to the window below cursor. Cached by the resolver thread; looked up here if its lookup is stale.
 	HWND MoveObserver::getTarget() {
-		return win_actions::getTarget(cursorPos);
+		POINT pos;
+		if (!GetPhysicalCursorPos(&pos)) return NULL;
+		HWND cached = targets.get(pos);
+		return (cached != NULL ? cached : win_actions::getTarget(cursorPos));
 	}
 
 	void MoveObserver::focusMyTarget(HWND inTarget) {
@@ -936,6 +1323,9 @@
 			winCurDiff.x = myCurPPos.x - tRect.left;							//This difference is kept while dragging
 			winCurDiff.y = myCurPPos.y - tRect.top;
 
+			SIZE size = { tSize.x, tSize.y };
+			drag.begin(myTarget, winCurDiff, size);
+
 			//printf("HWND:%d %d %d %d %d %d %d \n", myTarget, tRect.left, tRect.top, tSize.x, tSize.y, winCurDiff.x, winCurDiff.y);
 		}
 
@@ -981,6 +1371,7 @@
 
 		printf("Orientation calibrated.\n");
 		printf("Click the move button to continue calibration of screen area. Click X to quit.\n");
+		draft = *cfg;					//The cursor keeps the old region until the new one is published
 		calibrationMode = 1;
 	}
 
@@ -1004,46 +1395,114 @@
 			printf("Point the controller towards the right side of your screen and click the move button.\n");
 			break;
 		case 5:
-			calibrationMode = 0;
+			//With positions in centimetres, the camera itself is measured next, if our pipeline can see this sphere
+			if (cfg->metricPosition && eyePipeline.isRunning() && eyePipeline.hasTarget(keyMoveId)) {
+				calibrationMode++;
+				eyeCal.clearSamples();
+				printf("Hold the sphere %.0f cm from the camera and click the move button. Click X to skip.\n", calDistanceCm_d[0]);
+				break;
+			}
+			if (cfg->metricPosition) printf("No sphere colour for the camera pipeline yet; the camera is not measured. \n");
+			finishCalibration();
+			break;
+		case 6:
+		case 7:
+		case 8:
+			calibrateCameraStep();
+			break;
+		}
+	}
 
-			//Calculate thresholds
-			/*//Since we now use raw data position for thresholds this is no longer necessary:
-			scrollThreshold = (ctrlRegion_d.top - ctrlRegion_d.bottom)/(ctrlRegion.top - ctrlRegion.bottom) * scrollThreshold_d;
-			appScrollThreshold = (ctrlRegion_d.top - ctrlRegion_d.bottom) / (ctrlRegion.top - ctrlRegion.bottom) * appScrollThreshold_d;
-			mouseThreshold = (ctrlRegion_d.top - ctrlRegion_d.bottom) / (ctrlRegion.top - ctrlRegion.bottom) * mouseThreshold_d;
-			*/
+	//Radius of the sphere at a measured distance, one click per distance
+	void MoveObserver::calibrateCameraStep() {
+		int step = calibrationMode - 6;
+		int moveId = max(min(keyMoveId, maxEyeControllers - 1), 0);		//The controller that was clicked
+		EyeResult result;
+		if (!eyePipeline.getLatest(result) || !result.fits[moveId].valid) {
+			printf("The camera cannot see the sphere clearly. Hold it still facing the camera and click again, or click X to skip.\n");
+			return;
+		}
 
-			saveSettings();
-			printf("Calibration completed: Top:%.2f Bottom:%.2f Left:%.2f Right:%.2f \n", ctrlRegion.top, ctrlRegion.bottom, ctrlRegion.left, ctrlRegion.bottom);
-			printf("New thresholds: %.4f %.4f %.4f \n", scrollThreshold, appScrollThreshold, mouseThreshold);
+		eyeCal.addSample(calDistanceCm_d[step], result.fits[moveId].radius);
+		if (step < calDistances - 1) {
+			calibrationMode++;
+			printf("Hold the sphere %.0f cm from the camera and click the move button. Click X to skip.\n", calDistanceCm_d[step + 1]);
+			return;
+		}
 
-			if (fabs(ctrlRegion.top - ctrlRegion.bottom) < 20) {
-				printf("WARNING: Cursor might move very fast due to vertical distance being less than 20. A value of around 30 is recommended.");
-			}
-			if (fabs(ctrlRegion.right - ctrlRegion.left) < 30) {
-				printf("WARNING: Cursor might move very fast due to horizontal distance being less than 30. A value of around 60 is recommended.");
-			}
-			break;
+		if (eyeCal.solve()) {
+			draft.camIntrinsics = eyeCal.getIntrinsics();
+			eyeCal.print();
+		}
+		finishCalibration();
+	}
+
+	void MoveObserver::finishCalibration() {
+		calibrationMode = 0;
+
+		//Calculate thresholds
+		/*//Since we now use raw data position for thresholds this is no longer necessary:
+		draft.scrollThreshold = (ctrlRegion_d.top - ctrlRegion_d.bottom)/(draft.ctrlRegion.top - draft.ctrlRegion.bottom) * scrollThreshold_d;
+		draft.appScrollThreshold = (ctrlRegion_d.top - ctrlRegion_d.bottom) / (draft.ctrlRegion.top - draft.ctrlRegion.bottom) * appScrollThreshold_d;
+		draft.mouseThreshold = (ctrlRegion_d.top - ctrlRegion_d.bottom) / (draft.ctrlRegion.top - draft.ctrlRegion.bottom) * mouseThreshold_d;
+		*/
+
+		settings.publish(draft);
+		calSettings();
+		saveSettings();
+		printf("Calibration completed: Top:%.2f Bottom:%.2f Left:%.2f Right:%.2f \n", cfg->ctrlRegion.top, cfg->ctrlRegion.bottom, cfg->ctrlRegion.left, cfg->ctrlRegion.bottom);
+		printf("New thresholds: %.4f %.4f %.4f \n", cfg->scrollThreshold, cfg->appScrollThreshold, cfg->mouseThreshold);
+
+		if (fabs(cfg->ctrlRegion.top - cfg->ctrlRegion.bottom) < 20) {
+			printf("WARNING: Cursor might move very fast due to vertical distance being less than 20. A value of around 30 is recommended.");
+		}
+		if (fabs(cfg->ctrlRegion.right - cfg->ctrlRegion.left) < 30) {
+			printf("WARNING: Cursor might move very fast due to horizontal distance being less than 30. A value of around 60 is recommended.");
 		}
 	}
 
 	void MoveObserver::calibrateRecordPos(Move::MoveData data) {
 		switch (calibrationMode) {
 		case 2:
-			ctrlRegion.top = data.position.y;
+			draft.ctrlRegion.top = data.position.y;
 			break;
 		case 3:
-			ctrlRegion.bottom = data.position.y;
+			draft.ctrlRegion.bottom = data.position.y;
 			break;
 		case 4:
-			ctrlRegion.left = data.position.x;
+			draft.ctrlRegion.left = data.position.x;
 			break;
 		case 5:
-			ctrlRegion.right = data.position.x;
+			draft.ctrlRegion.right = data.position.x;
 			break;
 		}
 	}
 
+	/* Replaces pos with the latest camera fit in centimetres. Held at the last value while the
+	pipeline has nothing fresh. Until the pipeline, since it last started, has seen this
+	controller's sphere, pos keeps the SDK position and false is returned: a position stuck
+	at an old or zero value would freeze the cursor and calibrate to nothing. */
+	bool MoveObserver::metricPos(int moveId, Move::Vec3 & pos) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return false;
+		if (!eyePipeline.isRunning()) {
+			haveMetric[moveId] = false;
+			return false;
+		}
+
+		EyeResult result;
+		if (eyePipeline.getLatest(result) && eyeTimeMs() - result.captureMs < metricMaxAgeMs_d) {
+			const SphereFitResult & f = result.fits[moveId];
+			const SphereTrack & t = result.tracks[moveId];
+			if (f.valid) lastMetric[moveId] = eyeCal.toMetric(f.x, f.y, f.radius);
+			else if (t.found) lastMetric[moveId] = eyeCal.toMetric(t.x, t.y, t.radius);
+			if (f.valid || t.found) haveMetric[moveId] = true;
+		}
+		if (!haveMetric[moveId]) return false;
+
+		pos = lastMetric[moveId];
+		return true;
+	}
+
 	void MoveObserver::takeInitOrient(Move::MoveData data) {
 		avgOrient.w = data.orientation.w;
 		avgOrient.v.x = data.orientation.v.x;
@@ -1052,119 +1511,88 @@
 		takeInitReading = false;
 	}
 
-	void MoveObserver::restoreDefaults() {
-		ctrlRegion = ctrlRegion_d;
-		scrollPercent = scrollPercent_d;
-		scrollThreshold = scrollThreshold_d;
-		appScrollThreshold = appScrollThreshold_d;
-		mouseThreshold = mouseThreshold_d;
-		curPosWeight = curPosWeight_d;
-		moveDelay = moveDelay_d;
+	Settings MoveObserver::defaultSettings() {
+		Settings s;
+		ZeroMemory(&s, sizeof(s));
+		s.ctrlRegion = defaultRegion();
+		s.scrollPercent = scrollPercent_d;
+		s.scrollThreshold = scrollThreshold_d;
+		s.appScrollThreshold = appScrollThreshold_d;
+		s.mouseThreshold = mouseThreshold_d;
+		s.curPosWeight = curPosWeight_d;
+		s.moveDelay = moveDelay_d;
+		s.prefilterMode = prefilterMode_d;
+		s.cursorProfile = cursorProfile_d;
+		s.autoTune = autoTune_d;
+		s.eyePipelineOn = eyePipeline_d;
+		s.frameExportOn = frameExport_d;
+		s.recordSessionOn = recordSession_d;
+		s.colorPlannerOn = colorPlanner_d;
+		s.metricPosition = metricPosition_d;
+		s.colorLutBits = colorLutBits_d;
+		s.thresholdMin = thresholdMin_d;
+		s.thresholdMax = thresholdMax_d;
+		s.dragSnap = dragSnap_d;
+		strncpy(s.snapGrid, SNAP_GRID_D, sizeof(s.snapGrid) - 1);
+		return s;
+	}
 
+	void MoveObserver::restoreDefaults() {
+		settings.setDefaults(defaultSettings());
+		settings.publish(settings.getDefaults());
 		calSettings();
 	}
 
+	//Sensor thread, or before it starts. Everything derived from the settings is rebuilt from the current snapshot.
 	void MoveObserver::calSettings() {
-		if (mouseThreshold <= 0) mouseThreshold = 0.000001;
-		myMoveDelay = moveDelay * 10000;						//movement detection delay in nanoseconds
-		myScrollDelay = max((moveDelay + 100),300) * 10000;				//scroll needs slightly more delay
+		const Settings* old = cfg;
+		cfg = settings.acquire();
+		bool cameraChanged = appliedSerial == 0
+			|| memcmp(&old->camIntrinsics, &cfg->camIntrinsics, sizeof(cfg->camIntrinsics)) != 0
+			|| old->metricPosition != cfg->metricPosition;
+		bool weightsChanged = appliedSerial == 0 || strcmp(old->monitorWeights, cfg->monitorWeights) != 0;
+		settings.release(old);
+		appliedSerial = cfg->serial;
+
+		//Static per-axis values, replaced by the noise estimate when auto tuning
+		axisThreshold = Move::Vec3(cfg->mouseThreshold, cfg->mouseThreshold, cfg->mouseThreshold);
+		invThreshold = Move::Vec3(1 / cfg->mouseThreshold, 1 / cfg->mouseThreshold, 1 / cfg->mouseThreshold);		//moveCursor multiplies instead of dividing every frame
+		posWeight = Move::Vec3(cfg->curPosWeight, cfg->curPosWeight, cfg->curPosWeight);
+		scrollScale = Move::Vec3(1, 1, 1);
+		applyNoiseEstimate();
+		myMoveDelay = cfg->moveDelay * 10000;						//movement detection delay in nanoseconds
+		myScrollDelay = max((cfg->moveDelay + 100),300) * 10000;				//scroll needs slightly more delay
+		outlierFilter.setMode((outlierMode)cfg->prefilterMode);
+		if (transfer.getProfile() != cfg->cursorProfile) transfer.setProfile((pointerProfile)cfg->cursorProfile);
+		if (weightsChanged) display.rebuild(cfg->monitorWeights);		//Layout changes come from the shell thread
+		drag.setSnap(cfg->dragSnap ? dragSnapPx_d : 0);
+		if (!snapLayout.setGrid(cfg->snapGrid)) snapLayout.setGrid(SNAP_GRID_D);
+		eyePipeline.setLookup(cfg->colorLutBits);
+		if (cameraChanged) {				//Keep a calibration in progress through unrelated edits
+			eyeCal.reset();
+			eyeCal.setIntrinsics(cfg->camIntrinsics);
+		}
+
+		//Position units and region the warm state was measured in
+		calibrationKey = warmKey(&cfg->ctrlRegion, sizeof(cfg->ctrlRegion));
+		calibrationKey = warmKey(&cfg->camIntrinsics, sizeof(cfg->camIntrinsics), calibrationKey);
+		calibrationKey = warmKey(&cfg->metricPosition, sizeof(cfg->metricPosition), calibrationKey);
 	}
 
 	void MoveObserver::saveSettings() {
-		LONG retVal1, retVal2;
-
-		//If system-wide settings does not exist, try writing to it
-		if (hasSystemSettings != ERROR_SUCCESS)
-			retVal1 = saveSettingsReal(HKEY_LOCAL_MACHINE);
-
-		//Write to current user settings
-		retVal2 = saveSettingsReal(HKEY_CURRENT_USER);
-
-		printf("Save Settings. Return value: %d %d \n\n", retVal1, retVal2);
-
-	}
-
-	LONG MoveObserver::saveSettingsReal(HKEY inKey) {
-
-		LONG retVal1, retVal2, retVal3;
-		HKEY hKey;
-		DWORD dwDisp;
-
-		retVal1 = RegCreateKeyEx(inKey, TEXT("SOFTWARE\\MOVEpoint"), 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL, &hKey, &dwDisp);
-
-		retVal2 = writeFloatToReg(hKey, TEXT("scrollPercent"), scrollPercent);
-		retVal2 = writeFloatToReg(hKey, TEXT("scrollThreshold"), scrollThreshold);
-		retVal2 = writeFloatToReg(hKey, TEXT("appScrollThreshold"), appScrollThreshold);
-		retVal2 = writeFloatToReg(hKey, TEXT("mouseThreshold"), mouseThreshold);
-		retVal2 = writeFloatToReg(hKey, TEXT("curPosWeight"), curPosWeight);
-		retVal2 = RegSetValueEx(hKey, TEXT("moveDelay"), 0, REG_DWORD, (const BYTE*)&moveDelay, sizeof(moveDelay));
-
-		retVal2 = writeFloatToReg(hKey, TEXT("ctrlRegionT"), ctrlRegion.top);
-		retVal2 = writeFloatToReg(hKey, TEXT("ctrlRegionB"), ctrlRegion.bottom);
-		retVal2 = writeFloatToReg(hKey, TEXT("ctrlRegionL"), ctrlRegion.left);
-		retVal2 = writeFloatToReg(hKey, TEXT("ctrlRegionR"), ctrlRegion.right);
-
-		retVal3 = RegCloseKey(hKey);
-
-		return max(max(retVal1, retVal2), retVal3);
-
+		settings.save();
 	}
 
 	void MoveObserver::readSettings() {
-
-		LONG retVal1, retVal2;
-
-		//First try reading settings from system-wide settings before reading from current user
-		hasSystemSettings = readSettingsReal(HKEY_LOCAL_MACHINE);
-		retVal2 = readSettingsReal(HKEY_CURRENT_USER);
-
-		printf("Read Settings: %d %d %.3f %.3f %.3f %.3f %d %.3f %.3f %.3f %.3f \n\n",
-			hasSystemSettings, retVal2,
-			scrollThreshold, appScrollThreshold, mouseThreshold, curPosWeight, moveDelay,
-			ctrlRegion.top, ctrlRegion.bottom, ctrlRegion.left, ctrlRegion.right);
-	}
-
-	LONG MoveObserver::readSettingsReal(HKEY inKey) {
-
-		LONG retVal1, retVal2, retVal3;
-		HKEY hKey;
-		DWORD dwDisp;
-
-		retVal1 = RegCreateKeyEx(inKey, TEXT("SOFTWARE\\MOVEpoint"), 0, NULL, REG_OPTION_NON_VOLATILE, KEY_READ, NULL, &hKey, &dwDisp);
-
-		retVal2 = 5;
-		retVal2 = min(readFloatFromReg(hKey, TEXT("scrollPercent"), &scrollPercent), retVal2);
-		if (scrollPercent < 0.01) scrollPercent = scrollPercent_d;												//no negative value for scrollPercent
-		retVal2 = min(readFloatFromReg(hKey, TEXT("scrollThreshold"), &scrollThreshold), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("appScrollThreshold"), &appScrollThreshold), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("mouseThreshold"), &mouseThreshold), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("curPosWeight"), &curPosWeight), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionT"), &ctrlRegion.top), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionB"), &ctrlRegion.bottom), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionL"), &ctrlRegion.left), retVal2);
-		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionR"), &ctrlRegion.right), retVal2);
-
-		retVal2 = min(readDWORDFromReg(hKey, TEXT("moveDelay"), (DWORD*)&moveDelay), retVal2);
-
-		retVal3 = RegCloseKey(hKey);
-
+		Settings s;
+		settings.load(s);
+		settings.publish(s);
 		calSettings();
-
-		return max(max(retVal1, retVal2), retVal3);
 	}
 
 	//Default settings
 	void MoveObserver::initValues() {
-		screenSize.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
-		screenSize.right = GetSystemMetrics(SM_CXVIRTUALSCREEN);
-		screenSize.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
-		screenSize.bottom = GetSystemMetrics(SM_CYVIRTUALSCREEN);
-		screenWHratio = abs(screenSize.left - screenSize.right) / abs(screenSize.bottom - screenSize.top);
-
-		screenSize.left = round(screenSize.left * 65535 / GetSystemMetrics(SM_CXSCREEN));
-		screenSize.right = round(screenSize.right * 65535 / GetSystemMetrics(SM_CXSCREEN));
-		screenSize.top = round(screenSize.top * 65535 / GetSystemMetrics(SM_CYSCREEN));
-		screenSize.bottom = round(screenSize.bottom * 65535 / GetSystemMetrics(SM_CYSCREEN));
+		display.rebuild(NULL);
 
 		oldPos.x = -99999;
 		oldPos.y = -99999;
@@ -1175,11 +1603,25 @@
 		avgPos.x = 0;
 		avgPos.y = 0;
 		avgPos.z = 0;
+		anchorOffset.x = 0;
+		anchorOffset.y = 0;
+		anchorOffset.z = 0;
+		lastRaw = resumeFrom = Move::Vec3(0, 0, 0);
+	}
 
-		ctrlRegion_d.left = -30;
-		ctrlRegion_d.right = 30;
-		ctrlRegion_d.top = max(10, min(20, 30 / screenWHratio));			//default height between 1/3 to 2/3 of width
-		ctrlRegion_d.bottom = max(-10, min(-20, -30 / screenWHratio));
+	//From the current display layout, so a monitor added or rotated since startup is taken into account
+	RECTf MoveObserver::defaultRegion() {
+		const Topology* topo = display.acquire();
+		float screenWHratio = topo->whRatio;
+		display.release(topo);
+
+		//With metricPosition these are centimetres: an arm's sweep of 60 cm across, whatever the room
+		RECTf r;
+		r.left = -30;
+		r.right = 30;
+		r.top = max(10, min(20, 30 / screenWHratio));			//default height between 1/3 to 2/3 of width
+		r.bottom = max(-10, min(-20, -30 / screenWHratio));
+		return r;
 	}
 
 	//Restore size and position of console window
@@ -1234,7 +1676,7 @@
 
 	//Check for the presence of an PS Eye camera
 	void MoveObserver::initCamera() {
-		if (!move->initCamera(numMoves)) {
+		if (!openCamera()) {
 			showMyself();
 			printf("No PS Eye Camera found. Closing in 5 seconds. \n\n");
 			Sleep(5000);
@@ -1244,6 +1686,58 @@
 		}
 	}
 
+	//Opens the camera and starts whatever runs on its frames. Returns false if there is no camera.
+	BOOL MoveObserver::openCamera() {
+		if (!move->initCamera(numMoves)) return false;
+
+		//Also called from the control and shell threads on resume, so not through cfg
+		const Settings* c = settings.acquire();
+		bool tracking = c->eyePipelineOn || c->metricPosition || c->colorPlannerOn;		//Metric positions come from the pipeline's fits
+		bool pipeline = tracking || c->recordSessionOn;		//Only the pipeline reads camera frames
+
+		//Before the pipeline, which feeds it. A session paused by closeCamera() carries on in its file.
+		if (!c->recordSessionOn) {
+			recorder.stop();
+		}
+		else if (!recorder.resume(move->getEye())) {
+			SYSTEMTIME t;
+			TCHAR path[MAX_PATH];
+			GetLocalTime(&t);
+			_stprintf_s(path, TEXT("movepoint-%04d%02d%02d-%02d%02d%02d.mpsession"), t.wYear, t.wMonth, t.wDay, t.wHour, t.wMinute, t.wSecond);
+			recorder.start(move->getEye(), path);
+		}
+		if (pipeline) {
+			eyePipeline.setExport(c->frameExportOn ? &frameExport : nullptr);
+			eyePipeline.setRecorder(c->recordSessionOn ? &recorder : nullptr);
+			eyePipeline.start(move->getEye(), this);
+
+			int eyeWidth, eyeHeight;
+			move->getEye()->getEyeDimensions(eyeWidth, eyeHeight);
+			eyeCal.setResolution(eyeWidth, eyeHeight);
+		}
+		//The SDK does not tell its automatic colours, so the pipeline segments the planner's.
+		//Recording alone runs the pipeline without targets and leaves the SDK's colours be.
+		if (tracking) {
+			move->getEye()->useAutomaticColors(false);
+			if (!colorPlanner.start(move->getEye(), &eyePipeline, this, numMoves)) {
+				printf("%d No sphere colours for the camera pipeline; not tracking with it \n", ++curConsoleLine);
+				move->getEye()->useAutomaticColors(true);
+				if (!c->recordSessionOn) eyePipeline.stop();
+			}
+		}
+		settings.release(c);
+		return true;
+	}
+
+	void MoveObserver::closeCamera() {
+		colorPlanner.stop();
+		eyePipeline.stop();			//Feeds the recorder
+		recorder.pause();
+		clearFitQuality();
+		ZeroMemory(haveMetric, sizeof(haveMetric));
+		move->closeCamera();
+	}
+
 	//Print a debug message
 	void MoveObserver::printDebugMessage(int moveId, Move::MoveData data) {
 
@@ -1254,14 +1748,36 @@
 			data.position.x, data.position.y, data.position.z,
 			data.orientation.w, data.orientation.v.x, data.orientation.v.y, data.orientation.v.z,
 			data.trigger);
-		printf("AVG NORMALIZED pos:%.2f %.2f %.2f   ori:%.2f %.2f %.2f %.2f\n",
+		printf("AVG NORMALIZED pos:%.2f %.2f %.2f   ori:%.2f %.2f %.2f %.2f   prefilter:%d\n",
 			avgPos.x, avgPos.y, avgPos.z,
-			avgOrient.w, avgOrient.v.x, avgOrient.v.y, avgOrient.v.z);
+			avgOrient.w, avgOrient.v.x, avgOrient.v.y, avgOrient.v.z,
+			outlierFilter.getMode());
+		Move::Vec3 sigma = noise.getSigma();
+		printf("NOISE auto:%d  estimates:%ld  sigma:%.3f %.3f %.3f  threshold:%.3f %.3f  weight:%.2f %.2f %.2f  scroll:%.2f %.2f\n",
+			cfg->autoTune, noise.getEstimateCount(), sigma.x, sigma.y, sigma.z,
+			axisThreshold.x, axisThreshold.y, posWeight.x, posWeight.y, posWeight.z, scrollScale.x, scrollScale.y);
+		printf("PROFILE:%d  speed:%.2f  speed gain:%.2f  distance gain:%.2f\n",
+			transfer.getProfile(), trackingOf(moveId).speed(), transfer.speedGain(trackingOf(moveId).speed()), transfer.distanceGain(data.position));
 		if (GetPhysicalCursorPos(&debugCurPos)) {
 			printf("CURSOR pos:%d %d\n", debugCurPos.x, debugCurPos.y);
 		}
-		printf("SCREEN left:%d  right:%d top:%d bottom:%d\n",
-			screenSize.left, screenSize.right, screenSize.top, screenSize.bottom);
+		display.print();
+		targets.print();
+		drag.print();
+		snapLayout.print();
+		desktops.print();
+		inputLedger.print();
+		control.print();
+		warm.print();
+		eyePipeline.print();
+		recorder.print();
+		if (cfg->metricPosition) eyeCal.print();
+
+		const TrackingQuality & tracking = trackingOf(moveId);
+		const TrackingMetrics & tm = tracking.getMetrics();
+		printf("TRACKING state:%d  residual:%.2f  fit:%.2f  dropouts:%lu  jumps:%lu  poor fits:%lu  last:%.0fms  longest:%.0fms  total:%.0fms\n",
+			trackState, tracking.residualSigma(), tracking.getFitQuality(), tm.dropoutCount, tm.jumpCount, tm.poorFitCount,
+			tm.lastDropoutMs, tm.longestDropoutMs, tm.totalDropoutMs);
 		printf("\n");
 		printPos = false;
 	}
@@ -12,6 +12,26 @@
 
 #include "movepoint.h"
 #include "win_actions.h"
+#include "TrackingQuality.h"
+#include "OutlierFilter.h"
+#include "TransferFunction.h"
+#include "NoiseEstimator.h"
+#include "DisplayTopology.h"
+#include "ShellEvents.h"
+#include "EyePipeline.h"
+#include "ColorPlanner.h"
+#include "FrameExport.h"
+#include "SessionRecorder.h"
+#include "EyeCalibration.h"
+#include "SettingsStore.h"
+#include "AppProfiles.h"
+#include "TargetResolver.h"
+#include "DragEngine.h"
+#include "SnapLayout.h"
+#include "VirtualDesktops.h"
+#include "InputLedger.h"
+#include "ControlChannel.h"
+#include "WarmState.h"
 
 using namespace movepoint;
 using namespace win_actions;
@@ -23,6 +43,19 @@ const float appScrollThreshold_d = 5;		//Threshold of movement before scrolling
 const float mouseThreshold_d = 0.2;			//Threshold of movement before cursor moves 1:1 with handset. For reducing cursor jitter.
 const float curPosWeight_d = 0.4;			//Weight of current handset position in calculating moving average. For reducing cursor jitter.
 const int moveDelay_d = 0;					//Time to wait before executing press event in milliseconds. For reducing cursor shake while pressing button.
+const float orientGain_d = 2.5;				//Screen widths of cursor travel per unit of orientation change while the sphere is not tracked.
+const int cursorProfile_d = PROFILE_BALANCED;	//Pointer acceleration profile. 0 = precise, 1 = balanced, 2 = fast.
+const int autoTune_d = 0;					//Adapt mouseThreshold, curPosWeight and the scroll thresholds per axis to the measured noise floor. Off so registry values apply as set.
+const int prefilterMode_d = OUTLIER_OFF;		//Outlier rejection before smoothing. 0 = off, 1 = sliding median, 2 = Hampel filter.
+const float anchorDecay_d = 0.9;			//How quickly the cursor offset left by a tracking dropout is absorbed once tracking returns.
+const int eyePipeline_d = 0;				//Run our own camera pipeline next to MoveManager's tracking, for sphere fit quality. Starts colorPlanner.
+const int frameExport_d = 0;				//Share camera frames and sphere masks with viewers in other processes. Needs eyePipeline.
+const int recordSession_d = 0;				//Record camera frames and the sensor trace to movepoint-<date>-<time>.mpsession while the camera runs. Starts eyePipeline.
+const int metricPosition_d = 0;				//Position from our own sphere fit, in centimetres from the camera, so ctrlRegion is a physical size. Starts eyePipeline and colorPlanner.
+const int colorPlanner_d = 0;				//Pick sphere colours from a histogram of the room instead of the SDK's automatic colours. Starts eyePipeline.
+const int colorLutBits_d = 0;				//Bits per channel of the colour lookup tables. 0 = compute colours with the SIMD kernels instead.
+const int dragSnap_d = 1;					//Dragged windows stick to monitor work area edges
+const DWORD resumeTargetMs_d = 300;			//Resume to first camera position should take no longer than this
 
 enum snapStatus
 {
@@ -35,31 +68,58 @@ enum snapStatus
 	SNAP_CLOSE = 6
 };
 
-class MoveObserver : public Move::IMoveObserver
+class MoveObserver : public Move::IMoveObserver, public IShellListener, public IEyeListener, public IColorListener, public IControlListener
 {
 	//variables and objects
-	Move::IMoveManager* move;
+	Move::IMoveManager* move = nullptr;
 	int numMoves;
 
-	//Settings
-	float scrollPercent = 0.5;
-	float scrollThreshold = 1;
-	float appScrollThreshold = 5;
-	float mouseThreshold = 0.2;
-	float curPosWeight = 0.4;
-	int moveDelay = 0;
+	//Settings. cfg is the snapshot the sensor thread works with, pinned until the next calSettings(); other threads
+	//acquire their own. Calibration edits draft and publishes it when done.
+	SettingsStore settings;
+	const Settings* cfg = nullptr;
+	Settings draft;
+	LONG appliedSerial = 0;
+	ULONGLONG calibrationKey = 0;			//warmKey() of what the warm state depends on in cfg
 	int autoThreshold = 250000;
 	int myMoveDelay, myScrollDelay;
 	bool stableX = false;
 	bool stableY = false;
 
 	//Position
-	RECT screenSize;
-	float screenWHratio;
-	RECTf ctrlRegion, ctrlRegion_d;
+	DisplayTopology display;
+	ShellEvents shell;
+	AppProfiles appProfiles;
+	TargetResolver targets;
+	DragEngine drag;
+	SnapLayout snapLayout;
+	VirtualDesktops desktops;
+	InputLedger inputLedger;
+	ControlChannel control;
+	WarmState warm;
 	POINT cursorPos, winCurDiff;
 	Move::Vec3 oldPos, curPosNorm, avgPos;
-	Move::Quat avgOrient;
+	Move::Quat avgOrient, lastOrient;
+	OutlierFilter outlierFilter;
+	TransferFunction transfer;
+
+	//Noise floor and the per-axis values derived from it
+	NoiseEstimator noise;
+	Move::Vec3 axisThreshold, invThreshold, posWeight, scrollScale;
+
+	//Tracking quality
+	TrackingQuality trackers[maxEyeControllers];		//Per controller: fits and residuals of one sphere say nothing about another
+	trackingState trackState = TRACKING_OK;
+	Move::Vec3 anchorOffset;
+
+	//Camera
+	EyePipeline eyePipeline;
+	FrameExport frameExport;
+	SessionRecorder recorder;
+	ColorPlanner colorPlanner;
+	EyeCalibration eyeCal;
+	Move::Vec3 lastMetric[maxEyeControllers];
+	bool haveMetric[maxEyeControllers] = {};		//A fit has come in since the pipeline started
 
 	//Timers - TODO: switch to std::chrono 
 	ULARGE_INTEGER	cur_FT, old_FT, 
@@ -70,6 +130,18 @@ class MoveObserver : public Move::IMoveObserver
 
 	//Modes
 	bool controllerOn = true;
+	volatile bool paused = false;			//Set from the control and shell threads
+	volatile LONG resumePending = 0;
+	const char* volatile releaseReason = nullptr;	//Set by suspend(); the sensor thread releases held input and drags
+	volatile LONG recalibratePending = 0;
+	volatile LONGLONG resumeStart = 0;		//Performance counter at resume, until the camera first gives a position
+	volatile LONG eyeFrames = 0;			//Pipeline results, counted on the fusion thread
+	LONG resumeEyeFrames = 0;				//eyeFrames at resume
+	Move::Vec3 lastRaw, resumeFrom;			//Last SDK position, and the one from before the pause
+	DWORD lastResumeMs = 0;
+	volatile bool started = false;			//Set at the end of the constructor
+	bool sessionLocked = false;				//Under lifecycleLock
+	CRITICAL_SECTION lifecycleLock;			//suspend and resume come from the shell and control threads
 	bool mouseMode = true;
 	bool scrollMode = false;
 	bool dragMode = false;
@@ -95,8 +167,8 @@ class MoveObserver : public Move::IMoveObserver
 
 	bool printPos = false;
 	bool takeInitReading = true;
+	int keyMoveId = 0;						//Controller of the button being handled
 
-	long hasSystemSettings = false;
 	byte calibrationMode = 0;
 
 	//For drag operations
@@ -124,6 +196,19 @@ public:
 
 	void extraStableX(BOOL stabilize);
 	void extraStableY(BOOL stabilize);
+	void setOutlierFilter(outlierMode mode);
+	void setCursorProfile(pointerProfile profile);
+	void displayChanged();
+	void foregroundChanged(HWND hWnd);
+	void windowDestroyed(HWND hWnd);
+	void sessionChanged(sessionEvent event);
+	void commandReceived(controlCommand command);
+	void suspend(const char* reason);
+	void resume();
+	void eyeUpdated(const EyeResult & result);
+	void colorsPlanned(int count, const float* hues);
+	void setSphereColor(int moveId, int r, int g, int b);
+	void useAutomaticColors(bool use);
 
 private:
 	void updatePos(Move::MoveData data);
@@ -142,29 +227,42 @@ private:
 	void moveArrows(int moveId, Move::MoveData data);
 	void moveCursor(int moveId, Move::MoveData data);
 	void moveCursorTilt(int moveId, Move::MoveData data);
+	void moveCursorRelative(int moveId, Move::MoveData data);
+	void reanchorCursor();
+	void resetModes();
+	void noteCursorMove();
+	void applyNoiseEstimate();
+	TrackingQuality & trackingOf(int moveId);
+	void clearFitQuality();
+	void restoreWarmState();
+	void checkpointWarmState();
 
 	void scroll(int moveId, Move::MoveData data);
 	void snap(int keyCode);
 	void zoom(int keyCode);
 	void desktop(int keyCode);
-	void dragWindow(int moveId = 0);
 
 	void calibrateRegion();
 	void showCalibrationSteps();
+	void calibrateCameraStep();
+	void finishCalibration();
+	bool metricPos(int moveId, Move::Vec3 & pos);
 	void calibrateRecordPos(Move::MoveData data);
 	void takeInitOrient(Move::MoveData data);
 	void restoreDefaults();
 	void calSettings();
+	Settings defaultSettings();
+	RECTf defaultRegion();
 	void saveSettings();
-	LONG saveSettingsReal(HKEY inKey);
 	void readSettings();
-	LONG readSettingsReal(HKEY inKey);
 	void initValues();
 	BOOL showMyself(int showTime = -1);
 	BOOL hideMyself();
 	static unsigned int __stdcall hideMyself_T(void *p_thread_data);
 	void setupConsole();
 	void initCamera();
+	BOOL openCamera();
+	void closeCamera();
 	void printDebugMessage(int moveId, Move::MoveData data);
 	void checkAdminRights();
 	
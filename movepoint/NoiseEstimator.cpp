@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "NoiseEstimator.h"
+
+namespace movepoint {
+
+	NoiseEstimator::NoiseEstimator() {
+		reset();
+	}
+
+	void NoiseEstimator::reset() {
+		for (int i = 0; i < 3; i++) axis[i].reset();
+		sigma = Move::Vec3::ZERO;
+		ready = false;
+		estimates = 0;
+	}
+
+	//Estimate carried over from a previous run; the next window refines it as usual
+	void NoiseEstimator::restore(Move::Vec3 inSigma, long inEstimates) {
+		reset();
+		sigma = inSigma;
+		estimates = inEstimates;
+		ready = (inEstimates > 0);
+	}
+
+	//Returns true when a window completes and the estimate has changed
+	bool NoiseEstimator::update(Move::Vec3 pos, bool still) {
+
+		//Any movement invalidates the partial window
+		if (!still) {
+			for (int i = 0; i < 3; i++) axis[i].reset();
+			return false;
+		}
+
+		axis[0].add(pos.x);
+		axis[1].add(pos.y);
+		axis[2].add(pos.z);
+
+		if (axis[0].n < window) return false;
+
+		Move::Vec3 cur((float)sqrt(axis[0].variance()), (float)sqrt(axis[1].variance()), (float)sqrt(axis[2].variance()));
+		for (int i = 0; i < 3; i++) axis[i].reset();
+
+		//Follow slow changes in lighting and distance without reacting to a single odd window
+		if (ready) {
+			sigma.x = 0.8f * sigma.x + 0.2f * cur.x;
+			sigma.y = 0.8f * sigma.y + 0.2f * cur.y;
+			sigma.z = 0.8f * sigma.z + 0.2f * cur.z;
+		}
+		else {
+			sigma = cur;
+		}
+		ready = true;
+		estimates++;
+		return true;
+	}
+
+	bool NoiseEstimator::hasEstimate() const {
+		return ready;
+	}
+
+	long NoiseEstimator::getEstimateCount() const {
+		return estimates;
+	}
+
+	Move::Vec3 NoiseEstimator::getSigma() const {
+		return sigma;
+	}
+
+	//Dead zone wide enough that noise alone rarely moves the cursor
+	float NoiseEstimator::threshold(float axisSigma) const {
+		return max(min(deadZoneSigmas * axisSigma, thresholdMax), thresholdMin);
+	}
+
+	//Lower the moving average weight (cutoff) when the axis is noisier than the configured threshold assumes
+	float NoiseEstimator::weight(float baseWeight, float baseThreshold, float axisSigma) const {
+		float refSigma = baseThreshold / deadZoneSigmas;
+		float w = (axisSigma > 0 ? baseWeight * refSigma / axisSigma : weightMax);
+		return max(min(w, weightMax), weightMin);
+	}
+
+	//Scroll steps grow and shrink with the dead zone, relative to the configured mouseThreshold
+	float NoiseEstimator::scrollScale(float baseThreshold, float axisSigma) const {
+		float s = (baseThreshold > 0 ? threshold(axisSigma) / baseThreshold : 1);
+		return max(min(s, scrollScaleMax), scrollScaleMin);
+	}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	//Default values
+	const int noiseWindow_d = 60;				//Still samples per estimate
+	const float deadZoneSigmas_d = 4;			//Dead zone (mouseThreshold) as a multiple of the noise standard deviation
+	const float thresholdMin_d = 0.05;			//Bounds for the adapted mouseThreshold
+	const float thresholdMax_d = 1.0;
+	const float weightMin_d = 0.1;				//Bounds for the adapted curPosWeight
+	const float weightMax_d = 0.8;
+	const float scrollScaleMin_d = 0.5;			//Bounds for the factor applied to scrollThreshold and appScrollThreshold
+	const float scrollScaleMax_d = 3.0;
+	const float stillAngular_d = 0.3;			//Angular speed below which the controller counts as still
+
+	/* Estimates the per-axis position noise floor while the controller is held still,
+	using Welford's online variance over windows of still samples. */
+	class NoiseEstimator
+	{
+		struct Welford
+		{
+			long n;
+			double mean, m2;
+			void reset() { n = 0; mean = 0; m2 = 0; }
+			void add(double x) {
+				n++;
+				double delta = x - mean;
+				mean += delta / n;
+				m2 += delta * (x - mean);
+			}
+			double variance() const { return (n > 1 ? m2 / (n - 1) : 0); }
+		};
+
+		Welford axis[3];
+		Move::Vec3 sigma;
+		bool ready = false;
+		long estimates = 0;
+
+	public:
+		int window = noiseWindow_d;
+		float deadZoneSigmas = deadZoneSigmas_d;
+		float thresholdMin = thresholdMin_d;
+		float thresholdMax = thresholdMax_d;
+		float weightMin = weightMin_d;
+		float weightMax = weightMax_d;
+		float scrollScaleMin = scrollScaleMin_d;
+		float scrollScaleMax = scrollScaleMax_d;
+
+		NoiseEstimator();
+		bool update(Move::Vec3 pos, bool still);
+		bool hasEstimate() const;
+		long getEstimateCount() const;
+		Move::Vec3 getSigma() const;
+		float threshold(float axisSigma) const;
+		float weight(float baseWeight, float baseThreshold, float axisSigma) const;
+		float scrollScale(float baseThreshold, float axisSigma) const;
+		void reset();
+		void restore(Move::Vec3 inSigma, long inEstimates);
+	};
+
+}
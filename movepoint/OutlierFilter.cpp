@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "OutlierFilter.h"
+
+#include <emmintrin.h>
+
+namespace movepoint {
+
+	//Compare-exchange: a gets the smaller, b the larger value in every lane
+	#define SORT2(a, b) { __m128 t = _mm_min_ps(a, b); b = _mm_max_ps(a, b); a = t; }
+
+	//Median of five per lane. The min and max of the first four can never be the median,
+	//which leaves a median of three: six compare-exchanges in total.
+	static inline __m128 median5(__m128 a, __m128 b, __m128 c, __m128 d, __m128 e) {
+		SORT2(a, b);
+		SORT2(c, d);
+		SORT2(a, c);
+		SORT2(b, d);
+		SORT2(b, c);
+		return _mm_max_ps(b, _mm_min_ps(c, e));
+	}
+
+	OutlierFilter::OutlierFilter() {
+		reset();
+	}
+
+	void OutlierFilter::reset() {
+		ZeroMemory(window, sizeof(window));
+		next = 0;
+		primed = false;
+	}
+
+	void OutlierFilter::setMode(outlierMode newMode) {
+		if (newMode != mode) reset();
+		mode = newMode;
+	}
+
+	outlierMode OutlierFilter::getMode() const {
+		return mode;
+	}
+
+	Move::Vec3 OutlierFilter::filter(Move::Vec3 pos) {
+
+		if (mode == OUTLIER_OFF) return pos;
+
+		__m128 cur = _mm_set_ps(0, pos.z, pos.y, pos.x);
+
+		//Fill the whole window with the first sample so the filter starts without a transient
+		if (!primed) {
+			for (int i = 0; i < windowSize; i++) _mm_storeu_ps(window[i], cur);
+			primed = true;
+		}
+		_mm_storeu_ps(window[next], cur);
+		next = (next + 1) % windowSize;
+
+		__m128 w0 = _mm_loadu_ps(window[0]);
+		__m128 w1 = _mm_loadu_ps(window[1]);
+		__m128 w2 = _mm_loadu_ps(window[2]);
+		__m128 w3 = _mm_loadu_ps(window[3]);
+		__m128 w4 = _mm_loadu_ps(window[4]);
+
+		__m128 med = median5(w0, w1, w2, w3, w4);
+		__m128 out = med;
+
+		if (mode == OUTLIER_HAMPEL) {
+			//Median absolute deviation, scaled to a standard deviation for normal noise
+			const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			__m128 mad = median5(
+				_mm_and_ps(_mm_sub_ps(w0, med), absMask),
+				_mm_and_ps(_mm_sub_ps(w1, med), absMask),
+				_mm_and_ps(_mm_sub_ps(w2, med), absMask),
+				_mm_and_ps(_mm_sub_ps(w3, med), absMask),
+				_mm_and_ps(_mm_sub_ps(w4, med), absMask));
+			__m128 limit = _mm_max_ps(_mm_mul_ps(mad, _mm_set1_ps(1.4826f * hampelSigmas)), _mm_set1_ps(hampelFloor));
+			__m128 outlier = _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(cur, med), absMask), limit);
+
+			//Select the median where the sample is an outlier, the sample itself otherwise
+			out = _mm_or_ps(_mm_and_ps(outlier, med), _mm_andnot_ps(outlier, cur));
+		}
+
+		float res[4];
+		_mm_storeu_ps(res, out);
+		return Move::Vec3(res[0], res[1], res[2]);
+	}
+
+	#undef SORT2
+
+}
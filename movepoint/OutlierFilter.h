@@ -0,0 +1,39 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	//Default values
+	const float hampelSigmas_d = 3;			//Samples further than this many (MAD-estimated) deviations from the median are replaced
+	const float hampelFloor_d = 0.5;			//Deviations below this are never replaced, even when the window has no spread
+
+	enum outlierMode
+	{
+		OUTLIER_OFF = 0,
+		OUTLIER_MEDIAN = 1,						//Output the sliding median
+		OUTLIER_HAMPEL = 2						//Only replace samples that are far from the sliding median
+	};
+
+	/* Pre-filter for single-frame camera glitches. Keeps a 5-sample window of positions
+	and runs a branchless SSE sorting network over x, y and z at once. */
+	class OutlierFilter
+	{
+		static const int windowSize = 5;
+
+		float window[windowSize][4];			//x, y, z, padding. Loaded unaligned since the owner lives on the heap.
+		int next = 0;
+		bool primed = false;
+		outlierMode mode = OUTLIER_OFF;
+
+	public:
+		float hampelSigmas = hampelSigmas_d;
+		float hampelFloor = hampelFloor_d;
+
+		OutlierFilter();
+		Move::Vec3 filter(Move::Vec3 pos);
+		void setMode(outlierMode newMode);
+		outlierMode getMode() const;
+		void reset();
+	};
+
+}
@@ -0,0 +1,494 @@
+#include "stdafx.h"
+#include "SessionRecorder.h"
+#include "FrameCodec.h"
+
+#include <process.h>
+
+namespace movepoint {
+
+	SessionRecorder::SessionRecorder() {
+		ZeroMemory(pool, sizeof(pool));
+		ZeroMemory(&stats, sizeof(stats));
+	}
+
+	SessionRecorder::~SessionRecorder() {
+		stop();
+	}
+
+	BOOL SessionRecorder::start(Move::IEyeController* inEye, LPCTSTR path) {
+		if (running || paused || inEye == nullptr) return false;
+
+		eye = inEye;
+		eye->getEyeDimensions(width, height);
+		if (width <= 0 || height <= 0) return false;
+
+		hFile = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (hFile == INVALID_HANDLE_VALUE) {
+			printf("Session recorder: could not create the file (error %lu). \n", GetLastError());
+			return false;
+		}
+
+		for (int i = 0; i < poolSize; i++) {
+			pool[i].pixels = (unsigned char*)_aligned_malloc(width * height * eyeBytesPerPixel, 32);
+		}
+		encoded = (unsigned char*)malloc(frameCodecBound(width * height));
+		writeBuffer = (unsigned char*)malloc(recordWriteBytes_d);
+		writeUsed = 0;
+		fileOffset = 0;
+		index.clear();
+		index.reserve(recordIndexBlock_d);
+		lastIndexOffset = -1;
+		indexEntries = 0;
+		ZeroMemory(&stats, sizeof(stats));
+		droppedMoves = 0;
+		captureSeq = 0;
+
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		startMs = eyeTimeMs();
+
+		SessionFileHeader fileHeader;
+		ZeroMemory(&fileHeader, sizeof(fileHeader));
+		fileHeader.magic = sessionMagic;
+		fileHeader.version = sessionVersion;
+		fileHeader.width = width;
+		fileHeader.height = height;
+		fileHeader.startTime = ((long long)now.dwHighDateTime << 32) | now.dwLowDateTime;
+		memcpy(writeBuffer, &fileHeader, sizeof(fileHeader));
+		writeUsed = sizeof(fileHeader);
+		fileOffset = sizeof(fileHeader);
+
+		startThreads();
+		printf("Recording session: %dx%d. \n", width, height);
+		return true;
+	}
+
+	//Every pool frame starts out free
+	void SessionRecorder::startThreads() {
+		for (int i = 0; i < poolSize; i++) freeQueue.push(&pool[i]);
+		captureDrops = 0;
+
+		running = 1;
+		unsigned int thread_id = 0;
+		hWriter = (HANDLE)_beginthreadex(NULL, 0, writerProc, this, 0, &thread_id);
+		if (hWriter != NULL) SetThreadPriority(hWriter, THREAD_PRIORITY_BELOW_NORMAL);		//Never ahead of tracking
+	}
+
+	/* The writer checks running at least every 20 ms, so the join is short, and nothing below
+	may run while it could still touch the pool or the buffers. The pipeline feeding captured()
+	is stopped first. Frames already captured are written out. */
+	void SessionRecorder::stopThreads() {
+		InterlockedExchange(&running, 0);
+		writeQueue.wake();
+		if (hWriter != NULL) {
+			WaitForSingleObject(hWriter, INFINITE);
+			CloseHandle(hWriter);
+			hWriter = NULL;
+		}
+
+		RecordFrame* frame;
+		while (writeQueue.pop(frame)) writeFrame(frame);
+		writeMoves();
+		while (freeQueue.pop(frame));
+	}
+
+	//The camera is going away for a while; the file stays open for resume()
+	void SessionRecorder::pause() {
+		if (!running) return;
+
+		stopThreads();
+		flush();
+		pausedMs = eyeTimeMs() - startMs;
+		paused = true;
+	}
+
+	//Carries on in the same file behind a gap marker. False, with the file finished, if the camera mode changed.
+	BOOL SessionRecorder::resume(Move::IEyeController* inEye) {
+		if (!paused || inEye == nullptr) return false;
+
+		int w, h;
+		inEye->getEyeDimensions(w, h);
+		if (w != width || h != height) {
+			stop();
+			return false;
+		}
+
+		eye = inEye;
+		SessionGap gap = { 0, 0, pausedMs, eyeTimeMs() - startMs };
+		writeChunk(CHUNK_GAP, &gap, sizeof(gap), gap.fromMs, 0);
+		stats.gaps++;
+		paused = false;
+		startThreads();
+		return true;
+	}
+
+	void SessionRecorder::stop() {
+		if (!running && !paused) return;
+
+		if (running) stopThreads();
+		paused = false;
+		finish();
+
+		for (int i = 0; i < poolSize; i++) {
+			if (pool[i].pixels != NULL) _aligned_free(pool[i].pixels);
+		}
+		ZeroMemory(pool, sizeof(pool));
+		free(encoded);
+		free(writeBuffer);
+		encoded = NULL;
+		writeBuffer = NULL;
+		index.clear();
+
+		printf("Session recorded: %ld frames, %ld dropped, %.1f MB. \n", stats.frames, stats.droppedFrames, stats.fileBytes / (1 << 20));
+	}
+
+	bool SessionRecorder::isRecording() const {
+		return running != 0;
+	}
+
+	bool SessionRecorder::isPaused() const {
+		return paused;
+	}
+
+	//Sensor thread. Never waits: when the writer is behind the sample is dropped and counted.
+	void SessionRecorder::recordMove(int moveId, const Move::MoveData & data) {
+		if (!running) return;
+
+		SessionMove sample;
+		sample.timeMs = eyeTimeMs() - startMs;
+		sample.moveId = moveId;
+		sample.data = data;
+		if (!moveQueue.push(sample)) {
+			if (droppedMoves == 0) moveGapFromMs = sample.timeMs;
+			InterlockedIncrement(&droppedMoves);
+		}
+	}
+
+	//Pipeline capture thread, every frame. Never waits: with the pool taken the frame is dropped and a gap marked.
+	void SessionRecorder::captured(const unsigned char* pixels, double captureMs) {
+		if (!running) return;
+
+		double timeMs = captureMs - startMs;
+		RecordFrame* frame;
+		if (!freeQueue.pop(frame)) {
+			if (captureDrops++ == 0) gapFromMs = timeMs;			//The encoder or the disk is behind
+			return;
+		}
+
+		memcpy(frame->pixels, pixels, width * height * eyeBytesPerPixel);
+		frame->timeMs = timeMs;
+		frame->seq = captureSeq++;
+		frame->dropsBefore = captureDrops;
+		frame->gapFromMs = gapFromMs;
+		captureDrops = 0;
+
+		writeQueue.push(frame);
+	}
+
+	unsigned int __stdcall SessionRecorder::writerProc(void *p_thread_data) {
+		SessionRecorder* self = static_cast<SessionRecorder*>(p_thread_data);
+		RecordFrame* frame;
+
+		while (self->running) {
+			if (self->writeQueue.wait(frame, 20)) {
+				self->writeFrame(frame);
+				self->freeQueue.push(frame);
+			}
+			else {
+				self->writeMoves();
+			}
+		}
+		return 0;
+	}
+
+	//Writer thread, or stop() once the threads are gone
+	void SessionRecorder::writeChunk(DWORD type, const void* data, DWORD bytes, double timeMs, long long seq) {
+		SessionChunk chunk;
+		chunk.type = type;
+		chunk.bytes = bytes;
+		chunk.timeMs = timeMs;
+		chunk.seq = seq;
+
+		if (type == CHUNK_FRAME) {
+			SessionIndexEntry entry = { fileOffset, timeMs, seq };
+			index.push_back(entry);
+		}
+
+		int total = sizeof(chunk) + bytes;
+		if (writeUsed + total > recordWriteBytes_d) flush();
+		if (total > recordWriteBytes_d) {
+			//Larger than the whole buffer: straight to disk
+			memcpy(writeBuffer, &chunk, sizeof(chunk));
+			writeUsed = sizeof(chunk);
+			flush();
+			double start = eyeTimeMs();
+			DWORD written = 0;
+			WriteFile(hFile, data, bytes, &written, NULL);
+			stats.writeMs += eyeTimeMs() - start;
+		}
+		else {
+			memcpy(writeBuffer + writeUsed, &chunk, sizeof(chunk));
+			memcpy(writeBuffer + writeUsed + sizeof(chunk), data, bytes);
+			writeUsed += total;
+		}
+		fileOffset += total;
+		stats.fileBytes += total;
+	}
+
+	//Everything queued. Called while no frame is waiting, and at the end.
+	void SessionRecorder::writeMoves() {
+		LONG dropped = InterlockedExchange(&droppedMoves, 0);
+		if (dropped > 0) {
+			SessionGap gap = { 0, dropped, moveGapFromMs, eyeTimeMs() - startMs };
+			writeChunk(CHUNK_GAP, &gap, sizeof(gap), gap.fromMs, 0);
+			stats.droppedMoves += dropped;
+			stats.gaps++;
+		}
+
+		SessionMove batch[recordMovesPerChunk];
+		int count = 0;
+		while (moveQueue.pop(batch[count])) {
+			if (++count == recordMovesPerChunk) {
+				writeChunk(CHUNK_MOVE, batch, count * sizeof(SessionMove), batch[0].timeMs, 0);
+				stats.moves += count;
+				count = 0;
+			}
+		}
+		if (count > 0) {
+			writeChunk(CHUNK_MOVE, batch, count * sizeof(SessionMove), batch[0].timeMs, 0);
+			stats.moves += count;
+		}
+	}
+
+	void SessionRecorder::writeFrame(RecordFrame* frame) {
+		//Samples up to the frame's capture time belong before it
+		SessionMove sample;
+		SessionMove batch[recordMovesPerChunk];
+		int count = 0;
+		while (count < recordMovesPerChunk && moveQueue.peek(sample) && sample.timeMs <= frame->timeMs) {
+			moveQueue.pop(batch[count++]);
+		}
+		if (count > 0) {
+			writeChunk(CHUNK_MOVE, batch, count * sizeof(SessionMove), batch[0].timeMs, 0);
+			stats.moves += count;
+		}
+
+		if (frame->dropsBefore > 0) {
+			SessionGap gap = { frame->dropsBefore, 0, frame->gapFromMs, frame->timeMs };
+			writeChunk(CHUNK_GAP, &gap, sizeof(gap), gap.fromMs, frame->seq);
+			stats.droppedFrames += frame->dropsBefore;
+			stats.gaps++;
+		}
+
+		double start = eyeTimeMs();
+		int bytes = encodeFrame(frame->pixels, width * height, encoded);
+		stats.encodeMs += eyeTimeMs() - start;
+
+		writeChunk(CHUNK_FRAME, encoded, bytes, frame->timeMs, frame->seq);
+		stats.frames++;
+		stats.rawBytes += width * height * eyeBytesPerPixel;
+		if ((int)index.size() >= recordIndexBlock_d) writeIndex();
+	}
+
+	//Entries since the last index chunk, linked back to it
+	void SessionRecorder::writeIndex() {
+		long long offset = fileOffset;
+		writeChunk(CHUNK_INDEX, index.data(), (DWORD)(index.size() * sizeof(SessionIndexEntry)), eyeTimeMs() - startMs, lastIndexOffset);
+		indexEntries += (DWORD)index.size();
+		lastIndexOffset = offset;
+		index.clear();
+	}
+
+	void SessionRecorder::flush() {
+		if (writeUsed == 0) return;
+
+		double start = eyeTimeMs();
+		DWORD written = 0;
+		WriteFile(hFile, writeBuffer, writeUsed, &written, NULL);
+		stats.writeMs += eyeTimeMs() - start;
+		writeUsed = 0;
+	}
+
+	//Threads are gone: samples that came in since, then the last index chunk and the footer
+	void SessionRecorder::finish() {
+		writeMoves();
+		writeIndex();
+
+		SessionFooter footer;
+		footer.magic = sessionFooterMagic;
+		footer.entries = indexEntries;
+		footer.indexOffset = lastIndexOffset;
+
+		if (writeUsed + (int)sizeof(footer) > recordWriteBytes_d) flush();
+		memcpy(writeBuffer + writeUsed, &footer, sizeof(footer));
+		writeUsed += sizeof(footer);
+		stats.fileBytes += sizeof(footer);
+		flush();
+
+		CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+
+	const RecordStats & SessionRecorder::getStats() const {
+		return stats;
+	}
+
+	void SessionRecorder::print() const {
+		if (!running) return;
+
+		double elapsed = max(eyeTimeMs() - startMs, 1.0);
+		printf("RECORDING frames:%ld  dropped:%ld  gaps:%ld  samples:%ld (%ld dropped)  ratio:%.2f  encode:%.2fms  disk:%.1f MB/s\n",
+			stats.frames, stats.droppedFrames, stats.gaps, stats.moves, stats.droppedMoves,
+			(stats.fileBytes > 0 ? stats.rawBytes / stats.fileBytes : 0),
+			(stats.frames > 0 ? stats.encodeMs / stats.frames : 0), stats.fileBytes / (1 << 20) * 1000 / elapsed);
+	}
+
+	SessionReader::SessionReader() {
+		ZeroMemory(&header, sizeof(header));
+	}
+
+	SessionReader::~SessionReader() {
+		close();
+	}
+
+	bool SessionReader::readAt(long long offset, void* data, DWORD bytes) {
+		LARGE_INTEGER pos;
+		pos.QuadPart = offset;
+		DWORD read = 0;
+		if (!SetFilePointerEx(hFile, pos, NULL, FILE_BEGIN)) return false;
+		return ReadFile(hFile, data, bytes, &read, NULL) && read == bytes;
+	}
+
+	BOOL SessionReader::open(LPCTSTR path) {
+		close();
+		hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == INVALID_HANDLE_VALUE) return false;
+
+		if (!readAt(0, &header, sizeof(header)) || header.magic != sessionMagic || header.version < 1 || header.version > sessionVersion) {
+			close();
+			return false;
+		}
+
+		//The footer points at the index; without one the recording was cut short
+		LARGE_INTEGER size;
+		SessionFooter footer;
+		GetFileSizeEx(hFile, &size);
+		if (size.QuadPart >= (long long)(sizeof(header) + sizeof(footer)) &&
+			readAt(size.QuadPart - sizeof(footer), &footer, sizeof(footer)) && footer.magic == sessionFooterMagic
+			&& readIndex(footer)) {
+			return true;
+		}
+		return rebuildIndex();
+	}
+
+	//Follows the index chunks back from the footer, filling the index from the end. Version 1 has just one.
+	bool SessionReader::readIndex(const SessionFooter & footer) {
+		index.resize(footer.entries);
+		long long at = footer.indexOffset;
+		DWORD end = footer.entries;
+		SessionChunk chunk;
+
+		for (;;) {
+			if (!readAt(at, &chunk, sizeof(chunk)) || chunk.type != CHUNK_INDEX) return false;
+			DWORD n = chunk.bytes / sizeof(SessionIndexEntry);
+			if (n > end) return false;
+			if (n > 0 && !readAt(at + sizeof(chunk), index.data() + end - n, n * sizeof(SessionIndexEntry))) return false;
+			end -= n;
+
+			if (header.version < 2 || chunk.seq < 0) break;
+			if (chunk.seq >= at) return false;			//Chunks only link backwards
+			at = chunk.seq;
+		}
+		return end == 0;
+	}
+
+	//Walk the chunks, keeping every frame that made it to disk whole
+	bool SessionReader::rebuildIndex() {
+		LARGE_INTEGER size;
+		GetFileSizeEx(hFile, &size);
+		index.clear();
+
+		long long offset = sizeof(header);
+		SessionChunk chunk;
+		while (offset + (long long)sizeof(chunk) <= size.QuadPart && readAt(offset, &chunk, sizeof(chunk))) {
+			long long next = offset + sizeof(chunk) + chunk.bytes;
+			if (chunk.type < CHUNK_FRAME || chunk.type > CHUNK_INDEX || next > size.QuadPart) break;
+			if (chunk.type == CHUNK_FRAME) {
+				SessionIndexEntry entry = { offset, chunk.timeMs, chunk.seq };
+				index.push_back(entry);
+			}
+			offset = next;
+		}
+		return true;
+	}
+
+	void SessionReader::close() {
+		if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+		index.clear();
+	}
+
+	const SessionFileHeader & SessionReader::getHeader() const {
+		return header;
+	}
+
+	int SessionReader::frameCount() const {
+		return (int)index.size();
+	}
+
+	//Last frame captured at or before timeMs
+	int SessionReader::findFrame(double timeMs) const {
+		int lo = 0, hi = (int)index.size() - 1;
+		if (hi < 0 || timeMs < index[0].timeMs) return 0;
+		while (lo < hi) {
+			int mid = (lo + hi + 1) / 2;
+			if (index[mid].timeMs <= timeMs) lo = mid;
+			else hi = mid - 1;
+		}
+		return lo;
+	}
+
+	bool SessionReader::readFrame(int frame, unsigned char* pixels, double & timeMs) {
+		if (frame < 0 || frame >= (int)index.size()) return false;
+
+		SessionChunk chunk;
+		if (!readAt(index[frame].offset, &chunk, sizeof(chunk)) || chunk.type != CHUNK_FRAME) return false;
+		chunkData.resize(chunk.bytes);
+		if (!readAt(index[frame].offset + sizeof(chunk), chunkData.data(), chunk.bytes)) return false;
+
+		timeMs = chunk.timeMs;
+		return decodeFrame(chunkData.data(), chunk.bytes, pixels, header.width * header.height);
+	}
+
+	//Sensor samples recorded after this frame and before the next one. Any gap found is added into *gap.
+	int SessionReader::readMoves(int frame, SessionMove* out, int maxCount, SessionGap* gap) {
+		if (frame < 0 || frame >= (int)index.size()) return 0;
+
+		long long offset = index[frame].offset;
+		int count = 0;
+		SessionChunk chunk;
+		if (!readAt(offset, &chunk, sizeof(chunk))) return 0;
+		offset += sizeof(chunk) + chunk.bytes;
+
+		while (readAt(offset, &chunk, sizeof(chunk)) && chunk.type != CHUNK_FRAME && chunk.type != CHUNK_INDEX) {
+			if (chunk.type == CHUNK_MOVE) {
+				int n = min((int)(chunk.bytes / sizeof(SessionMove)), maxCount - count);
+				if (n > 0 && !readAt(offset + sizeof(chunk), out + count, n * sizeof(SessionMove))) break;
+				count += max(n, 0);
+			}
+			else if (chunk.type == CHUNK_GAP && gap != nullptr) {
+				SessionGap g;
+				if (readAt(offset + sizeof(chunk), &g, sizeof(g))) {
+					if (gap->frames == 0 && gap->moves == 0) gap->fromMs = g.fromMs;
+					gap->frames += g.frames;
+					gap->moves += g.moves;
+					gap->toMs = g.toMs;
+				}
+			}
+			offset += sizeof(chunk) + chunk.bytes;
+		}
+		return count;
+	}
+
+}
@@ -0,0 +1,191 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "SpscQueue.h"
+
+#include <vector>
+
+namespace movepoint {
+
+	//Default values
+	const int recordPool_d = 8;					//Frames waiting for the encoder. Capture drops frames, with a gap marker, once all are taken.
+	const int recordWriteBytes_d = 1 << 20;		//Encoded chunks collect in this buffer and go to disk in one write
+	const int recordMoveQueue_d = 1024;			//Sensor samples waiting to be written
+	const int recordMovesPerChunk = 256;
+	const int recordIndexBlock_d = 4096;		//Frame index entries held in memory before they are written out as one index chunk
+
+	const DWORD sessionMagic = 0x5253504D;		//'MPSR'
+	const DWORD sessionFooterMagic = 0x5849504D;	//'MPIX'
+	const DWORD sessionVersion = 2;				//1: a single index chunk at the end
+
+	enum sessionChunkType
+	{
+		CHUNK_FRAME = 1,			//FrameCodec data for one frame
+		CHUNK_GAP = 2,				//SessionGap: frames or samples the recorder had to drop
+		CHUNK_MOVE = 3,				//Array of SessionMove
+		CHUNK_INDEX = 4				//Array of SessionIndexEntry, one per frame chunk since the previous index chunk
+	};
+
+	/* File layout: SessionFileHeader, then chunks in time order, each a SessionChunk followed
+	by its data, then SessionFooter. An index chunk follows every recordIndexBlock_d frames
+	and one more comes last; each carries the offset of the one before in its seq (-1 for
+	the first), and the footer points at the last. A file cut short by a crash has no
+	footer; SessionReader then rebuilds the index by walking the chunks. */
+	struct SessionFileHeader
+	{
+		DWORD magic;
+		DWORD version;
+		int width, height;
+		long long startTime;		//FILETIME of timeMs 0, same clock base as the sensor samples
+	};
+
+	struct SessionChunk
+	{
+		DWORD type;
+		DWORD bytes;				//Data following this header
+		double timeMs;				//Since recording started
+		long long seq;				//Frame sequence number, or for an index chunk the previous index chunk's offset
+	};
+
+	struct SessionGap
+	{
+		long frames;
+		long moves;
+		double fromMs, toMs;
+	};
+
+	struct SessionMove
+	{
+		double timeMs;
+		int moveId;
+		Move::MoveData data;		//As the SDK delivered it, before any filtering
+	};
+
+	struct SessionIndexEntry
+	{
+		long long offset;			//Of the frame's SessionChunk
+		double timeMs;
+		long long seq;
+	};
+
+	struct SessionFooter
+	{
+		DWORD magic;
+		DWORD entries;				//In all index chunks together
+		long long indexOffset;		//Of the last index chunk
+	};
+
+	struct RecordStats
+	{
+		long frames;
+		long droppedFrames;
+		long droppedMoves;
+		long moves;
+		long gaps;
+		double rawBytes, fileBytes;
+		double encodeMs, writeMs;
+	};
+
+	/* Records the camera input and the sensor trace of a session to one file, to replay
+	tracking failures later. The camera pipeline's capture stage hands every frame to
+	captured(), which only copies it into a fixed pool; a writer thread encodes and writes
+	them. A slow disk therefore fills the pool and costs recorded
+	frames, never tracking time, and memory stays at the pool, one write buffer and one
+	block of index entries however long the session runs. pause() lets the camera go and
+	resume() carries on in the same file, so a locked screen does not split a session. */
+	class SessionRecorder
+	{
+		struct RecordFrame
+		{
+			unsigned char* pixels;
+			double timeMs;
+			long long seq;
+			long dropsBefore;				//Frames capture lost just before this one
+			double gapFromMs;
+		};
+
+		static const int poolSize = recordPool_d;
+		typedef SpscQueue<RecordFrame*, poolSize + 1> FrameQueue;
+
+		RecordFrame pool[poolSize];
+		FrameQueue freeQueue, writeQueue;
+		SpscQueue<SessionMove, recordMoveQueue_d> moveQueue;
+		volatile LONG droppedMoves = 0;
+		double moveGapFromMs = 0;
+
+		Move::IEyeController* eye = nullptr;
+		int width = 0, height = 0;
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+		HANDLE hWriter = NULL;
+		volatile LONG running = 0;
+		bool paused = false;
+		double startMs = 0, pausedMs = 0;
+
+		//Pipeline capture thread only
+		long long captureSeq = 0;
+		long captureDrops = 0;
+		double gapFromMs = 0;
+
+		unsigned char* encoded = NULL;
+		unsigned char* writeBuffer = NULL;
+		int writeUsed = 0;
+		long long fileOffset = 0;
+		std::vector<SessionIndexEntry> index;		//Since the last index chunk
+		long long lastIndexOffset = -1;
+		DWORD indexEntries = 0;					//Already written out
+
+		RecordStats stats;
+
+		static unsigned int __stdcall writerProc(void *p_thread_data);
+
+		void writeChunk(DWORD type, const void* data, DWORD bytes, double timeMs, long long seq);
+		void writeMoves();
+		void writeFrame(RecordFrame* frame);
+		void writeIndex();
+		void flush();
+		void startThreads();
+		void stopThreads();
+		void finish();
+
+	public:
+		SessionRecorder();
+		~SessionRecorder();
+
+		BOOL start(Move::IEyeController* inEye, LPCTSTR path);
+		void stop();
+		void pause();
+		BOOL resume(Move::IEyeController* inEye);
+		bool isRecording() const;
+		bool isPaused() const;
+		void captured(const unsigned char* pixels, double captureMs);
+		void recordMove(int moveId, const Move::MoveData & data);
+		const RecordStats & getStats() const;
+		void print() const;
+	};
+
+	//Reads a recorded session back, frame by frame or from a point in time
+	class SessionReader
+	{
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+		SessionFileHeader header;
+		std::vector<SessionIndexEntry> index;
+		std::vector<unsigned char> chunkData;
+
+		bool readAt(long long offset, void* data, DWORD bytes);
+		bool readIndex(const SessionFooter & footer);
+		bool rebuildIndex();
+
+	public:
+		SessionReader();
+		~SessionReader();
+
+		BOOL open(LPCTSTR path);
+		void close();
+		const SessionFileHeader & getHeader() const;
+		int frameCount() const;
+		int findFrame(double timeMs) const;
+		bool readFrame(int frame, unsigned char* pixels, double & timeMs);
+		int readMoves(int frame, SessionMove* out, int maxCount, SessionGap* gap = nullptr);
+	};
+
+}
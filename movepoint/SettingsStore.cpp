@@ -0,0 +1,303 @@
+#include "stdafx.h"
+#include "SettingsStore.h"
+#include "win_actions.h"
+#include "OutlierFilter.h"
+#include "TransferFunction.h"
+#include "ColorLut.h"
+
+#include <process.h>
+
+using namespace win_actions;
+
+namespace movepoint {
+
+	SettingsStore::SettingsStore() {
+		InitializeCriticalSection(&writeLock);
+		ZeroMemory(slots, sizeof(slots));
+		ZeroMemory((void*)refs, sizeof(refs));
+		ZeroMemory(&defaults, sizeof(defaults));
+		defaults.size = sizeof(Settings);
+		defaults.format = settingsFormat;
+		publish(defaults);
+	}
+
+	SettingsStore::~SettingsStore() {
+		stop();
+		DeleteCriticalSection(&writeLock);
+	}
+
+	void SettingsStore::setDefaults(const Settings & s) {
+		defaults = s;
+		defaults.size = sizeof(Settings);
+		defaults.format = settingsFormat;
+	}
+
+	const Settings & SettingsStore::getDefaults() const {
+		return defaults;
+	}
+
+	/* Any thread. Stays valid until release(). The pin is only good if the slot is still
+	current after taking it; otherwise publish() may already be reusing it, so try again. */
+	const Settings* SettingsStore::acquire() {
+		for (;;) {
+			Settings* s = current;
+			int i = (int)(s - slots);
+			InterlockedIncrement(&refs[i]);
+			if (s == current) return s;
+			InterlockedDecrement(&refs[i]);
+		}
+	}
+
+	void SettingsStore::release(const Settings* s) {
+		if (s != nullptr) InterlockedDecrement(&refs[s - slots]);
+	}
+
+	//Any thread. A private copy of the current snapshot.
+	void SettingsStore::copy(Settings & out) {
+		const Settings* s = acquire();
+		out = *s;
+		release(s);
+	}
+
+	//Any thread. Changes with every publish; cheaper than acquire() to notice one.
+	LONG SettingsStore::getSerial() const {
+		return serial;
+	}
+
+	//Any thread. Returns the serial of the new snapshot.
+	LONG SettingsStore::publish(const Settings & s) {
+		EnterCriticalSection(&writeLock);
+
+		//Neither current nor pinned. With a slot per reader to spare this never waits in practice.
+		Settings* slot = nullptr;
+		while (slot == nullptr) {
+			for (int i = 0; i < numSlots && slot == nullptr; i++) {
+				int k = (nextSlot + i) % numSlots;
+				if (&slots[k] != current && refs[k] == 0) {
+					slot = &slots[k];
+					nextSlot = (k + 1) % numSlots;
+				}
+			}
+			if (slot == nullptr) Sleep(0);
+		}
+		*slot = s;
+		sanitize(*slot);
+		slot->size = sizeof(Settings);
+		slot->format = settingsFormat;
+		slot->serial = ++serial;
+
+		InterlockedExchangePointer((PVOID volatile *)&current, slot);
+
+		LeaveCriticalSection(&writeLock);
+		return slot->serial;
+	}
+
+	//Values that would break the hot path fall back to their defaults
+	void SettingsStore::sanitize(Settings & s) const {
+		if (s.scrollPercent < 0.01) s.scrollPercent = defaults.scrollPercent;		//no negative value for scrollPercent
+		if (s.mouseThreshold <= 0) s.mouseThreshold = 0.000001f;
+		if (s.thresholdMax < s.thresholdMin) s.thresholdMax = s.thresholdMin;
+		if (s.prefilterMode < 0 || s.prefilterMode > OUTLIER_HAMPEL) s.prefilterMode = defaults.prefilterMode;
+		if (s.cursorProfile < 0 || s.cursorProfile > PROFILE_FAST) s.cursorProfile = defaults.cursorProfile;
+		if (s.colorLutBits < 0 || s.colorLutBits > lutBitsMax) s.colorLutBits = defaults.colorLutBits;
+		s.monitorWeights[sizeof(s.monitorWeights) - 1] = 0;
+		s.snapGrid[sizeof(s.snapGrid) - 1] = 0;
+	}
+
+	//System-wide settings first, then the current user's on top
+	LONG SettingsStore::load(Settings & out) {
+		out = defaults;
+		LONG system = readKey(HKEY_LOCAL_MACHINE, out);
+		LONG user = readKey(HKEY_CURRENT_USER, out);
+		systemSettings = (system == ERROR_SUCCESS);
+		sanitize(out);
+
+		printf("Read Settings: %d %d %.3f %.3f %.3f %.3f %d %.3f %.3f %.3f %.3f \n\n",
+			system, user,
+			out.scrollThreshold, out.appScrollThreshold, out.mouseThreshold, out.curPosWeight, out.moveDelay,
+			out.ctrlRegion.top, out.ctrlRegion.bottom, out.ctrlRegion.left, out.ctrlRegion.right);
+		return user;
+	}
+
+	LONG SettingsStore::readKey(HKEY root, Settings & out) {
+		HKEY hKey;
+		LONG retVal = RegOpenKeyEx(root, SETTINGS_KEY, 0, KEY_READ, &hKey);
+		if (retVal != ERROR_SUCCESS) return retVal;
+
+		//Only the fields this build knows about, over whatever is already in out
+		Settings blob;
+		DWORD sz = sizeof(blob);
+		DWORD type = 0;
+		retVal = RegQueryValueEx(hKey, SETTINGS_VALUE, 0, &type, (BYTE*)&blob, &sz);
+		if (retVal == ERROR_MORE_DATA) {
+			//Written by a newer build: read it whole and keep the part we know
+			BYTE* buffer = (BYTE*)malloc(sz);
+			retVal = RegQueryValueEx(hKey, SETTINGS_VALUE, 0, &type, buffer, &sz);
+			memcpy(&blob, buffer, sizeof(blob));
+			free(buffer);
+		}
+
+		if (retVal == ERROR_SUCCESS && type == REG_BINARY && sz >= 3 * sizeof(DWORD) && blob.size == sz && blob.format == settingsFormat) {
+			LONG keepSerial = out.serial;
+			memcpy(&out, &blob, min(sz, (DWORD)sizeof(Settings)));
+			out.serial = keepSerial;
+		}
+		else {
+			retVal = readLegacy(hKey, out);
+		}
+
+		RegCloseKey(hKey);
+		return retVal;
+	}
+
+	//One value per setting, as saved before the blob. Read once; the next save writes the blob.
+	LONG SettingsStore::readLegacy(HKEY hKey, Settings & out) {
+		LONG retVal2 = 5;
+		retVal2 = min(readFloatFromReg(hKey, TEXT("scrollPercent"), &out.scrollPercent), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("scrollThreshold"), &out.scrollThreshold), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("appScrollThreshold"), &out.appScrollThreshold), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("mouseThreshold"), &out.mouseThreshold), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("curPosWeight"), &out.curPosWeight), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionT"), &out.ctrlRegion.top), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionB"), &out.ctrlRegion.bottom), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionL"), &out.ctrlRegion.left), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("ctrlRegionR"), &out.ctrlRegion.right), retVal2);
+
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("moveDelay"), (DWORD*)&out.moveDelay), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("prefilterMode"), (DWORD*)&out.prefilterMode), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("cursorProfile"), (DWORD*)&out.cursorProfile), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("autoTune"), (DWORD*)&out.autoTune), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("eyePipeline"), (DWORD*)&out.eyePipelineOn), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("frameExport"), (DWORD*)&out.frameExportOn), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("recordSession"), (DWORD*)&out.recordSessionOn), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("colorPlanner"), (DWORD*)&out.colorPlannerOn), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("colorLutBits"), (DWORD*)&out.colorLutBits), retVal2);
+		retVal2 = min(readDWORDFromReg(hKey, TEXT("metricPosition"), (DWORD*)&out.metricPosition), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("camFocalX"), &out.camIntrinsics.fx), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("camFocalY"), &out.camIntrinsics.fy), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("camCenterX"), &out.camIntrinsics.cx), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("camCenterY"), &out.camIntrinsics.cy), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("camRadiusBias"), &out.camIntrinsics.radiusBias), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("mouseThresholdMin"), &out.thresholdMin), retVal2);
+		retVal2 = min(readFloatFromReg(hKey, TEXT("mouseThresholdMax"), &out.thresholdMax), retVal2);
+		retVal2 = min(readStringFromReg(hKey, TEXT("monitorWeights"), out.monitorWeights, sizeof(out.monitorWeights)), retVal2);
+		return retVal2;
+	}
+
+	LONG SettingsStore::writeKey(HKEY root, const Settings & s) {
+		HKEY hKey;
+		DWORD dwDisp;
+		LONG retVal1 = RegCreateKeyEx(root, SETTINGS_KEY, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL, &hKey, &dwDisp);
+		if (retVal1 != ERROR_SUCCESS) return retVal1;
+
+		LONG retVal2 = RegSetValueEx(hKey, SETTINGS_VALUE, 0, REG_BINARY, (const BYTE*)&s, sizeof(Settings));
+		LONG retVal3 = RegCloseKey(hKey);
+		return max(retVal2, retVal3);
+	}
+
+	//Asynchronous: the watcher thread writes whatever is current when it gets to it
+	void SettingsStore::save() {
+		if (hSave != NULL && hThread != NULL) SetEvent(hSave);
+		else saveNow();
+	}
+
+	//Any thread. The registry is read on the watch thread, as for an outside edit.
+	void SettingsStore::requestReload() {
+		if (hReload != NULL && hThread != NULL) SetEvent(hReload);
+		else reload();
+	}
+
+	LONG SettingsStore::saveNow() {
+		Settings s;
+		copy(s);
+		LONG retVal1 = ERROR_SUCCESS, retVal2;
+
+		//If system-wide settings does not exist, try writing to it
+		if (!systemSettings) retVal1 = writeKey(HKEY_LOCAL_MACHINE, s);
+		retVal2 = writeKey(HKEY_CURRENT_USER, s);
+
+		printf("Save Settings. Return value: %d %d \n\n", retVal1, retVal2);
+		return retVal2;
+	}
+
+	//Publish only if the registry now says something different, which our own saves never do
+	void SettingsStore::reload() {
+		Settings s;
+		ZeroMemory(&s, sizeof(s));
+		load(s);
+		sanitize(s);
+
+		Settings now;
+		copy(now);
+		s.serial = now.serial;
+		if (memcmp(&s, &now, sizeof(Settings)) == 0) return;
+
+		publish(s);
+		printf("Settings changed outside MOVEpoint, applying. \n");
+	}
+
+	BOOL SettingsStore::start() {
+		if (hThread != NULL) return true;
+
+		hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		hSave = CreateEvent(NULL, FALSE, FALSE, NULL);
+		hReload = CreateEvent(NULL, FALSE, FALSE, NULL);
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, watchProc, this, 0, &thread_id);
+		return hThread != NULL;
+	}
+
+	void SettingsStore::stop() {
+		if (hThread == NULL) return;
+
+		SetEvent(hStop);
+		WaitForSingleObject(hThread, INFINITE);			//A save or reload in progress completes
+		CloseHandle(hThread);
+		CloseHandle(hStop);
+		CloseHandle(hSave);
+		CloseHandle(hReload);
+		hThread = hStop = hSave = hReload = NULL;
+	}
+
+	unsigned int __stdcall SettingsStore::watchProc(void *p_thread_data) {
+		SettingsStore* self = static_cast<SettingsStore*>(p_thread_data);
+		HKEY hKey = NULL;
+		DWORD dwDisp;
+		HANDLE hChange = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+		if (RegCreateKeyEx(HKEY_CURRENT_USER, SETTINGS_KEY, 0, NULL, REG_OPTION_NON_VOLATILE, KEY_NOTIFY | KEY_READ, NULL, &hKey, &dwDisp) != ERROR_SUCCESS) {
+			hKey = NULL;
+		}
+
+		HANDLE events[4] = { self->hStop, self->hSave, hChange, self->hReload };
+		bool running = true;
+		while (running) {
+			//Notifications are one-shot, so arm again every time round
+			if (hKey != NULL) RegNotifyChangeKeyValue(hKey, FALSE, REG_NOTIFY_CHANGE_LAST_SET, hChange, TRUE);
+
+			switch (WaitForMultipleObjects(4, events, FALSE, INFINITE)) {
+			case WAIT_OBJECT_0:
+				running = false;
+				break;
+			case WAIT_OBJECT_0 + 1:
+				self->saveNow();
+				break;
+			case WAIT_OBJECT_0 + 2:
+				if (WaitForSingleObject(self->hStop, settingsDebounceMs_d) == WAIT_OBJECT_0) running = false;
+				else self->reload();
+				break;
+			case WAIT_OBJECT_0 + 3:
+				self->reload();
+				break;
+			default:
+				running = false;
+				break;
+			}
+		}
+
+		if (hKey != NULL) RegCloseKey(hKey);
+		CloseHandle(hChange);
+		return 0;
+	}
+
+}
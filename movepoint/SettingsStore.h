@@ -0,0 +1,101 @@
+#pragma once
+#include "stdafx.h"
+#include "movepoint.h"
+#include "EyeCalibration.h"
+
+namespace movepoint {
+
+	//Default values
+	const DWORD settingsFormat = 1;				//Layout of the saved blob. Fields are only ever appended.
+	const DWORD settingsDebounceMs_d = 100;		//Editors often write several values in a row; reload once they are done
+	#define SETTINGS_KEY TEXT("SOFTWARE\\MOVEpoint")
+	#define SETTINGS_VALUE TEXT("settings")
+
+	/* Everything the user can change, as one value. It is saved as a single binary registry
+	value, so a save or a load is one round trip and never half applied. A blob from an
+	older build is shorter; the fields it lacks keep their defaults. */
+	struct Settings
+	{
+		DWORD size;							//sizeof(Settings) of the build that wrote it
+		DWORD format;
+		LONG serial;						//Set on publish. Consumers compare it to notice a new snapshot.
+
+		float scrollPercent;
+		float scrollThreshold;
+		float appScrollThreshold;
+		float mouseThreshold;
+		float curPosWeight;
+		int moveDelay;
+		int prefilterMode;
+		int cursorProfile;
+		int autoTune;
+		float thresholdMin;
+		float thresholdMax;
+		int eyePipelineOn;
+		int frameExportOn;
+		int recordSessionOn;
+		int colorPlannerOn;
+		int colorLutBits;
+		int metricPosition;
+		EyeIntrinsics camIntrinsics;		//Entered or calibrated camera model. Zero = PS Eye defaults.
+		char monitorWeights[64];			//Per-monitor share of the control region, left to right. Empty = all 1.
+		RECTf ctrlRegion;
+		int dragSnap;
+		char snapGrid[16];					//halves, quarters, thirds or columns x rows such as "3x2"
+	};
+
+	/* Holds the current settings snapshot. Writers fill in a whole Settings and publish it
+	into a free slot, then swap the pointer. Readers pin the snapshot they use with
+	acquire() and let it go with release(); a pinned slot is never written, so a reader
+	may keep one across frames and threads and never sees a half written value.
+
+	A watcher thread re-reads the registry when the key is changed from outside and
+	publishes the result, and does the registry writes for save() so callers never wait. */
+	class SettingsStore
+	{
+		static const int numSlots = 8;			//Current, one pinned per long-lived reader, and spares
+
+		Settings slots[numSlots];
+		volatile LONG refs[numSlots];
+		Settings defaults;
+		int nextSlot = 0;
+		Settings* volatile current = nullptr;
+		volatile LONG serial = 0;
+		CRITICAL_SECTION writeLock;
+
+		HANDLE hThread = NULL;
+		HANDLE hStop = NULL;
+		HANDLE hSave = NULL;
+		HANDLE hReload = NULL;
+		bool systemSettings = false;			//HKLM already holds settings, so saves only go to HKCU
+
+		static unsigned int __stdcall watchProc(void *p_thread_data);
+
+		LONG readKey(HKEY root, Settings & out);
+		LONG readLegacy(HKEY hKey, Settings & out);
+		LONG writeKey(HKEY root, const Settings & s);
+		void reload();
+		void sanitize(Settings & s) const;
+
+	public:
+		SettingsStore();
+		~SettingsStore();
+
+		void setDefaults(const Settings & s);
+		const Settings & getDefaults() const;
+		const Settings* acquire();
+		void release(const Settings* s);
+		void copy(Settings & out);
+		LONG getSerial() const;
+		LONG publish(const Settings & s);
+
+		LONG load(Settings & out);
+		void save();
+		void requestReload();
+		LONG saveNow();
+
+		BOOL start();
+		void stop();
+	};
+
+}
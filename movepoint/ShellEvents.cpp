@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include "ShellEvents.h"
+
+#include <process.h>
+#include <Wtsapi32.h>
+
+namespace movepoint {
+
+	static const TCHAR shellClassName[] = TEXT("movepoint-shell-events");
+	static ShellEvents* hookOwner = nullptr;				//WinEvent callbacks carry no context
+
+	ShellEvents::~ShellEvents() {
+		stop();
+	}
+
+	BOOL ShellEvents::start(IShellListener* inListener) {
+		if (hThread != NULL) return true;
+
+		listener = inListener;
+		hReady = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		threadId = thread_id;
+
+		//Wait until the window exists so callers can rely on getWindow(). The thread signals
+		//whether or not the window could be created, so this cannot hang, and the event is
+		//never closed while the thread may still set it.
+		if (hThread != NULL) WaitForSingleObject(hReady, INFINITE);
+		CloseHandle(hReady);
+		hReady = NULL;
+
+		return hWnd != NULL;
+	}
+
+	void ShellEvents::stop() {
+		if (hThread == NULL) return;
+
+		PostThreadMessage(threadId, WM_QUIT, 0, 0);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		hThread = NULL;
+		hWnd = NULL;
+	}
+
+	HWND ShellEvents::getWindow() const {
+		return hWnd;
+	}
+
+	unsigned int __stdcall ShellEvents::threadProc(void *p_thread_data) {
+		ShellEvents* self = static_cast<ShellEvents*>(p_thread_data);
+
+		WNDCLASSEX wcex;
+		ZeroMemory(&wcex, sizeof(wcex));
+		wcex.cbSize = sizeof(WNDCLASSEX);
+		wcex.lpfnWndProc = wndProc;
+		wcex.hInstance = GetModuleHandle(NULL);
+		wcex.lpszClassName = shellClassName;
+		RegisterClassEx(&wcex);
+
+		//A real top-level window (never shown): message-only windows don't get broadcasts
+		self->hWnd = CreateWindow(shellClassName, shellClassName, WS_OVERLAPPED,
+			0, 0, 0, 0, NULL, NULL, wcex.hInstance, NULL);
+		if (self->hWnd != NULL) {
+			SetWindowLongPtr(self->hWnd, GWLP_USERDATA, (LONG_PTR)self);
+			WTSRegisterSessionNotification(self->hWnd, NOTIFY_FOR_THIS_SESSION);
+		}
+		SetEvent(self->hReady);
+
+		//Out of context, so the callback runs here from the message loop below
+		hookOwner = self;
+		self->hForegroundHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL, foregroundProc, 0, 0,
+			WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+		self->hDestroyHook = SetWinEventHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_DESTROY, NULL, destroyProc, 0, 0,
+			WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+		if (self->listener != nullptr) self->listener->foregroundChanged(GetForegroundWindow());
+
+		MSG msg;
+		while (GetMessage(&msg, NULL, 0, 0) > 0) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+
+		if (self->hForegroundHook != NULL) UnhookWinEvent(self->hForegroundHook);
+		self->hForegroundHook = NULL;
+		if (self->hDestroyHook != NULL) UnhookWinEvent(self->hDestroyHook);
+		self->hDestroyHook = NULL;
+		hookOwner = nullptr;
+		if (self->hWnd != NULL) {
+			WTSUnRegisterSessionNotification(self->hWnd);
+			DestroyWindow(self->hWnd);
+		}
+		return 0;
+	}
+
+	LRESULT CALLBACK ShellEvents::wndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
+		ShellEvents* self = (ShellEvents*)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+
+		switch (message)
+		{
+		case WM_DISPLAYCHANGE:
+			if (self != NULL && self->listener != nullptr) self->listener->displayChanged();
+			break;
+		case WM_SETTINGCHANGE:
+			//Taskbar moved or resized
+			if (wParam == SPI_SETWORKAREA && self != NULL && self->listener != nullptr) self->listener->displayChanged();
+			break;
+		case WM_WTSSESSION_CHANGE:
+			if (self == NULL || self->listener == nullptr) break;
+			if (wParam == WTS_SESSION_LOCK || wParam == WTS_CONSOLE_DISCONNECT) self->listener->sessionChanged(SESSION_LOCK);
+			else if (wParam == WTS_SESSION_UNLOCK || wParam == WTS_CONSOLE_CONNECT) self->listener->sessionChanged(SESSION_UNLOCK);
+			break;
+		case WM_POWERBROADCAST:
+			if (self == NULL || self->listener == nullptr) break;
+			if (wParam == PBT_APMSUSPEND) self->listener->sessionChanged(SESSION_SUSPEND);
+			else if (wParam == PBT_APMRESUMEAUTOMATIC) self->listener->sessionChanged(SESSION_RESUME);
+			break;
+		case WM_ENDSESSION:
+			if (wParam == TRUE && self != NULL && self->listener != nullptr) self->listener->sessionChanged(SESSION_END);
+			break;
+		case WM_CLOSE:
+			//Not DefWindowProc: the window has to outlive the request
+			if (self != NULL && self->listener != nullptr) self->listener->sessionChanged(SESSION_CLOSE);
+			return 0;
+		}
+		return DefWindowProc(hWnd, message, wParam, lParam);
+	}
+
+	void CALLBACK ShellEvents::foregroundProc(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD time) {
+		if (idObject != OBJID_WINDOW || hookOwner == nullptr || hookOwner->listener == nullptr) return;
+		hookOwner->listener->foregroundChanged(hWnd);
+	}
+
+	//Windows only, not the caret, scroll bars or other objects inside them
+	void CALLBACK ShellEvents::destroyProc(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD time) {
+		if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF || hookOwner == nullptr || hookOwner->listener == nullptr) return;
+		hookOwner->listener->windowDestroyed(hWnd);
+	}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	enum sessionEvent
+	{
+		SESSION_LOCK = 0,
+		SESSION_UNLOCK = 1,
+		SESSION_SUSPEND = 2,
+		SESSION_RESUME = 3,
+		SESSION_END = 4,						//Logoff or shutdown
+		SESSION_CLOSE = 5						//Asked to close, e.g. by MovePointBase
+	};
+
+	//Receives notifications on the shell event thread. Default implementations do nothing.
+	class IShellListener
+	{
+	public:
+		virtual void displayChanged() {}
+		virtual void foregroundChanged(HWND hWnd) {}
+		virtual void windowDestroyed(HWND hWnd) {}
+		virtual void sessionChanged(sessionEvent event) {}
+	};
+
+	/* Background thread owning a hidden top-level window, so the console process can
+	receive broadcast messages (display changes, work area changes, power and session
+	changes) without a UI. The same thread's message loop also delivers foreground window
+	changes and window destruction from WinEvent hooks. */
+	class ShellEvents
+	{
+		HWND hWnd = NULL;
+		HWINEVENTHOOK hForegroundHook = NULL;
+		HWINEVENTHOOK hDestroyHook = NULL;
+		HANDLE hThread = NULL;
+		HANDLE hReady = NULL;
+		DWORD threadId = 0;
+		IShellListener* listener = nullptr;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+		static LRESULT CALLBACK wndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+		static void CALLBACK foregroundProc(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD time);
+		static void CALLBACK destroyProc(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD time);
+
+	public:
+		~ShellEvents();
+		BOOL start(IShellListener* inListener);
+		void stop();
+		HWND getWindow() const;
+	};
+
+}
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "SnapLayout.h"
+
+namespace movepoint {
+
+	SnapLayout::SnapLayout() {
+		ZeroMemory(&zone, sizeof(zone));
+		ZeroMemory(&restoreRect, sizeof(restoreRect));
+	}
+
+	void SnapLayout::init(const DisplayTopology* inDisplay, DragEngine* inExecutor) {
+		display = inDisplay;
+		executor = inExecutor;
+	}
+
+	//Returns false and keeps the current grid if the spec cannot be read
+	bool SnapLayout::setGrid(const char* spec) {
+		int c = 0, r = 0;
+		if (_stricmp(spec, "halves") == 0) c = 2, r = 1;
+		else if (_stricmp(spec, "quarters") == 0) c = 2, r = 2;
+		else if (_stricmp(spec, "thirds") == 0) c = 3, r = 1;
+		else if (sscanf(spec, "%dx%d", &c, &r) != 2) return false;
+
+		if (c < 1 || r < 1 || c > maxSnapCells || r > maxSnapCells) return false;
+		if (c != cols || r != rows) target = NULL;			//Zones of the old grid mean nothing now
+		cols = c;
+		rows = r;
+		return true;
+	}
+
+	//Monitor and cell under a point. Monitors are few, the cell is one division per axis.
+	bool SnapLayout::zoneAt(const Topology* topo, POINT p, int & monitor, int & col, int & row) const {
+		for (int i = 0; i < topo->numMonitors; i++) {
+			const RECT & wa = topo->monitors[i].workArea;
+			if (p.x < wa.left || p.x >= wa.right || p.y < wa.top || p.y >= wa.bottom) continue;
+			monitor = i;
+			col = (p.x - wa.left) * cols / max(wa.right - wa.left, (LONG)1);
+			row = (p.y - wa.top) * rows / max(wa.bottom - wa.top, (LONG)1);
+			return true;
+		}
+		return false;
+	}
+
+	RECT SnapLayout::zoneRect(const Topology* topo, const SnapZone & z) const {
+		const RECT & wa = topo->monitors[z.monitor].workArea;
+		LONG w = wa.right - wa.left, h = wa.bottom - wa.top;
+		RECT r;
+		r.left = wa.left + w * z.c0 / cols;
+		r.right = wa.left + w * z.c1 / cols;
+		r.top = wa.top + h * z.r0 / rows;
+		r.bottom = wa.top + h * z.r1 / rows;
+		return r;
+	}
+
+	/* Carry on from the last snap if this is the same window and it is still where we put
+	it. Otherwise it was moved, maximized or is a different window: start from scratch. */
+	void SnapLayout::follow(HWND hWnd, const Topology* topo) {
+		RECT wr;
+		GetWindowRect(hWnd, &wr);
+		POINT centre = { (wr.left + wr.right) / 2, (wr.top + wr.bottom) / 2 };
+		int m = 0, col = 0, row = 0;
+		bool inside = zoneAt(topo, centre, m, col, row);
+
+		if (hWnd == target && topo->version == topologyVersion) {
+			if (state == STATE_MAXIMIZED && IsZoomed(hWnd)) return;
+			if (state == STATE_ZONE && inside && m == zone.monitor && col >= zone.c0 && col < zone.c1 && row >= zone.r0 && row < zone.r1) return;
+		}
+
+		target = hWnd;
+		topologyVersion = topo->version;
+		zone.monitor = (inside ? m : 0);
+		zone.c0 = col;
+		zone.c1 = col + 1;
+		zone.r0 = 0;
+		zone.r1 = rows;
+
+		if (IsZoomed(hWnd)) {
+			state = STATE_MAXIMIZED;
+			WINDOWPLACEMENT wp;
+			wp.length = sizeof(wp);
+			GetWindowPlacement(hWnd, &wp);
+			restoreRect = wp.rcNormalPosition;
+		}
+		else {
+			state = STATE_FLOATING;
+			restoreRect = wr;
+		}
+	}
+
+	//Sensor thread. keyCode is the gesture direction as a VK_ arrow.
+	bool SnapLayout::snap(HWND hWnd, int keyCode) {
+		if (display == nullptr) return false;
+		const Topology* topo = display->acquire();
+		bool handled = snapIn(topo, hWnd, keyCode);
+		display->release(topo);
+		return handled;
+	}
+
+	bool SnapLayout::snapIn(const Topology* topo, HWND hWnd, int keyCode) {
+		if (hWnd == NULL || executor == nullptr || topo == nullptr || topo->numMonitors == 0) return false;
+
+		follow(hWnd, topo);
+
+		bool fullHeight = (zone.r0 == 0 && zone.r1 == rows);
+		placeAction action = PLACE_RECT;
+
+		switch (keyCode) {
+		case VK_LEFT:
+			if (state != STATE_ZONE) {
+				zone.c0 = 0;
+				zone.r0 = 0;
+				zone.r1 = rows;
+			}
+			else if (zone.c0 > 0) {
+				zone.c0--;
+			}
+			else if (zone.monitor > 0) {
+				zone.monitor--;
+				zone.c0 = cols - 1;
+			}
+			else return true;							//Already at the far left
+			zone.c1 = zone.c0 + 1;
+			state = STATE_ZONE;
+			break;
+
+		case VK_RIGHT:
+			if (state != STATE_ZONE) {
+				zone.c0 = cols - 1;
+				zone.r0 = 0;
+				zone.r1 = rows;
+			}
+			else if (zone.c0 < cols - 1) {
+				zone.c0++;
+			}
+			else if (zone.monitor < topo->numMonitors - 1) {
+				zone.monitor++;
+				zone.c0 = 0;
+			}
+			else return true;
+			zone.c1 = zone.c0 + 1;
+			state = STATE_ZONE;
+			break;
+
+		case VK_UP:
+			if (state == STATE_ZONE && fullHeight && rows > 1) {
+				zone.r1 = 1;							//Top row of the same column
+			}
+			else if (state == STATE_ZONE && zone.r0 > 0) {
+				zone.r0 = 0;							//Lower row grows to full height
+				zone.r1 = rows;
+			}
+			else {
+				if (state == STATE_MAXIMIZED) return true;
+				action = PLACE_MAXIMIZE;
+				state = STATE_MAXIMIZED;
+			}
+			break;
+
+		case VK_DOWN:
+			if (state == STATE_ZONE && fullHeight && rows > 1) {
+				zone.r0 = rows - 1;						//Bottom row of the same column
+			}
+			else if (state == STATE_ZONE && zone.r1 < rows) {
+				zone.r0 = 0;							//Upper row grows to full height
+				zone.r1 = rows;
+			}
+			else if (state == STATE_FLOATING) {
+				action = PLACE_MINIMIZE;
+				target = NULL;
+			}
+			else if (state == STATE_MAXIMIZED) {
+				action = PLACE_RESTORE;
+				state = STATE_FLOATING;
+			}
+			else {
+				//Back to where the window was before the first snap
+				executor->place(hWnd, PLACE_OUTER, restoreRect);
+				state = STATE_FLOATING;
+				return true;
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+		RECT r = zoneRect(topo, zone);
+		executor->place(hWnd, action, r);
+		return true;
+	}
+
+	void SnapLayout::print() const {
+		printf("SNAP grid:%dx%d  state:%d  zone:%d %d-%d %d-%d\n", cols, rows, state, zone.monitor, zone.c0, zone.c1, zone.r0, zone.r1);
+	}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "stdafx.h"
+#include "DisplayTopology.h"
+#include "DragEngine.h"
+
+namespace movepoint {
+
+	//Default values
+	#define SNAP_GRID_D "halves"				//halves, quarters, thirds, or columns x rows such as "3x2"
+	const int maxSnapCells = 8;					//Per axis
+
+	//Columns c0..c1 and rows r0..r1 (exclusive) of one monitor's work area
+	struct SnapZone
+	{
+		int monitor;
+		int c0, c1;
+		int r0, r1;
+	};
+
+	/* Snaps windows to zones of each monitor's work area without going through the shell.
+	The work area is cut into a grid, and each snap gesture moves the window one step:
+	left and right walk across columns and on to the next monitor, up and down span or
+	split rows and finally maximize, restore or minimize, much like Win+Arrow does.
+
+	The rectangle is computed here from the cached topology and handed to the drag
+	engine's thread, which applies it with one SetWindowPos, so neither focus nor
+	keystroke timing decides where the window ends up. Finding the zone a window is in
+	is a division per axis. */
+	class SnapLayout
+	{
+		enum snapState
+		{
+			STATE_FLOATING = 0,
+			STATE_ZONE = 1,
+			STATE_MAXIMIZED = 2
+		};
+
+		const DisplayTopology* display = nullptr;
+		DragEngine* executor = nullptr;
+		int cols = 2, rows = 1;
+
+		//The window of the current gesture
+		HWND target = NULL;
+		long topologyVersion = -1;
+		snapState state = STATE_FLOATING;
+		SnapZone zone;
+		RECT restoreRect;
+
+		bool zoneAt(const Topology* topo, POINT p, int & monitor, int & col, int & row) const;
+		RECT zoneRect(const Topology* topo, const SnapZone & z) const;
+		void follow(HWND hWnd, const Topology* topo);
+		bool snapIn(const Topology* topo, HWND hWnd, int keyCode);
+
+	public:
+		SnapLayout();
+		void init(const DisplayTopology* inDisplay, DragEngine* inExecutor);
+		bool setGrid(const char* spec);
+		bool snap(HWND hWnd, int keyCode);
+		void print() const;
+	};
+
+}
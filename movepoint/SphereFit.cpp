@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "SphereFit.h"
+
+#include <ppl.h>
+
+namespace movepoint {
+
+	unsigned int SphereFit::nextRandom() {
+		seed = seed * 1664525 + 1013904223;
+		return seed >> 8;
+	}
+
+	//Boundary points of one band of rows: horizontal edges within its rows, vertical edges to the row above.
+	//The set side of an edge must be at least two pixels deep, so isolated specks of noise give no points.
+	void SphereFit::extractBand(const unsigned char* mask, int width, const EyeRect & roi, int top, int bottom, std::vector<FitPoint> & out) {
+		out.clear();
+		for (int y = top; y < bottom; y++) {
+			const unsigned char* row = mask + y * width;
+			const unsigned char* above = row - width;
+
+			for (int x = roi.left + 1; x < roi.right; x++) {
+				bool rising = row[x] != 0 && row[x - 1] == 0 && x + 1 < roi.right && row[x + 1] != 0;
+				bool falling = row[x] == 0 && row[x - 1] != 0 && x - 2 >= roi.left && row[x - 2] != 0;
+				if (rising || falling) {
+					FitPoint p = { x - 0.5f, (float)y };
+					out.push_back(p);
+				}
+			}
+			if (y == roi.top) continue;
+			for (int x = roi.left; x < roi.right; x++) {
+				bool rising = row[x] != 0 && above[x] == 0 && y + 1 < roi.bottom && row[x + width] != 0;
+				bool falling = row[x] == 0 && above[x] != 0 && y - 2 >= roi.top && above[x - width] != 0;
+				if (rising || falling) {
+					FitPoint p = { (float)x, y - 0.5f };
+					out.push_back(p);
+				}
+			}
+		}
+	}
+
+	SphereFitResult SphereFit::fit(const unsigned char* mask, int width, int height, const EyeRect & roi) {
+		EyeRect r;
+		r.left = max(roi.left, 0);
+		r.top = max(roi.top, 0);
+		r.right = min(roi.right, width);
+		r.bottom = min(roi.bottom, height);
+
+		points.clear();
+		int rows = r.bottom - r.top;
+		if (mask == NULL || rows <= 0 || r.right <= r.left) return fitPoints(NULL, 0);
+
+		int bands = max(min(rows / max(bandRows, 1), maxBands), 1);
+		if (bands == 1) {
+			extractBand(mask, width, r, r.top, r.bottom, points);
+		}
+		else {
+			concurrency::parallel_for(0, bands, [&](int b) {
+				int top = r.top + rows * b / bands;
+				int bottom = r.top + rows * (b + 1) / bands;
+				extractBand(mask, width, r, top, bottom, bandPoints[b]);
+			});
+			for (int b = 0; b < bands; b++) points.insert(points.end(), bandPoints[b].begin(), bandPoints[b].end());
+		}
+
+		return fitPoints(points.data(), (int)points.size());
+	}
+
+	SphereFitResult SphereFit::fitPoints(const FitPoint * pts, int count) {
+		SphereFitResult result;
+		ZeroMemory(&result, sizeof(result));
+		result.points = count;
+		if (count < max(minPoints, 3)) return result;
+
+		//RANSAC: keep the candidate circle through three contour points with the most support
+		float bestX = 0, bestY = 0, bestR = 0;
+		int bestCount = 0;
+		for (int it = 0; it < iterations; it++) {
+			const FitPoint & a = pts[nextRandom() % count];
+			const FitPoint & b = pts[nextRandom() % count];
+			const FitPoint & c = pts[nextRandom() % count];
+			float cx, cy, cr;
+			if (!circleFrom3(a, b, c, cx, cy, cr)) continue;
+
+			int support = 0;
+			for (int i = 0; i < count; i++) {
+				float dx = pts[i].x - cx, dy = pts[i].y - cy;
+				if (fabs(sqrt(dx * dx + dy * dy) - cr) < tolerance) support++;
+			}
+			if (support > bestCount) {
+				bestCount = support;
+				bestX = cx;
+				bestY = cy;
+				bestR = cr;
+			}
+		}
+
+		//Without a consensus (e.g. very few points) fall back to fitting everything
+		inliers.clear();
+		for (int i = 0; i < count; i++) {
+			float dx = pts[i].x - bestX, dy = pts[i].y - bestY;
+			if (bestCount == 0 || fabs(sqrt(dx * dx + dy * dy) - bestR) < tolerance) inliers.push_back(pts[i]);
+		}
+		if ((int)inliers.size() < 3) return result;
+
+		if (!kasaFit(inliers.data(), (int)inliers.size(), result.x, result.y, result.radius)) return result;
+
+		//Residual and angular coverage of the refined circle
+		const int sectors = 16;
+		bool covered[sectors] = { false };
+		double sumSq = 0;
+		for (size_t i = 0; i < inliers.size(); i++) {
+			float dx = inliers[i].x - result.x, dy = inliers[i].y - result.y;
+			float d = sqrt(dx * dx + dy * dy) - result.radius;
+			sumSq += d * d;
+			int s = (int)((atan2(dy, dx) + Move::PI) / (2 * Move::PI) * sectors);
+			covered[min(max(s, 0), sectors - 1)] = true;
+		}
+		int coverage = 0;
+		for (int s = 0; s < sectors; s++) {
+			if (covered[s]) coverage++;
+		}
+
+		result.valid = true;
+		result.inliers = (int)inliers.size();
+		result.rms = (float)sqrt(sumSq / inliers.size());
+		result.quality = ((float)result.inliers / count) * ((float)coverage / sectors) * (1 - 0.5f * min(result.rms / tolerance, 1.0f));
+		return result;
+	}
+
+	const std::vector<FitPoint> & SphereFit::getContour() const {
+		return points;
+	}
+
+	//Algebraic least squares: minimize sum (x^2 + y^2 + a x + b y + c)^2, in coordinates centred on the mean
+	bool SphereFit::kasaFit(const FitPoint * pts, int count, float & x, float & y, float & radius) {
+		if (count < 3) return false;
+
+		double mx = 0, my = 0;
+		for (int i = 0; i < count; i++) {
+			mx += pts[i].x;
+			my += pts[i].y;
+		}
+		mx /= count;
+		my /= count;
+
+		double suu = 0, suv = 0, svv = 0, suz = 0, svz = 0, sz = 0;
+		for (int i = 0; i < count; i++) {
+			double u = pts[i].x - mx, v = pts[i].y - my;
+			double z = u * u + v * v;
+			suu += u * u;
+			suv += u * v;
+			svv += v * v;
+			suz += u * z;
+			svz += v * z;
+			sz += z;
+		}
+
+		//With centred coordinates the constant term decouples: c = -sz / n
+		double det = suu * svv - suv * suv;
+		if (fabs(det) < 1e-9) return false;
+		double a = (-suz * svv + svz * suv) / det;
+		double b = (-svz * suu + suz * suv) / det;
+		double c = -sz / count;
+
+		double r2 = (a * a + b * b) / 4 - c;
+		if (r2 <= 0) return false;
+
+		x = (float)(mx - a / 2);
+		y = (float)(my - b / 2);
+		radius = (float)sqrt(r2);
+		return true;
+	}
+
+	bool SphereFit::circleFrom3(const FitPoint & a, const FitPoint & b, const FitPoint & c, float & x, float & y, float & radius) {
+		float bx = b.x - a.x, by = b.y - a.y;
+		float cx = c.x - a.x, cy = c.y - a.y;
+		float d = 2 * (bx * cy - by * cx);
+		if (fabs(d) < 1e-3f) return false;		//Collinear or repeated points
+
+		float b2 = bx * bx + by * by, c2 = cx * cx + cy * cy;
+		float ux = (cy * b2 - by * c2) / d;
+		float uy = (bx * c2 - cx * b2) / d;
+
+		x = a.x + ux;
+		y = a.y + uy;
+		radius = sqrt(ux * ux + uy * uy);
+		return true;
+	}
+
+}
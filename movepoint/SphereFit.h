@@ -0,0 +1,59 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+
+#include <vector>
+
+namespace movepoint {
+
+	//Default values
+	const int fitIterations_d = 64;			//RANSAC samples per fit
+	const float fitTolerance_d = 1.0f;		//Contour points further than this (pixels) from a candidate circle are outliers
+	const int fitMinPoints_d = 12;			//Fewer contour points than this gives no fit
+	const int fitBandRows_d = 32;			//Rows per parallel band. Windows with fewer rows run on the calling thread.
+
+	struct FitPoint
+	{
+		float x, y;
+	};
+
+	struct SphereFitResult
+	{
+		bool valid;
+		float x, y, radius;					//Sub-pixel image-space circle
+		float rms;							//Residual of the inliers in pixels
+		float quality;						//0..1 from inlier share, contour coverage and residual
+		int points, inliers;
+	};
+
+	/* Localizes a sphere in a segmentation mask. Contour points are taken halfway between
+	set and unset neighbours, extracted in parallel row bands, then a circle is fitted by
+	algebraic (Kasa) least squares on the consensus set of a RANSAC search. Occluded or
+	clipped parts of the sphere simply produce no contour points. */
+	class SphereFit
+	{
+		static const int maxBands = 8;
+
+		std::vector<FitPoint> bandPoints[maxBands];		//Reused between frames
+		std::vector<FitPoint> points;
+		std::vector<FitPoint> inliers;
+		unsigned int seed = 1;
+
+		void extractBand(const unsigned char* mask, int width, const EyeRect & roi, int top, int bottom, std::vector<FitPoint> & out);
+		unsigned int nextRandom();
+
+	public:
+		int iterations = fitIterations_d;
+		float tolerance = fitTolerance_d;
+		int minPoints = fitMinPoints_d;
+		int bandRows = fitBandRows_d;
+
+		SphereFitResult fit(const unsigned char* mask, int width, int height, const EyeRect & roi);
+		SphereFitResult fitPoints(const FitPoint * pts, int count);
+		const std::vector<FitPoint> & getContour() const;
+
+		static bool kasaFit(const FitPoint * pts, int count, float & x, float & y, float & radius);
+		static bool circleFrom3(const FitPoint & a, const FitPoint & b, const FitPoint & c, float & x, float & y, float & radius);
+	};
+
+}
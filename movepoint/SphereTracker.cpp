@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include "SphereTracker.h"
+
+namespace movepoint {
+
+	SphereTracker::SphereTracker() {
+		reset();
+	}
+
+	void SphereTracker::reset() {
+		ZeroMemory(tracks, sizeof(tracks));
+		ZeroMemory(&stats, sizeof(stats));
+		for (int i = 0; i < maxEyeControllers; i++) tracks[i].missed = lostFrames + 1;		//Search on the first frame
+	}
+
+	//Window around where the sphere should be this frame
+	void SphereTracker::predictRoi(SphereTrack & t, int width, int height) {
+		float px = t.x + t.vx * (t.missed + 1);
+		float py = t.y + t.vy * (t.missed + 1);
+		float half = t.radius * roiScale + roiMargin + max(fabs(t.vx), fabs(t.vy)) * (t.missed + 1);
+
+		t.roi.left = max((int)(px - half), 0);
+		t.roi.top = max((int)(py - half), 0);
+		t.roi.right = min((int)(px + half) + 1, width);
+		t.roi.bottom = min((int)(py + half) + 1, height);
+	}
+
+	//Centroid and size of the mask pixels inside the window
+	bool SphereTracker::measure(const unsigned char* mask, int width, const EyeRect & roi, int rowStep, SphereTrack & t) {
+		int count = 0;
+		long long sumX = 0, sumY = 0;
+		int minX = width, maxX = -1;
+
+		for (int y = roi.top; y < roi.bottom; y += rowStep) {
+			const unsigned char* row = mask + y * width;
+			for (int x = roi.left; x < roi.right; x++) {
+				if (row[x] == 0) continue;
+				count++;
+				sumX += x;
+				sumY += y;
+				if (x < minX) minX = x;
+				if (x > maxX) maxX = x;
+			}
+		}
+
+		t.pixels = count * rowStep;
+		if (t.pixels < minSpherePixels) return false;
+
+		float x = (float)sumX / count;
+		float y = (float)sumY / count;
+
+		//On full rows the area gives the radius; on sparse rows only the widest row can be trusted
+		float radius = (rowStep == 1 ? sqrt(count / Move::PI) : (maxX - minX + 1) * 0.5f);
+
+		if (t.found || t.missed <= lostFrames) {
+			int frames = t.missed + 1;
+			t.vx = velocityWeight_d * (x - t.x) / frames + (1 - velocityWeight_d) * t.vx;
+			t.vy = velocityWeight_d * (y - t.y) / frames + (1 - velocityWeight_d) * t.vy;
+		}
+		else {
+			t.vx = 0;
+			t.vy = 0;
+		}
+
+		t.x = x;
+		t.y = y;
+		t.radius = radius;
+		return true;
+	}
+
+	void SphereTracker::update(EyeSegmenter & segmenter, const unsigned char* frame) {
+		int width = segmenter.getWidth();
+		int height = segmenter.getHeight();
+		if (frame == NULL || width == 0) return;
+
+		unsigned int search = 0;
+		int active = 0;
+
+		for (int i = 0; i < maxEyeControllers; i++) {
+			SphereTrack & t = tracks[i];
+			if (!segmenter.hasTarget(i)) {
+				ZeroMemory(&t, sizeof(t));
+				t.missed = lostFrames + 1;
+				continue;
+			}
+			active++;
+
+			if (t.missed > lostFrames) {
+				search |= 1 << i;
+				continue;
+			}
+
+			predictRoi(t, width, height);
+			t.coarse = false;
+			segmenter.segment(frame, t.roi, 1 << i);
+			stats.segmentedPixels += (double)(t.roi.right - t.roi.left) * (t.roi.bottom - t.roi.top);
+
+			if (measure(segmenter.getMaskBuffer(i), width, t.roi, 1, t)) {
+				t.found = true;
+				t.missed = 0;
+			}
+			else {
+				t.found = false;
+				if (++t.missed > lostFrames) search |= 1 << i;
+			}
+		}
+
+		//One pass over sparse rows serves every lost controller
+		if (search != 0) {
+			EyeRect full = { 0, 0, width, height };
+			segmenter.segment(frame, full, search, coarseStep);
+			stats.searches++;
+
+			for (int i = 0; i < maxEyeControllers; i++) {
+				if ((search & (1 << i)) == 0) continue;
+				SphereTrack & t = tracks[i];
+				stats.segmentedPixels += (double)width * ((height + coarseStep - 1) / coarseStep);
+
+				t.roi = full;
+				t.coarse = true;
+				if (measure(segmenter.getMaskBuffer(i), width, full, coarseStep, t)) {
+					t.found = true;
+					t.missed = 0;
+				}
+			}
+		}
+
+		stats.frames++;
+		stats.fullFramePixels += (double)width * height * active;
+	}
+
+	const SphereTrack & SphereTracker::getTrack(int moveId) const {
+		return tracks[moveId];
+	}
+
+	const TrackerStats & SphereTracker::getStats() const {
+		return stats;
+	}
+
+	float SphereTracker::workload() const {
+		return (stats.fullFramePixels > 0 ? (float)(stats.segmentedPixels / stats.fullFramePixels) : 1);
+	}
+
+	void SphereTracker::print() const {
+		printf("SPHERES frames:%ld  searches:%ld  workload:%.1f%% of full frame\n",
+			stats.frames, stats.searches, workload() * 100);
+		for (int i = 0; i < maxEyeControllers; i++) {
+			const SphereTrack & t = tracks[i];
+			if (t.roi.right == 0) continue;
+			printf("  %d: %s  pos:%.1f %.1f  r:%.1f  v:%.1f %.1f  window:%dx%d\n", i, (t.found ? "found" : "lost "),
+				t.x, t.y, t.radius, t.vx, t.vy, t.roi.right - t.roi.left, t.roi.bottom - t.roi.top);
+		}
+	}
+
+}
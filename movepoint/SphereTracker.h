@@ -0,0 +1,62 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+#include "EyeSegmenter.h"
+
+namespace movepoint {
+
+	//Default values
+	const float roiScale_d = 2;				//Half size of the search window in sphere radii
+	const int roiMargin_d = 8;				//Extra pixels around the window, on top of one frame of motion
+	const int minSpherePixels_d = 12;		//Fewer mask pixels than this in the window means the sphere is gone
+	const int lostFrames_d = 2;				//Frames the window coasts on the last velocity before a full frame search
+	const int coarseStep_d = 4;				//Row step of the full frame search
+	const float velocityWeight_d = 0.5;		//Weight of the newest measurement in the image-space velocity
+
+	struct SphereTrack
+	{
+		bool found;
+		bool coarse;						//Found by the full frame search. Only every coarseStep-th mask row is valid.
+		int missed;							//Frames since the sphere was last seen
+		float x, y, radius;					//Image-space centre and radius in pixels
+		float vx, vy;						//Pixels per frame
+		EyeRect roi;						//Window segmented this frame. Masks are only valid inside it. Empty without a target colour.
+		int pixels;							//Mask pixels found in the window
+	};
+
+	struct TrackerStats
+	{
+		long frames;
+		long searches;						//Full frame searches
+		double segmentedPixels;				//Pixel classifications, summed over controllers
+		double fullFramePixels;				//What segmenting every frame for every controller would have cost
+	};
+
+	/* Follows each controller's sphere in image space. Only a window around the predicted
+	position is segmented, sized by the sphere radius and its speed; a sphere that stays
+	missing for a few frames is searched for on every few rows of the full frame. */
+	class SphereTracker
+	{
+		SphereTrack tracks[maxEyeControllers];
+		TrackerStats stats;
+
+		void predictRoi(SphereTrack & t, int width, int height);
+		bool measure(const unsigned char* mask, int width, const EyeRect & roi, int rowStep, SphereTrack & t);
+
+	public:
+		float roiScale = roiScale_d;
+		int roiMargin = roiMargin_d;
+		int minSpherePixels = minSpherePixels_d;
+		int lostFrames = lostFrames_d;
+		int coarseStep = coarseStep_d;
+
+		SphereTracker();
+		void update(EyeSegmenter & segmenter, const unsigned char* frame);
+		const SphereTrack & getTrack(int moveId) const;
+		const TrackerStats & getStats() const;
+		float workload() const;				//Segmented pixels as a fraction of full frame segmentation
+		void reset();
+		void print() const;
+	};
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	/* Bounded single-producer single-consumer ring. Each index is written by one side only
+	and published with an interlocked store, so neither side ever takes a lock. An auto-reset
+	event lets an idle consumer sleep instead of spinning. */
+	template <typename T, int capacity>
+	class SpscQueue
+	{
+		T items[capacity];
+		volatile LONG head = 0;					//Next slot to read, consumer owned
+		volatile LONG tail = 0;					//Next slot to write, producer owned
+		HANDLE hSignal = NULL;
+
+	public:
+		SpscQueue() {
+			hSignal = CreateEvent(NULL, FALSE, FALSE, NULL);
+		}
+
+		~SpscQueue() {
+			if (hSignal != NULL) CloseHandle(hSignal);
+		}
+
+		//Producer side. Returns false when full.
+		bool push(const T & item) {
+			LONG t = tail;
+			LONG next = (t + 1) % capacity;
+			if (next == head) return false;
+
+			items[t] = item;
+			InterlockedExchange(&tail, next);
+			SetEvent(hSignal);
+			return true;
+		}
+
+		//Consumer side. Returns false when empty.
+		bool pop(T & item) {
+			LONG h = head;
+			if (h == tail) return false;
+
+			item = items[h];
+			InterlockedExchange(&head, (h + 1) % capacity);
+			return true;
+		}
+
+		//Consumer side. Looks at the next item without taking it.
+		bool peek(T & item) const {
+			LONG h = head;
+			if (h == tail) return false;
+
+			item = items[h];
+			return true;
+		}
+
+		//Consumer side. Waits up to timeoutMs for an item.
+		bool wait(T & item, DWORD timeoutMs) {
+			if (pop(item)) return true;
+			WaitForSingleObject(hSignal, timeoutMs);
+			return pop(item);
+		}
+
+		//Approximate from either side
+		int size() const {
+			return (tail - head + capacity) % capacity;
+		}
+
+		//Wake a waiting consumer, e.g. on shutdown
+		void wake() {
+			SetEvent(hSignal);
+		}
+	};
+
+}
@@ -0,0 +1,260 @@
+#include "stdafx.h"
+#include "SyntheticEye.h"
+#include "MoveColors.h"
+
+namespace movepoint {
+
+	static inline unsigned int hashRandom(unsigned int x) {
+		x ^= x >> 16;
+		x *= 0x7feb352d;
+		x ^= x >> 15;
+		x *= 0x846ca68b;
+		x ^= x >> 16;
+		return x;
+	}
+
+	static inline unsigned char clampByte(float v) {
+		return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v + 0.5f));
+	}
+
+	static void sphereAt(const SyntheticSphere & s, float time, float & x, float & y, float & radius) {
+		x = s.cx + s.ax * sin(2 * Move::PI * s.fx * time + s.px);
+		y = s.cy + s.ay * sin(2 * Move::PI * s.fy * time + s.py);
+		radius = s.radius + s.radiusAmp * sin(2 * Move::PI * s.radiusFreq * time);
+	}
+
+	SyntheticEye::SyntheticEye(int inWidth, int inHeight) {
+		width = inWidth;
+		height = inHeight;
+		frame = (unsigned char*)_aligned_malloc(width * height * eyeBytesPerPixel, 32);
+		background = (unsigned char*)_aligned_malloc(width * height * eyeBytesPerPixel, 32);
+		for (int i = 0; i < maxEyeControllers; i++) {
+			truthMasks[i] = (unsigned char*)_aligned_malloc(width * height, 32);
+			ZeroMemory(truthMasks[i], width * height);
+		}
+		ZeroMemory(truth, sizeof(truth));
+	}
+
+	SyntheticEye::~SyntheticEye() {
+		_aligned_free(frame);
+		_aligned_free(background);
+		for (int i = 0; i < maxEyeControllers; i++) _aligned_free(truthMasks[i]);
+	}
+
+	int SyntheticEye::addSphere(const SyntheticSphere & sphere) {
+		if ((int)spheres.size() >= maxEyeControllers) return -1;
+		spheres.push_back(sphere);
+		return (int)spheres.size() - 1;
+	}
+
+	void SyntheticEye::addBox(const SyntheticBox & box) {
+		boxes.push_back(box);
+		backgroundDirty = true;
+	}
+
+	void SyntheticEye::setHue(int moveId, float hue) {
+		int r, g, b;
+		hueToRgb(hue, r, g, b);
+		setColor(moveId, r, g, b);
+	}
+
+	//Two spheres, one leaving the frame part of the time, a passing occluder and two distractors
+	void SyntheticEye::loadDefaultScene() {
+		spheres.clear();
+		boxes.clear();
+
+		SyntheticSphere a = { 250, 20, 240, 0.05f * width, 0.5f * width, 0.5f * height, 0.35f * width, 0.3f * height, 0.2f, 0.33f, 0, 0, 0.4f * 0.05f * width, 0.11f };
+		SyntheticSphere b = { 10, 220, 230, 0.035f * width, 0.5f * width, 0.5f * height, 0.6f * width, 0.25f * height, 0.14f, 0.27f, 1.5f, 0.5f, 0, 0 };
+		addSphere(a);
+		addSphere(b);
+
+		SyntheticBox distractor1 = { 0.05f * width, 0.1f * height, 0.12f * width, 0.1f * height, 0, 0, 230, 120, 40, false };		//Orange poster
+		SyntheticBox distractor2 = { 0.8f * width, 0.7f * height, 0.1f * width, 0.2f * height, 0, 0, 40, 90, 200, false };			//Blue lamp
+		SyntheticBox occluder = { 0, 0.35f * height, 0.04f * width, 0.3f * height, 0.004f * width, 0, 90, 80, 70, true };			//Passing arm
+		addBox(distractor1);
+		addBox(distractor2);
+		addBox(occluder);
+	}
+
+	int SyntheticEye::getSphereCount() const {
+		return (int)spheres.size();
+	}
+
+	SyntheticTruth SyntheticEye::truthAt(long long n, int moveId) const {
+		SyntheticTruth t;
+		ZeroMemory(&t, sizeof(t));
+		if (moveId < 0 || moveId >= (int)spheres.size()) return t;
+
+		sphereAt(spheres[moveId], n / fps, t.x, t.y, t.radius);
+		t.visible = 1;
+		return t;
+	}
+
+	const SyntheticTruth & SyntheticEye::getTruth(int moveId) const {
+		return truth[moveId];
+	}
+
+	long long SyntheticEye::getFrameIndex() const {
+		return frameIndex;
+	}
+
+	//The next getEyeBuffer call renders frame n
+	void SyntheticEye::seek(long long n) {
+		frameIndex = n - 1;
+	}
+
+	//Dim room with a vertical gradient and some texture, plus the static parts of the scene
+	void SyntheticEye::renderBackground() {
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				unsigned char* px = background + (y * width + x) * eyeBytesPerPixel;
+				unsigned int h = hashRandom(seed * 7919 + (x >> 3) * 131 + (y >> 3) * 65537);
+				float shade = 50 + 40.0f * y / height + (h & 15);
+				px[0] = clampByte(shade * 0.9f);
+				px[1] = clampByte(shade * 0.95f);
+				px[2] = clampByte(shade * 1.1f);
+				px[3] = 255;
+			}
+		}
+		backgroundDirty = false;
+	}
+
+	void SyntheticEye::renderBox(const SyntheticBox & box, long long n) {
+		float x = box.x + box.vx * n;
+		float y = box.y + box.vy * n;
+		if (box.vx != 0) x = fmod(fmod(x, (float)width + box.w) + width + box.w, (float)width + box.w) - box.w;
+		if (box.vy != 0) y = fmod(fmod(y, (float)height + box.h) + height + box.h, (float)height + box.h) - box.h;
+
+		int left = max((int)x, 0), right = min((int)(x + box.w), width);
+		int top = max((int)y, 0), bottom = min((int)(y + box.h), height);
+		for (int py = top; py < bottom; py++) {
+			for (int px = left; px < right; px++) {
+				unsigned char* p = frame + (py * width + px) * eyeBytesPerPixel;
+				p[0] = (unsigned char)box.b;
+				p[1] = (unsigned char)box.g;
+				p[2] = (unsigned char)box.r;
+				if (!box.occluder) continue;
+				for (int i = 0; i < (int)spheres.size(); i++) truthMasks[i][py * width + px] = 0;
+			}
+		}
+	}
+
+	//Glowing sphere: brighter core, soft falloff, smeared over the exposure
+	void SyntheticEye::renderSphere(int id, long long n) {
+		const SyntheticSphere & s = spheres[id];
+		const int maxSteps = 16;
+		float sx[maxSteps], sy[maxSteps], sr[maxSteps];
+		int steps = max(min(blurSteps, maxSteps), 1);
+
+		float minX = 1e9f, maxX = -1e9f, minY = 1e9f, maxY = -1e9f;
+		for (int k = 0; k < steps; k++) {
+			float offset = (steps > 1 ? exposure * ((float)k / (steps - 1) - 0.5f) : 0);
+			sphereAt(s, (n + offset) / fps, sx[k], sy[k], sr[k]);
+			minX = min(minX, sx[k] - sr[k]);
+			maxX = max(maxX, sx[k] + sr[k]);
+			minY = min(minY, sy[k] - sr[k]);
+			maxY = max(maxY, sy[k] + sr[k]);
+		}
+
+		truth[id] = truthAt(n, id);
+		unsigned char* mask = truthMasks[id];
+		ZeroMemory(mask, width * height);
+
+		int left = max((int)minX, 0), right = min((int)maxX + 2, width);
+		int top = max((int)minY, 0), bottom = min((int)maxY + 2, height);
+		for (int y = top; y < bottom; y++) {
+			for (int x = left; x < right; x++) {
+				int inside = 0;
+				float depth = 0;
+				for (int k = 0; k < steps; k++) {
+					float dx = x - sx[k], dy = y - sy[k];
+					float d2 = (dx * dx + dy * dy) / (sr[k] * sr[k]);
+					if (d2 < 1) {
+						inside++;
+						depth += sqrt(1 - d2);
+					}
+				}
+				float dx = x - truth[id].x, dy = y - truth[id].y;
+				if (dx * dx + dy * dy < truth[id].radius * truth[id].radius) mask[y * width + x] = 255;
+				if (inside == 0) continue;
+
+				float cover = (float)inside / steps;
+				float glow = 0.7f + 0.3f * depth / inside;
+				unsigned char* p = frame + (y * width + x) * eyeBytesPerPixel;
+				p[0] = clampByte(p[0] * (1 - cover) + s.b * glow * cover);
+				p[1] = clampByte(p[1] * (1 - cover) + s.g * glow * cover);
+				p[2] = clampByte(p[2] * (1 - cover) + s.r * glow * cover);
+			}
+		}
+	}
+
+	void SyntheticEye::addNoise(long long n) {
+		if (noise <= 0) return;
+
+		unsigned int frameSeed = hashRandom(seed ^ (unsigned int)(n * 2654435761u));
+		int count = width * height;
+		for (int p = 0; p < count; p++) {
+			unsigned int h = hashRandom(frameSeed + p);
+			unsigned char* px = frame + p * eyeBytesPerPixel;
+			for (int c = 0; c < 3; c++) {
+				//Sum of two uniforms, roughly Gaussian with unit deviation
+				int sum = (int)((h >> (c * 8)) & 255) + (int)((h >> ((c * 8 + 4) % 32)) & 255);
+				float u = (sum - 255) / 104.0f;
+				px[c] = clampByte(px[c] + u * noise);
+			}
+		}
+	}
+
+	unsigned char* SyntheticEye::getEyeBuffer() {
+		long long n = ++frameIndex;
+		if (backgroundDirty) renderBackground();
+		memcpy(frame, background, width * height * eyeBytesPerPixel);
+
+		for (size_t i = 0; i < boxes.size(); i++) {
+			if (!boxes[i].occluder) renderBox(boxes[i], n);
+		}
+		for (int i = 0; i < (int)spheres.size(); i++) renderSphere(i, n);
+		for (size_t i = 0; i < boxes.size(); i++) {
+			if (boxes[i].occluder) renderBox(boxes[i], n);
+		}
+		addNoise(n);
+
+		//Visible share of each disc, after clipping and occlusion
+		for (int i = 0; i < (int)spheres.size(); i++) {
+			int count = 0;
+			for (int p = 0; p < width * height; p++) {
+				if (truthMasks[i][p] != 0) count++;
+			}
+			float area = Move::PI * truth[i].radius * truth[i].radius;
+			truth[i].visible = (area > 0 ? min(count / area, 1.0f) : 0);
+		}
+		return frame;
+	}
+
+	unsigned char* SyntheticEye::getMaskBuffer(int moveId) {
+		if (moveId < 0 || moveId >= maxEyeControllers) return NULL;
+		return truthMasks[moveId];
+	}
+
+	void SyntheticEye::getEyeDimensions(int &x, int &y) {
+		x = width;
+		y = height;
+	}
+
+	//Evenly spaced hues, the way the SDK spreads controller colours
+	void SyntheticEye::useAutomaticColors(bool use) {
+		if (!use) return;
+		for (int i = 0; i < (int)spheres.size(); i++) setHue(i, 300 - 120.0f * i);
+	}
+
+	void SyntheticEye::setColor(int moveId, int r, int g, int b) {
+		if (moveId < 0 || moveId >= (int)spheres.size()) return;
+		spheres[moveId].r = r;
+		spheres[moveId].g = g;
+		spheres[moveId].b = b;
+	}
+
+	void SyntheticEye::resetPosition(int moveId) {
+	}
+
+}
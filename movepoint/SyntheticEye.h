@@ -0,0 +1,95 @@
+#pragma once
+#include "stdafx.h"
+#include "EyeFrame.h"
+
+#include <vector>
+
+namespace movepoint {
+
+	//Default values
+	const int synthWidth_d = 640;
+	const int synthHeight_d = 480;
+	const float synthFps_d = 60;
+	const float synthNoise_d = 4;				//Sensor noise standard deviation in 8-bit levels
+	const float synthExposure_d = 0.5f;			//Exposure as a fraction of the frame interval, for motion blur
+	const int synthBlurSteps_d = 6;				//Sphere positions sampled over the exposure
+
+	//Sphere moving on a Lissajous path: centre + amplitude * sin(2 pi freq t + phase)
+	struct SyntheticSphere
+	{
+		int r, g, b;
+		float radius;
+		float cx, cy, ax, ay;				//Pixels
+		float fx, fy;						//Hz
+		float px, py;						//Radians
+		float radiusAmp, radiusFreq;		//Depth motion as a change of radius
+	};
+
+	//Flat coloured rectangle moving at a constant speed, wrapping around the frame
+	struct SyntheticBox
+	{
+		float x, y, w, h;
+		float vx, vy;						//Pixels per frame
+		int r, g, b;
+		bool occluder;						//Drawn over the spheres instead of under them
+	};
+
+	struct SyntheticTruth
+	{
+		float x, y, radius;
+		float visible;						//Share of the sphere's disc visible in the frame, 0..1
+	};
+
+	/* Deterministic stand-in for the PS Eye. Every getEyeBuffer call renders the next BGRA
+	frame: a textured background with distractor boxes, shaded glowing spheres with
+	motion blur, occluders and sensor noise. Frame n always looks the same for the same
+	settings and seed, and ground truth for each sphere is available per frame. */
+	class SyntheticEye : public Move::IEyeController
+	{
+		int width, height;
+		unsigned char* frame = NULL;
+		unsigned char* background = NULL;
+		unsigned char* truthMasks[maxEyeControllers];
+		SyntheticTruth truth[maxEyeControllers];
+		long long frameIndex = -1;
+		bool backgroundDirty = true;
+
+		std::vector<SyntheticSphere> spheres;
+		std::vector<SyntheticBox> boxes;
+
+		void renderBackground();
+		void renderBox(const SyntheticBox & box, long long n);
+		void renderSphere(int id, long long n);
+		void addNoise(long long n);
+
+	public:
+		unsigned int seed = 1;
+		float fps = synthFps_d;
+		float noise = synthNoise_d;
+		float exposure = synthExposure_d;
+		int blurSteps = synthBlurSteps_d;
+
+		SyntheticEye(int inWidth = synthWidth_d, int inHeight = synthHeight_d);
+		~SyntheticEye();
+
+		int addSphere(const SyntheticSphere & sphere);
+		void addBox(const SyntheticBox & box);
+		void setHue(int moveId, float hue);
+		void loadDefaultScene();
+		int getSphereCount() const;
+
+		SyntheticTruth truthAt(long long n, int moveId) const;		//Centre and radius only
+		const SyntheticTruth & getTruth(int moveId) const;			//Last rendered frame, including visibility
+		long long getFrameIndex() const;
+		void seek(long long n);
+
+		//IEyeController
+		unsigned char* getEyeBuffer();
+		unsigned char* getMaskBuffer(int moveId);					//Ground-truth sphere mask of the last frame
+		void getEyeDimensions(int &x, int &y);
+		void useAutomaticColors(bool use);
+		void setColor(int moveId, int r, int g, int b);
+		void resetPosition(int moveId);
+	};
+
+}
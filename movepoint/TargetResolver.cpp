@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include "TargetResolver.h"
+
+#include <process.h>
+
+namespace movepoint {
+
+	static TargetResolver* hookOwner = nullptr;				//WinEvent callbacks carry no context
+
+	TargetResolver::~TargetResolver() {
+		stop();
+	}
+
+	BOOL TargetResolver::start() {
+		if (hThread != NULL) return true;
+
+		hReady = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		threadId = thread_id;
+
+		//The first lookup is done before start returns, so get() is valid straight away
+		if (hThread != NULL) WaitForSingleObject(hReady, INFINITE);
+		CloseHandle(hReady);
+		hReady = NULL;
+
+		return hThread != NULL;
+	}
+
+	void TargetResolver::stop() {
+		if (hThread == NULL) return;
+
+		PostThreadMessage(threadId, WM_QUIT, 0, 0);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		hThread = NULL;
+		target = NULL;
+	}
+
+	unsigned int __stdcall TargetResolver::threadProc(void *p_thread_data) {
+		TargetResolver* self = static_cast<TargetResolver*>(p_thread_data);
+
+		//Out of context, so the callbacks run here from the message loop below
+		hookOwner = self;
+		self->hooks[0] = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL, eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+		self->hooks[1] = SetWinEventHook(EVENT_SYSTEM_MOVESIZEEND, EVENT_SYSTEM_MOVESIZEEND, NULL, eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+		self->hooks[2] = SetWinEventHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, NULL, eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+		self->hooks[3] = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_FOCUS, NULL, eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+		self->hooks[4] = SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, NULL, eventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+
+		UINT_PTR timer = SetTimer(NULL, 0, targetPollMs_d, NULL);
+		self->poll();
+		SetEvent(self->hReady);
+
+		MSG msg;
+		while (GetMessage(&msg, NULL, 0, 0) > 0) {
+			if (msg.message == WM_TIMER && msg.hwnd == NULL) {
+				self->poll();
+				continue;
+			}
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+
+		KillTimer(NULL, timer);
+		for (int i = 0; i < numHooks; i++) {
+			if (self->hooks[i] != NULL) UnhookWinEvent(self->hooks[i]);
+			self->hooks[i] = NULL;
+		}
+		hookOwner = nullptr;
+		return 0;
+	}
+
+	void CALLBACK TargetResolver::eventProc(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD time) {
+		if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF || hookOwner == nullptr) return;
+		hookOwner->windowEvent(event, hWnd);
+	}
+
+	//Events only mark the cache; the lookup waits for the next poll, so a burst of them costs one walk
+	void TargetResolver::windowEvent(DWORD event, HWND hWnd) {
+		if (event == EVENT_OBJECT_REORDER) return;				//Z order inside a window, fires constantly
+		if (event == EVENT_OBJECT_LOCATIONCHANGE && GetAncestor(hWnd, GA_ROOT) != hWnd) return;	//Child windows scroll and animate all the time
+		eventCount++;
+		dirty = true;
+
+		if (hWnd == target && (event == EVENT_OBJECT_DESTROY || event == EVENT_OBJECT_HIDE || event == EVENT_SYSTEM_MINIMIZESTART)) {
+			InterlockedExchangePointer((PVOID volatile *)&target, NULL);
+		}
+	}
+
+	void TargetResolver::poll() {
+		POINT pos;
+		if (!GetPhysicalCursorPos(&pos)) return;
+
+		if (!dirty && abs(pos.x - lastPos.x) < targetMoveThreshold_d && abs(pos.y - lastPos.y) < targetMoveThreshold_d) {
+			skipCount++;
+			return;
+		}
+
+		//RealChildWindowFromPoint gives us the best guess as to which window is relevant
+		HWND hWnd = RealChildWindowFromPoint(GetDesktopWindow(), pos);
+		LONG s = seq;
+		InterlockedExchange(&seq, s + 1);
+		InterlockedExchangePointer((PVOID volatile *)&target, hWnd);
+		lastPos = pos;
+		InterlockedExchange(&seq, s + 2);
+		dirty = false;
+		resolveCount++;
+	}
+
+	//Any thread. NULL if the lookup is out of date or was made too far from pos; the caller then looks up itself.
+	HWND TargetResolver::get(POINT pos) const {
+		for (int tries = 0; tries < 4; tries++) {
+			LONG before = seq;
+			if (before & 1) continue;
+			HWND hWnd = target;
+			POINT at = lastPos;
+			MemoryBarrier();
+			if (seq != before) continue;
+
+			if (dirty || abs(pos.x - at.x) >= targetMoveThreshold_d || abs(pos.y - at.y) >= targetMoveThreshold_d) return NULL;
+			return hWnd;
+		}
+		return NULL;
+	}
+
+	void TargetResolver::print() const {
+		printf("TARGET hwnd:%p  lookups:%lu  skipped polls:%lu  window events:%lu\n", (void*)target, resolveCount, skipCount, eventCount);
+	}
+
+}
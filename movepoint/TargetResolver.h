@@ -0,0 +1,51 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	//Default values
+	const UINT targetPollMs_d = 15;				//How often the cursor position is checked
+	const LONG targetMoveThreshold_d = 8;		//Pixels the cursor must travel before the window under it is looked up again
+
+	/* Keeps the window under the cursor up to date on a background thread, so button
+	handlers read one cached handle instead of walking the window tree. The lookup is
+	repeated when the cursor has moved far enough, or when a window is created, destroyed,
+	shown, hidden, minimized, moved or takes the focus. If the cached window goes away it
+	is dropped at once. get() only hands out a lookup that is clean and was made near the
+	given cursor position, so a caller never acts on a window the cursor has left. */
+	class TargetResolver
+	{
+		static const int numHooks = 5;
+
+		HANDLE hThread = NULL;
+		HANDLE hReady = NULL;
+		DWORD threadId = 0;
+		HWINEVENTHOOK hooks[numHooks];
+
+		//Written by the resolver thread behind a sequence lock: odd while target and lastPos change
+		volatile LONG seq = 0;
+		HWND volatile target = NULL;
+		POINT lastPos;							//Where the cached target was looked up
+		volatile bool dirty = true;
+
+		//Resolver thread only
+		unsigned long resolveCount = 0;
+		unsigned long skipCount = 0;
+		unsigned long eventCount = 0;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+		static void CALLBACK eventProc(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD time);
+
+		void poll();
+		void windowEvent(DWORD event, HWND hWnd);
+
+	public:
+		~TargetResolver();
+		BOOL start();
+		void stop();
+		inline bool isRunning() const { return hThread != NULL; }
+		HWND get(POINT pos) const;
+		void print() const;
+	};
+
+}
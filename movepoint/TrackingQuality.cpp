@@ -0,0 +1,146 @@
+#include "stdafx.h"
+#include "TrackingQuality.h"
+
+namespace movepoint {
+
+	TrackingQuality::TrackingQuality() {
+		reset();
+	}
+
+	void TrackingQuality::reset() {
+		hasHistory = false;
+		lost = false;
+		frozenFrames = 0;
+		consistentFrames = 0;
+		residualVar = 1;
+		ZeroMemory(&metrics, sizeof(metrics));
+	}
+
+	trackingState TrackingQuality::update(Move::MoveData data, ULARGE_INTEGER cur_FT) {
+
+		Move::Vec3 pos = data.position;
+
+		if (!hasHistory) {
+			lastPos = pos;
+			candidatePos = pos;
+			velocity = Move::Vec3::ZERO;
+			last_FT = cur_FT;
+			hasHistory = true;
+			return TRACKING_OK;
+		}
+
+		//MoveManager repeats the last position when it cannot see the sphere
+		if (pos.x == candidatePos.x && pos.y == candidatePos.y && pos.z == candidatePos.z) {
+			frozenFrames++;
+		}
+		else {
+			frozenFrames = 0;
+		}
+
+		//A partly occluded or blurred sphere gives a poor fit and a biased position
+		LONG poorFitFrames = poorFits;
+
+		float limit = max(jumpThreshold, jumpSigmas * residualSigma());
+
+		if (!lost) {
+			float dt = (float)(cur_FT.QuadPart - last_FT.QuadPart) / 10000000;		//FILETIME is in 100ns units
+			Move::Vec3 predicted(lastPos.x + velocity.x * dt, lastPos.y + velocity.y * dt, lastPos.z + velocity.z * dt);	//The SDK exports no Vec3 operators
+			float residual = pos.distance(predicted);
+
+			candidatePos = pos;
+
+			if (frozenFrames >= freezeFrames) {
+				beginDropout(cur_FT);
+				return TRACKING_LOST;
+			}
+			if (poorFitFrames >= freezeFrames) {
+				metrics.poorFitCount++;
+				beginDropout(cur_FT);
+				return TRACKING_LOST;
+			}
+			if (residual > limit) {
+				metrics.jumpCount++;
+				beginDropout(cur_FT);
+				return TRACKING_LOST;
+			}
+
+			//Good frame: update residual statistics and the velocity estimate
+			residualVar = 0.95f * residualVar + 0.05f * residual * residual;
+			if (dt > 0 && frozenFrames == 0) {
+				velocity.x = 0.5f * (pos.x - lastPos.x) / dt + 0.5f * velocity.x;
+				velocity.y = 0.5f * (pos.y - lastPos.y) / dt + 0.5f * velocity.y;
+				velocity.z = 0.5f * (pos.z - lastPos.z) / dt + 0.5f * velocity.z;
+			}
+			lastPos = pos;
+			last_FT = cur_FT;
+			return TRACKING_OK;
+		}
+
+		//While lost, wait for a few frames that move smoothly before trusting the camera again
+		if (frozenFrames == 0 && poorFitFrames == 0 && pos.distance(candidatePos) < limit) {
+			consistentFrames++;
+		}
+		else {
+			consistentFrames = 0;
+		}
+		candidatePos = pos;
+
+		if (consistentFrames >= reacquireFrames) {
+			endDropout(cur_FT);
+			lastPos = pos;
+			velocity = Move::Vec3::ZERO;
+			last_FT = cur_FT;
+			return TRACKING_REACQUIRED;
+		}
+		return TRACKING_LOST;
+	}
+
+	bool TrackingQuality::isLost() const {
+		return lost;
+	}
+
+	float TrackingQuality::residualSigma() const {
+		return sqrt(residualVar);
+	}
+
+	//Camera thread, once per camera fit: quality score of the latest sphere fit
+	void TrackingQuality::setFitQuality(float quality) {
+		fitQuality = quality;
+		InterlockedExchange(&poorFits, (quality < minFitQuality ? poorFits + 1 : 0));
+	}
+
+	//The camera pipeline stopped: no fit is no evidence either way
+	void TrackingQuality::clearFitQuality() {
+		fitQuality = 1;
+		InterlockedExchange(&poorFits, 0);
+	}
+
+	float TrackingQuality::getFitQuality() const {
+		return fitQuality;
+	}
+
+	//Hand speed in the screen plane, in position units per second
+	float TrackingQuality::speed() const {
+		return sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+	}
+
+	const TrackingMetrics & TrackingQuality::getMetrics() const {
+		return metrics;
+	}
+
+	void TrackingQuality::beginDropout(ULARGE_INTEGER cur_FT) {
+		lost = true;
+		consistentFrames = 0;
+		lost_FT = cur_FT;
+		metrics.dropoutCount++;
+	}
+
+	void TrackingQuality::endDropout(ULARGE_INTEGER cur_FT) {
+		lost = false;
+		frozenFrames = 0;
+		metrics.lastDropoutMs = (double)(cur_FT.QuadPart - lost_FT.QuadPart) / 10000;
+		metrics.totalDropoutMs += metrics.lastDropoutMs;
+		if (metrics.lastDropoutMs > metrics.longestDropoutMs) metrics.longestDropoutMs = metrics.lastDropoutMs;
+	}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	//Default values
+	const float jumpThreshold_d = 8;			//Minimum residual (position units) that counts as an implausible jump
+	const float jumpSigmas_d = 6;				//Residuals beyond this many standard deviations count as a jump
+	const int freezeFrames_d = 4;				//Identical positions in a row before the sphere is considered lost
+	const int reacquireFrames_d = 3;			//Consistent frames required before optical tracking is trusted again
+	const float minFitQuality_d = 0.3f;			//Sphere fits scoring below this (SphereFit quality) count as bad fits
+
+	enum trackingState
+	{
+		TRACKING_OK = 0,
+		TRACKING_LOST = 1,
+		TRACKING_REACQUIRED = 2				//Returned once on the frame optical tracking comes back
+	};
+
+	struct TrackingMetrics
+	{
+		unsigned long dropoutCount;
+		unsigned long jumpCount;
+		unsigned long poorFitCount;
+		double lastDropoutMs;
+		double longestDropoutMs;
+		double totalDropoutMs;
+	};
+
+	/* Estimates the quality of optical tracking from position residuals against a
+	constant-velocity prediction. A dropout is declared when the position freezes
+	(sphere out of view or occluded), jumps further than the prediction allows, or
+	the image-space sphere fit stays poor for several camera frames in a row. One per
+	controller. */
+	class TrackingQuality
+	{
+		bool hasHistory = false;
+		bool lost = false;
+		int frozenFrames = 0;
+		int consistentFrames = 0;
+		volatile float fitQuality = 1;			//Written by the camera pipeline, 1 when there is none
+		volatile LONG poorFits = 0;				//Consecutive poor fits, counted per camera fit rather than per sensor frame
+
+		Move::Vec3 lastPos, velocity, candidatePos;
+		float residualVar = 1;
+		ULARGE_INTEGER last_FT, lost_FT;
+
+		TrackingMetrics metrics;
+
+	public:
+		float jumpThreshold = jumpThreshold_d;
+		float jumpSigmas = jumpSigmas_d;
+		int freezeFrames = freezeFrames_d;
+		int reacquireFrames = reacquireFrames_d;
+		float minFitQuality = minFitQuality_d;
+
+		TrackingQuality();
+		trackingState update(Move::MoveData data, ULARGE_INTEGER cur_FT);
+		bool isLost() const;
+		float residualSigma() const;
+		void setFitQuality(float quality);
+		void clearFitQuality();
+		float getFitQuality() const;
+		float speed() const;
+		const TrackingMetrics & getMetrics() const;
+		void reset();
+
+	private:
+		void beginDropout(ULARGE_INTEGER cur_FT);
+		void endDropout(ULARGE_INTEGER cur_FT);
+	};
+
+}
@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "TransferFunction.h"
+
+namespace movepoint {
+
+	//1/log(r+2) sampled at the control points, so the balanced profile matches the old formula
+	static const CurvePoint offAxisPoints[] = {
+		{ 0, 1.4427f }, { 0.25f, 1.2332f }, { 0.5f, 1.0914f }, { 1, 0.9102f }, { 1.5f, 0.7982f }, { 2, 0.7213f },
+		{ 3, 0.6213f }, { 4, 0.5581f }, { 6, 0.4809f }, { 8, 0.4343f }, { 11, 0.3899f }, { 15, 0.3530f },
+		{ 20, 0.3235f }, { 30, 0.2885f }, { 45, 0.2597f }, { 60, 0.2423f }, { 80, 0.2269f }, { 100, 0.2162f }
+	};
+
+	//max(1, z/70)
+	static const CurvePoint depthPoints[] = {
+		{ 0, 1 }, { 70, 1 }, { 400, 5.7143f }
+	};
+
+	static const CurvePoint speedPrecise[] = {
+		{ 0, 0.3f }, { 10, 0.5f }, { 30, 1 }, { 60, 1.2f }
+	};
+	static const CurvePoint speedBalanced[] = {
+		{ 0, 1 }, { 60, 1 }
+	};
+	static const CurvePoint speedFast[] = {
+		{ 0, 1 }, { 10, 1.5f }, { 40, 3 }, { 80, 4 }
+	};
+
+	#define NUM_POINTS(a) (sizeof(a) / sizeof(a[0]))
+
+	void TransferCurve::bake(const CurvePoint * points, int numPoints) {
+		inMin = points[0].in;
+		float step = (points[numPoints - 1].in - inMin) / lutSize;
+		invStep = (step > 0 ? 1 / step : 0);
+
+		int seg = 0;
+		for (int i = 0; i <= lutSize; i++) {
+			float x = inMin + i * step;
+			while (seg < numPoints - 2 && x > points[seg + 1].in) seg++;
+
+			if (numPoints == 1) {
+				lut[i] = points[0].out;
+			}
+			else {
+				const CurvePoint & a = points[seg];
+				const CurvePoint & b = points[seg + 1];
+				float f = (b.in > a.in ? (x - a.in) / (b.in - a.in) : 0);
+				lut[i] = a.out + (b.out - a.out) * max(min(f, 1), 0);
+			}
+		}
+	}
+
+	TransferFunction::TransferFunction() {
+		offAxisCurve.bake(offAxisPoints, NUM_POINTS(offAxisPoints));
+		depthCurve.bake(depthPoints, NUM_POINTS(depthPoints));
+		setProfile(PROFILE_BALANCED);
+	}
+
+	void TransferFunction::setProfile(pointerProfile newProfile) {
+		switch (newProfile) {
+		case PROFILE_PRECISE:
+			speedCurve.bake(speedPrecise, NUM_POINTS(speedPrecise));
+			break;
+		case PROFILE_FAST:
+			speedCurve.bake(speedFast, NUM_POINTS(speedFast));
+			break;
+		default:
+			newProfile = PROFILE_BALANCED;
+			speedCurve.bake(speedBalanced, NUM_POINTS(speedBalanced));
+			break;
+		}
+		profile = newProfile;
+	}
+
+	pointerProfile TransferFunction::getProfile() const {
+		return profile;
+	}
+
+	#undef NUM_POINTS
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	enum pointerProfile
+	{
+		PROFILE_PRECISE = 0,					//Heavy smoothing for slow movements
+		PROFILE_BALANCED = 1,					//Same response as the original distance weighting
+		PROFILE_FAST = 2						//Little smoothing once the hand moves quickly
+	};
+
+	struct CurvePoint
+	{
+		float in, out;
+	};
+
+	//Piecewise-linear curve through control points, baked into a lookup table
+	class TransferCurve
+	{
+		static const int lutSize = 256;
+
+		float lut[lutSize + 1];
+		float inMin = 0;
+		float invStep = 1;
+
+	public:
+		void bake(const CurvePoint * points, int numPoints);
+
+		inline float eval(float x) const {
+			float t = max(min((x - inMin) * invStep, (float)lutSize), 0);
+			int i = min((int)t, lutSize - 1);
+			return lut[i] + (lut[i + 1] - lut[i]) * (t - i);
+		}
+	};
+
+	/* Gain applied to the cursor blend weights in moveCursor, as a function of hand speed
+	and of where the controller is relative to the camera. */
+	class TransferFunction
+	{
+		TransferCurve speedCurve, depthCurve, offAxisCurve;
+		pointerProfile profile = PROFILE_BALANCED;
+
+	public:
+		TransferFunction();
+		void setProfile(pointerProfile newProfile);
+		pointerProfile getProfile() const;
+
+		//Speed in position units per second
+		inline float speedGain(float speed) const {
+			return speedCurve.eval(speed);
+		}
+
+		//Replaces distWeight = 1/log(max(|x|,|y|)+2) * max(1, z/70)
+		inline float distanceGain(Move::Vec3 pos) const {
+			return min(offAxisCurve.eval(max(fabs(pos.x), fabs(pos.y))) * depthCurve.eval(pos.z), 1);
+		}
+	};
+
+}
@@ -0,0 +1,248 @@
+#include "stdafx.h"
+#include "VirtualDesktops.h"
+#include "win_actions.h"
+
+#include <process.h>
+#include <objbase.h>
+
+using namespace win_actions;
+
+namespace movepoint {
+
+	//Undocumented shell interfaces, as laid out from Windows 10 1809 up to Windows 11
+	static const CLSID CLSID_ImmersiveShell = { 0xC2F03A33, 0x21F5, 0x47FA, { 0xB4, 0xBB, 0x15, 0x63, 0x62, 0xA2, 0xF2, 0x39 } };
+	static const GUID SID_VirtualDesktopManagerInternal = { 0xC5E0CDCA, 0x7B6E, 0x41B2, { 0x9F, 0xC4, 0xD9, 0x39, 0x75, 0xCC, 0x46, 0x7B } };
+	static const IID IID_IVirtualDesktopManagerInternal = { 0xF31574D6, 0xB682, 0x4CDC, { 0xBD, 0x56, 0x18, 0x27, 0x86, 0x0A, 0xBE, 0xC6 } };
+	static const IID IID_IApplicationViewCollection = { 0x1841C6D7, 0x4F9D, 0x42C0, { 0xAF, 0x41, 0x87, 0x47, 0x53, 0x8F, 0x10, 0xE5 } };
+
+	enum adjacentDesktop
+	{
+		ADJACENT_LEFT = 3,
+		ADJACENT_RIGHT = 4
+	};
+
+	struct IVirtualDesktop : public IUnknown
+	{
+		virtual HRESULT STDMETHODCALLTYPE IsViewVisible(IUnknown* view, int* visible) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetID(GUID* id) = 0;
+	};
+
+	struct IVirtualDesktopManagerInternal : public IUnknown
+	{
+		virtual HRESULT STDMETHODCALLTYPE GetCount(UINT* count) = 0;
+		virtual HRESULT STDMETHODCALLTYPE MoveViewToDesktop(IUnknown* view, IVirtualDesktop* desktop) = 0;
+		virtual HRESULT STDMETHODCALLTYPE CanViewMoveDesktops(IUnknown* view, int* canMove) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetCurrentDesktop(IVirtualDesktop** desktop) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetDesktops(IUnknown** desktops) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetAdjacentDesktop(IVirtualDesktop* from, int direction, IVirtualDesktop** desktop) = 0;
+		virtual HRESULT STDMETHODCALLTYPE SwitchDesktop(IVirtualDesktop* desktop) = 0;
+		virtual HRESULT STDMETHODCALLTYPE CreateDesktopW(IVirtualDesktop** desktop) = 0;
+		virtual HRESULT STDMETHODCALLTYPE RemoveDesktop(IVirtualDesktop* desktop, IVirtualDesktop* fallback) = 0;
+		virtual HRESULT STDMETHODCALLTYPE FindDesktop(const GUID* id, IVirtualDesktop** desktop) = 0;
+	};
+
+	struct IApplicationViewCollection : public IUnknown
+	{
+		virtual HRESULT STDMETHODCALLTYPE GetViews(IUnknown** views) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetViewsByZOrder(IUnknown** views) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetViewsByAppUserModelId(PCWSTR id, IUnknown** views) = 0;
+		virtual HRESULT STDMETHODCALLTYPE GetViewForHwnd(HWND hWnd, IUnknown** view) = 0;
+	};
+
+	//GetVersionEx reports 6.2 to programs without a manifest, so ask ntdll
+	typedef LONG(WINAPI *RtlGetVersionFn)(OSVERSIONINFOW* info);
+
+	static DWORD windowsBuild() {
+		HMODULE ntdll = GetModuleHandle(TEXT("ntdll.dll"));
+		RtlGetVersionFn pRtlGetVersion = (ntdll != NULL ? (RtlGetVersionFn)GetProcAddress(ntdll, "RtlGetVersion") : NULL);
+		if (pRtlGetVersion == NULL) return 0;
+
+		OSVERSIONINFOW info;
+		ZeroMemory(&info, sizeof(info));
+		info.dwOSVersionInfoSize = sizeof(info);
+		if (pRtlGetVersion(&info) != 0) return 0;
+		return info.dwBuildNumber;
+	}
+
+	VirtualDesktops::~VirtualDesktops() {
+		stop();
+	}
+
+	BOOL VirtualDesktops::start() {
+		if (hThread != NULL) return true;
+
+		hReady = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		threadId = thread_id;
+
+		//Wait for the message queue, so posted commands are not lost
+		if (hThread != NULL) WaitForSingleObject(hReady, INFINITE);
+		CloseHandle(hReady);
+		hReady = NULL;
+
+		return hThread != NULL;
+	}
+
+	void VirtualDesktops::stop() {
+		if (hThread == NULL) return;
+
+		PostThreadMessage(threadId, WM_QUIT, 0, 0);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		hThread = NULL;
+	}
+
+	//Any thread. Returns at once; the desktop thread does the work.
+	void VirtualDesktops::post(desktopCommand command, HWND hWnd) {
+		if (hThread == NULL || !PostThreadMessage(threadId, WM_APP, command, (LPARAM)hWnd)) {
+			runChord(command);
+		}
+	}
+
+	bool VirtualDesktops::connect() {
+		if (manager != nullptr) return true;
+
+		DWORD build = windowsBuild();
+		if (build < desktopMinBuild || build > desktopMaxBuild) return false;
+
+		if (FAILED(CoCreateInstance(CLSID_ImmersiveShell, NULL, CLSCTX_LOCAL_SERVER, __uuidof(IServiceProvider), (void**)&shell))) {
+			shell = nullptr;
+			return false;
+		}
+		if (FAILED(shell->QueryService(SID_VirtualDesktopManagerInternal, IID_IVirtualDesktopManagerInternal, (void**)&manager))) manager = nullptr;
+		if (FAILED(shell->QueryService(IID_IApplicationViewCollection, IID_IApplicationViewCollection, (void**)&views))) views = nullptr;
+
+		if (manager == nullptr) {
+			disconnect();
+			return false;
+		}
+		InterlockedExchange(&available, 1);
+		return true;
+	}
+
+	void VirtualDesktops::disconnect() {
+		if (views != nullptr) views->Release();
+		if (manager != nullptr) manager->Release();
+		if (shell != nullptr) shell->Release();
+		views = nullptr;
+		manager = nullptr;
+		shell = nullptr;
+		InterlockedExchange(&available, 0);
+	}
+
+	HRESULT VirtualDesktops::runShell(desktopCommand command, HWND hWnd) {
+		IVirtualDesktop* current = nullptr;
+		IVirtualDesktop* other = nullptr;
+		IUnknown* view = nullptr;
+		HRESULT hr = manager->GetCurrentDesktop(&current);
+		if (FAILED(hr)) return hr;
+
+		switch (command) {
+		case DESKTOP_NEXT:
+		case DESKTOP_PREV:
+			hr = manager->GetAdjacentDesktop(current, command == DESKTOP_NEXT ? ADJACENT_RIGHT : ADJACENT_LEFT, &other);
+			if (SUCCEEDED(hr)) hr = manager->SwitchDesktop(other);
+			else hr = S_FALSE;								//Already at the end
+			break;
+
+		case DESKTOP_NEW:
+			hr = manager->CreateDesktopW(&other);
+			if (SUCCEEDED(hr)) hr = manager->SwitchDesktop(other);
+			break;
+
+		case DESKTOP_REMOVE:
+			//Windows on the removed desktop go to its left neighbour, or the right one for the first desktop
+			hr = manager->GetAdjacentDesktop(current, ADJACENT_LEFT, &other);
+			if (FAILED(hr)) hr = manager->GetAdjacentDesktop(current, ADJACENT_RIGHT, &other);
+			if (SUCCEEDED(hr)) hr = manager->RemoveDesktop(current, other);
+			else hr = S_FALSE;								//The last desktop stays
+			break;
+
+		case DESKTOP_CARRY_NEXT:
+		case DESKTOP_CARRY_PREV:
+			hr = manager->GetAdjacentDesktop(current, command == DESKTOP_CARRY_NEXT ? ADJACENT_RIGHT : ADJACENT_LEFT, &other);
+			if (FAILED(hr)) {
+				hr = S_FALSE;
+				break;
+			}
+			if (hWnd != NULL && views != nullptr && SUCCEEDED(views->GetViewForHwnd(hWnd, &view))) {
+				manager->MoveViewToDesktop(view, other);		//Some windows cannot move; switch anyway
+			}
+			hr = manager->SwitchDesktop(other);
+			break;
+		}
+
+		if (view != nullptr) view->Release();
+		if (other != nullptr) other->Release();
+		current->Release();
+		return hr;
+	}
+
+	//The keyboard shortcuts for the same thing. A window cannot be carried this way, only the desktop switched.
+	void VirtualDesktops::runChord(desktopCommand command) {
+		switch (command) {
+		case DESKTOP_NEXT:
+		case DESKTOP_CARRY_NEXT:
+			nextDesktop();
+			break;
+		case DESKTOP_PREV:
+		case DESKTOP_CARRY_PREV:
+			prevDesktop();
+			break;
+		case DESKTOP_NEW:
+			newDesktop();
+			break;
+		case DESKTOP_REMOVE:
+			killDesktop();
+			break;
+		}
+		chordCount++;
+	}
+
+	void VirtualDesktops::run(desktopCommand command, HWND hWnd) {
+		if (connect()) {
+			HRESULT hr = runShell(command, hWnd);
+			if (FAILED(hr)) {
+				//Explorer may have restarted since the last command
+				disconnect();
+				if (connect()) hr = runShell(command, hWnd);
+			}
+			if (SUCCEEDED(hr)) {
+				apiCount++;
+				return;
+			}
+		}
+		runChord(command);
+	}
+
+	unsigned int __stdcall VirtualDesktops::threadProc(void *p_thread_data) {
+		VirtualDesktops* self = static_cast<VirtualDesktops*>(p_thread_data);
+
+		CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+
+		MSG msg;
+		PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);		//Creates the message queue
+		self->connect();
+		SetEvent(self->hReady);
+
+		while (GetMessage(&msg, NULL, 0, 0) > 0) {
+			if (msg.message == WM_APP && msg.hwnd == NULL) {
+				self->run((desktopCommand)msg.wParam, (HWND)msg.lParam);
+				continue;
+			}
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+
+		self->disconnect();
+		CoUninitialize();
+		return 0;
+	}
+
+	void VirtualDesktops::print() const {
+		printf("DESKTOPS shell api:%d  by api:%lu  by shortcut:%lu\n", (int)available, apiCount, chordCount);
+	}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "stdafx.h"
+
+#include <servprov.h>
+
+namespace movepoint {
+
+	//Default values
+	const DWORD desktopMinBuild = 17763;		//Windows 10 1809: first build with the interface layout below
+	const DWORD desktopMaxBuild = 21999;		//Windows 11 changed the interfaces again
+
+	enum desktopCommand
+	{
+		DESKTOP_NEXT = 0,					//The desktop to the right
+		DESKTOP_PREV = 1,
+		DESKTOP_NEW = 2,
+		DESKTOP_REMOVE = 3,					//The current one; its windows go to the neighbour
+		DESKTOP_CARRY_NEXT = 4,				//Move a window to the desktop to the right and follow it
+		DESKTOP_CARRY_PREV = 5
+	};
+
+	struct IVirtualDesktopManagerInternal;
+	struct IApplicationViewCollection;
+
+	/* Virtual desktops through the shell's desktop manager. The manager the shell uses
+	itself is reached through the immersive shell's service provider; it is undocumented
+	and its layout changes between Windows versions, so it is only used on the builds it
+	is known for. Everywhere else, and whenever a call fails, the same keyboard shortcut
+	is sent as one SendInput call, so it is applied whole or not at all.
+
+	COM objects belong to the thread that made them, so a worker thread with its own
+	message loop owns them and carries out the commands posted to it. Explorer restarting
+	drops the connection; the next command connects again. */
+	class VirtualDesktops
+	{
+		HANDLE hThread = NULL;
+		HANDLE hReady = NULL;
+		DWORD threadId = 0;
+		volatile LONG available = 0;
+
+		//Desktop thread only
+		IServiceProvider* shell = nullptr;
+		IVirtualDesktopManagerInternal* manager = nullptr;
+		IApplicationViewCollection* views = nullptr;
+		unsigned long apiCount = 0;
+		unsigned long chordCount = 0;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+		bool connect();
+		void disconnect();
+		HRESULT runShell(desktopCommand command, HWND hWnd);
+		void runChord(desktopCommand command);
+		void run(desktopCommand command, HWND hWnd);
+
+	public:
+		~VirtualDesktops();
+		BOOL start();
+		void stop();
+		void post(desktopCommand command, HWND hWnd = NULL);
+		inline bool isAvailable() const { return available != 0; }
+		void print() const;
+	};
+
+}
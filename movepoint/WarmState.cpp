@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "WarmState.h"
+
+#include <process.h>
+#include <setupapi.h>
+#include <vector>
+#include <algorithm>
+
+namespace movepoint {
+
+	static const DWORD warmMagic = 0x4D525757;				//'WWRM'
+	static const DWORD warmVersion = 1;
+
+	//Hardware IDs of the PS Move controller over USB and over Bluetooth, where the vendor id is written
+	//VID&0002054C after the HID service GUID, and of the PS Eye camera
+	static const char* const warmDevices[] = { "VID_054C&PID_03D5", "VID&0002054C_PID&03D5", "VID_8888&PID_0508", "VID_1415&PID_2000" };
+
+	//FNV-1a
+	ULONGLONG warmKey(const void* data, size_t size, ULONGLONG seed) {
+		const byte* p = (const byte*)data;
+		ULONGLONG h = seed;
+		for (size_t i = 0; i < size; i++) {
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	WarmState::~WarmState() {
+		stop();
+		if (view != nullptr) UnmapViewOfFile(view);
+		if (hMapping != NULL) CloseHandle(hMapping);
+		if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+	}
+
+	/* Instance IDs of the controllers and camera that are plugged in or paired. The BTHENUM
+	node of a paired controller ends in its Bluetooth address, and a USB device's ID carries
+	its port, so another controller or the camera on another port gives another key. */
+	ULONGLONG WarmState::deviceKey() {
+		std::vector<std::string> ids;
+		HDEVINFO devs = SetupDiGetClassDevs(NULL, NULL, NULL, DIGCF_ALLCLASSES | DIGCF_PRESENT);
+		if (devs == INVALID_HANDLE_VALUE) return 0;
+
+		SP_DEVINFO_DATA info;
+		info.cbSize = sizeof(info);
+		char id[MAX_DEVICE_ID_LEN];
+		for (DWORD i = 0; SetupDiEnumDeviceInfo(devs, i, &info); i++) {
+			if (!SetupDiGetDeviceInstanceIdA(devs, &info, id, sizeof(id), NULL)) continue;
+			_strupr_s(id, sizeof(id));
+			for (int k = 0; k < sizeof(warmDevices) / sizeof(warmDevices[0]); k++) {
+				if (strstr(id, warmDevices[k]) != NULL) ids.push_back(id);
+			}
+		}
+		SetupDiDestroyDeviceInfoList(devs);
+
+		//Enumeration order is not guaranteed
+		std::sort(ids.begin(), ids.end());
+		ULONGLONG h = warmKey(NULL, 0);
+		for (size_t i = 0; i < ids.size(); i++) h = warmKey(ids[i].c_str(), ids[i].size() + 1, h);
+		return h;
+	}
+
+	//%LOCALAPPDATA%\MOVEpoint\warmstate.bin, created if missing
+	BOOL WarmState::open() {
+		if (view != nullptr) return true;
+
+		char path[MAX_PATH];
+		DWORD len = GetEnvironmentVariableA("LOCALAPPDATA", path, MAX_PATH);
+		if (len == 0 || len > MAX_PATH - 32) return false;
+		strcat_s(path, "\\MOVEpoint");
+		CreateDirectoryA(path, NULL);
+		strcat_s(path, "\\warmstate.bin");
+
+		hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == INVALID_HANDLE_VALUE) return false;
+
+		//A new or short file is extended with zeros, which no record accepts
+		hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE, 0, sizeof(File), NULL);
+		if (hMapping != NULL) view = (File*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(File));
+		if (view == nullptr) return false;
+
+		devices = deviceKey();
+		sequence = max(view->records[0].sequence, view->records[1].sequence);
+		return true;
+	}
+
+	DWORD WarmState::checksum(const Record & r) {
+		return (DWORD)warmKey(&r, offsetof(Record, checksum));
+	}
+
+	//Startup, before the sensor thread runs. Picks the newest intact record made with these devices and calibration.
+	bool WarmState::restore(ULONGLONG calibration, WarmData & out) {
+		if (view == nullptr || devices == 0) return false;
+
+		ULONGLONG want = warmKey(&calibration, sizeof(calibration), devices);
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		ULONGLONG nowTicks = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+
+		const Record* best = nullptr;
+		for (int i = 0; i < 2; i++) {
+			const Record & r = view->records[i];
+			if (r.magic != warmMagic || r.version != warmVersion || r.key != want || r.checksum != checksum(r)) continue;
+
+			ULONGLONG written = ((ULONGLONG)r.written.dwHighDateTime << 32) | r.written.dwLowDateTime;
+			if (written > nowTicks || (nowTicks - written) / 600000000ULL > warmMaxAgeMin_d) continue;	//100 ns ticks per minute
+			if (best == nullptr || r.sequence - best->sequence > 0) best = &r;
+		}
+		if (best == nullptr) return false;
+
+		CopyMemory(&out, &best->data, sizeof(out));
+		restored = true;
+		return true;
+	}
+
+	BOOL WarmState::start() {
+		if (hThread != NULL) return true;
+		if (view == nullptr) return false;
+
+		hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+		unsigned int thread_id = 0;
+		hThread = (HANDLE)_beginthreadex(NULL, 0, threadProc, this, 0, &thread_id);
+		return hThread != NULL;
+	}
+
+	//Writes one last checkpoint on the way out
+	void WarmState::stop() {
+		if (hThread == NULL) return;
+
+		//The last checkpoint writes the view, which the destructor unmaps
+		SetEvent(hStop);
+		WaitForSingleObject(hThread, INFINITE);
+		CloseHandle(hThread);
+		CloseHandle(hStop);
+		hThread = hStop = NULL;
+	}
+
+	//Sensor thread. Never waits.
+	void WarmState::update(const WarmData & data) {
+		LONG seq = latestSeq;
+		InterlockedExchange(&latestSeq, seq + 1);
+		latest = data;
+		InterlockedExchange(&latestSeq, seq + 2);
+	}
+
+	//Checkpoint thread. False if there is nothing new, or the sensor thread kept writing.
+	bool WarmState::readLatest(WarmData & out) {
+		for (int tries = 0; tries < 4; tries++) {
+			LONG before = latestSeq;
+			if (before == 0 || before == writtenSeq) return false;
+			if (before & 1) {
+				Sleep(0);
+				continue;
+			}
+			out = latest;
+			MemoryBarrier();
+			if (latestSeq == before) {
+				writtenSeq = before;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WarmState::checkpoint() {
+		Record r;
+		ZeroMemory(&r, sizeof(r));
+		if (!readLatest(r.data)) return;
+
+		r.magic = warmMagic;
+		r.version = warmVersion;
+		r.sequence = ++sequence;
+		r.key = warmKey(&r.data.calibration, sizeof(r.data.calibration), devices);
+		GetSystemTimeAsFileTime(&r.written);
+		r.checksum = checksum(r);
+
+		//Byte for byte, padding included, as the checksum was taken
+		CopyMemory(&view->records[sequence & 1], &r, sizeof(r));
+		checkpointCount++;
+	}
+
+	unsigned int __stdcall WarmState::threadProc(void *p_thread_data) {
+		WarmState* self = static_cast<WarmState*>(p_thread_data);
+
+		while (WaitForSingleObject(self->hStop, warmCheckpointMs_d) == WAIT_TIMEOUT) {
+			self->checkpoint();
+		}
+		self->checkpoint();
+		return 0;
+	}
+
+	void WarmState::print() const {
+		printf("WARM file:%d  restored:%d  checkpoints:%lu  devices:%08lx\n", view != nullptr, restored, checkpointCount, (unsigned long)devices);
+	}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "stdafx.h"
+
+namespace movepoint {
+
+	//Default values
+	const DWORD warmCheckpointMs_d = 2000;		//How often the warm state is written out
+	const DWORD warmMaxAgeMin_d = 24 * 60;		//Older checkpoints are ignored; the room has likely changed
+
+	//What the observer needs to skip warm-up, valid only for the same controllers, camera and calibration
+	struct WarmData
+	{
+		ULONGLONG calibration;					//warmKey() of the calibration the state was built on
+		Move::Quat avgOrient;					//Orientation baseline
+		bool haveOrient;
+		Move::Vec3 avgPos;						//Moving average
+		Move::Vec3 noiseSigma;					//Noise floor, if estimated
+		long noiseEstimates;
+	};
+
+	ULONGLONG warmKey(const void* data, size_t size, ULONGLONG seed = 14695981039346656037ULL);
+
+	/* Keeps the observer's runtime state across a process restart. The sensor thread hands
+	over its latest state every frame through a sequence lock, which never waits and never
+	touches the disk. A background thread copies it into a memory-mapped file every couple
+	of seconds. Dirty pages of a mapped file belong to the system, so they reach the disk
+	even when the process is killed a moment later.
+
+	The file has two records written in turn, each with a sequence number and checksum, so
+	a write cut short leaves the other one intact. A record is only used if its key matches
+	the controllers, camera and calibration in use now. */
+	class WarmState
+	{
+		struct Record
+		{
+			DWORD magic;
+			DWORD version;
+			LONG sequence;
+			ULONGLONG key;
+			FILETIME written;
+			WarmData data;
+			DWORD checksum;
+		};
+
+		struct File
+		{
+			Record records[2];
+		};
+
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+		HANDLE hMapping = NULL;
+		File* view = nullptr;
+		ULONGLONG devices = 0;					//Key of the controllers and camera present at start
+
+		HANDLE hThread = NULL;
+		HANDLE hStop = NULL;
+
+		//Sequence lock: odd while the sensor thread is writing latest
+		volatile LONG latestSeq = 0;
+		WarmData latest;
+
+		//Checkpoint thread only
+		LONG writtenSeq = 0;
+		LONG sequence = 0;
+		unsigned long checkpointCount = 0;
+		bool restored = false;
+
+		static unsigned int __stdcall threadProc(void *p_thread_data);
+		static DWORD checksum(const Record & r);
+		static ULONGLONG deviceKey();
+		bool readLatest(WarmData & out);
+		void checkpoint();
+
+	public:
+		~WarmState();
+		BOOL open();
+		bool restore(ULONGLONG calibration, WarmData & out);
+		BOOL start();
+		void stop();
+		void update(const WarmData & data);
+		void print() const;
+	};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
-#include "MoveIncludes.h"
+#include "MoveConfig.h"
+#include <cmath>
 
 namespace Move
 {
@@ -2,6 +2,7 @@
 
 #include "stdafx.h"
 #include "MoveObserver.h""
+#include "EyeBenchmark.h"
 
 //Move class
 MoveObserver* observer;
@@ -22,12 +23,44 @@ bool duplicateExist() {
 
 }
 
+//shcore.dll only exists on Windows 8.1 and later, so load it dynamically
+typedef HRESULT(WINAPI *SetProcessDpiAwarenessFn)(int value);
+
+//Physical pixels everywhere, otherwise mixed-DPI layouts come back scaled. Must come before any window or monitor call.
+void setDpiAwareness() {
+	HMODULE shcore = LoadLibrary(TEXT("shcore.dll"));
+	SetProcessDpiAwarenessFn pSetAwareness = (shcore != NULL ? (SetProcessDpiAwarenessFn)GetProcAddress(shcore, "SetProcessDpiAwareness") : NULL);
+	if (pSetAwareness != NULL) {
+		pSetAwareness(2);		//PROCESS_PER_MONITOR_DPI_AWARE
+	}
+	else {
+		SetProcessDPIAware();
+	}
+}
+
+//Closing the console, logoff and shutdown end the process without returning from main
+BOOL WINAPI consoleHandler(DWORD ctrlType) {
+	win_actions::releaseInput();
+	return FALSE;
+}
+
 
 int main(int argc, char* argv[])
 {
+	setDpiAwareness();
+
+	//Benchmark mode does not need the controllers
+	for (int count = 1; count < argc; count++) {
+		if (std::string(argv[count]) == "-bench") {
+			runEyeBenchmark();
+			return 0;
+		}
+	}
+
 	if (!duplicateExist()) {
 		//only run if there isn't a duplicate
 		observer = new MoveObserver();
+		SetConsoleCtrlHandler(consoleHandler, TRUE);
 
 		int count;
 		for (count = 0; count < argc; count++) {
@@ -42,10 +75,27 @@ int main(int argc, char* argv[])
 				observer->extraStableY(true);
 				printf("Command line settings: Extra stable Y \n");
 			}
+			else if (curArg == "-precise") {
+				observer->setCursorProfile(PROFILE_PRECISE);
+				printf("Command line settings: Precise pointer profile \n");
+			}
+			else if (curArg == "-fast") {
+				observer->setCursorProfile(PROFILE_FAST);
+				printf("Command line settings: Fast pointer profile \n");
+			}
+			else if (curArg == "-median") {
+				observer->setOutlierFilter(OUTLIER_MEDIAN);
+				printf("Command line settings: Sliding median pre-filter \n");
+			}
+			else if (curArg == "-hampel") {
+				observer->setOutlierFilter(OUTLIER_HAMPEL);
+				printf("Command line settings: Hampel pre-filter \n");
+			}
 		}
 
 
 		getchar();
+		win_actions::releaseInput();
 
 	}
 
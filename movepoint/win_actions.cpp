@@ -3,35 +3,46 @@
 
 namespace win_actions {
 
+	//Injected keys and mouse buttons still down, by virtual key. Any thread may press or release.
+	static volatile LONG held[256];
+
 	//Keypress subroutine
 	void keyPress(byte bVk, byte keyState)
 	{
 		if (keyState == 1) {
+			InterlockedExchange(&held[bVk], 1);
 			keybd_event(bVk, 0, 0, 0);
 		}
 		else {
 			keybd_event(bVk, 0, KEYEVENTF_KEYUP, 0);
+			InterlockedExchange(&held[bVk], 0);
 		}
 	}
 
 	void mousePress(byte button, byte keyState) {
 
 		DWORD myMButton = -1;
+		byte bVk = 0;
 
 		switch (button) {
 		case 1:
 			myMButton = (keyState == 1 ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP);
+			bVk = VK_LBUTTON;
 			break;
 		case 2:
 			myMButton = (keyState == 1 ? MOUSEEVENTF_MIDDLEDOWN : MOUSEEVENTF_MIDDLEUP);
+			bVk = VK_MBUTTON;
 			break;
 		case 3:
 			myMButton = (keyState == 1 ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP);
+			bVk = VK_RBUTTON;
 			break;
 		}
 
 		if (myMButton != -1) {
+			if (keyState == 1) InterlockedExchange(&held[bVk], 1);
 			mouse_event(myMButton, 0, 0, 0, 0);
+			if (keyState != 1) InterlockedExchange(&held[bVk], 0);
 		}
 	}
 
@@ -80,52 +91,116 @@ namespace win_actions {
 		return TRUE;
 	}
 
+	//Presses the keys in order and releases them in reverse, all in one SendInput call.
+	//Nothing can come in between, and if the input is blocked none of it goes through, so no key is left down.
+	UINT keyChord(const byte* keys, int count) {
+		INPUT inputs[2 * maxChordKeys];
+		if (count <= 0 || count > maxChordKeys) return 0;
+
+		ZeroMemory(inputs, sizeof(inputs));
+		for (int i = 0; i < count; i++) {
+			inputs[i].type = INPUT_KEYBOARD;
+			inputs[i].ki.wVk = keys[i];
+			inputs[2 * count - 1 - i].type = INPUT_KEYBOARD;
+			inputs[2 * count - 1 - i].ki.wVk = keys[i];
+			inputs[2 * count - 1 - i].ki.dwFlags = KEYEVENTF_KEYUP;
+		}
+		return SendInput(2 * count, inputs, sizeof(INPUT));
+	}
+
+	static bool isModifier(byte bVk) {
+		return bVk == VK_SHIFT || bVk == VK_CONTROL || bVk == VK_MENU || bVk == VK_LWIN || bVk == VK_RWIN;
+	}
+
+	bool isHeld(byte bVk) {
+		return held[bVk] != 0;
+	}
+
+	//Fills keys with what is held down and returns how many
+	int heldInput(byte* keys, int size) {
+		int count = 0;
+		for (int vk = 1; vk < 256 && count < size; vk++) {
+			if (held[vk] != 0) keys[count++] = (byte)vk;
+		}
+		return count;
+	}
+
+	//For a key something else has already released
+	void forgetInput(byte bVk) {
+		InterlockedExchange(&held[bVk], 0);
+	}
+
+	/* Releases everything still held down in one SendInput call: mouse buttons and keys
+	first, modifiers last, so a released key is never seen with a modifier it did not have.
+	Each key is claimed before it is released, so a key is never released twice even if
+	two threads get here at once. Returns the number of keys and buttons released. */
+	UINT releaseInput() {
+		INPUT inputs[256];
+		UINT count = 0;
+		ZeroMemory(inputs, sizeof(inputs));
+
+		for (int pass = 0; pass < 2; pass++) {
+			for (int vk = 1; vk < 256; vk++) {
+				if (isModifier((byte)vk) != (pass == 1) || held[vk] == 0) continue;
+				if (InterlockedExchange(&held[vk], 0) == 0) continue;
+
+				INPUT & in = inputs[count++];
+				switch (vk) {
+				case VK_LBUTTON:
+					in.type = INPUT_MOUSE;
+					in.mi.dwFlags = MOUSEEVENTF_LEFTUP;
+					break;
+				case VK_MBUTTON:
+					in.type = INPUT_MOUSE;
+					in.mi.dwFlags = MOUSEEVENTF_MIDDLEUP;
+					break;
+				case VK_RBUTTON:
+					in.type = INPUT_MOUSE;
+					in.mi.dwFlags = MOUSEEVENTF_RIGHTUP;
+					break;
+				default:
+					in.type = INPUT_KEYBOARD;
+					in.ki.wVk = (WORD)vk;
+					in.ki.dwFlags = KEYEVENTF_KEYUP;
+				}
+			}
+		}
+		if (count > 0) SendInput(count, inputs, sizeof(INPUT));
+		return count;
+	}
+
 	void showDesktop() {
-		keyPress(VK_LWIN, 1);
-		keyboardClick(68);		//'D'
-		keyPress(VK_LWIN, 0);
+		const byte keys[] = { VK_LWIN, 68 };		//'D'
+		keyChord(keys, 2);
 	}
 
 	void showTaskView() {
-		keyPress(VK_LWIN, 1);
-		keyboardClick(VK_TAB);
-		keyPress(VK_LWIN, 0);
+		const byte keys[] = { VK_LWIN, VK_TAB };
+		keyChord(keys, 2);
 	}
 
 	//only works for Windows 10
 	void newDesktop() {
-		keyPress(VK_LWIN, 1);
-		keyPress(VK_CONTROL, 1);
-		keyboardClick(68);		//'D'
-		keyPress(VK_CONTROL, 0);
-		keyPress(VK_LWIN, 0);
+		const byte keys[] = { VK_LWIN, VK_CONTROL, 68 };		//'D'
+		keyChord(keys, 3);
 	}
 
 	//only works for Windows 10
 	void killDesktop() {
-		keyPress(VK_LWIN, 1);
-		keyPress(VK_CONTROL, 1);
-		keyboardClick(VK_F4);
-		keyPress(VK_CONTROL, 0);
-		keyPress(VK_LWIN, 0);
+		const byte keys[] = { VK_LWIN, VK_CONTROL, VK_F4 };
+		keyChord(keys, 3);
 	}
 
 	//only works for Windows 10
 	void prevDesktop() {
-		keyPress(VK_LWIN, 1);
-		keyPress(VK_CONTROL, 1);
-		keyboardClick(VK_LEFT);
-		keyPress(VK_CONTROL, 0);
-		keyPress(VK_LWIN, 0);
+		const byte keys[] = { VK_LWIN, VK_CONTROL, VK_LEFT };
+		keyChord(keys, 3);
 	}
 
 	//only works for Windows 10
 	void nextDesktop() {
-		keyPress(VK_LWIN, 1);
-		keyPress(VK_CONTROL, 1);
-		keyboardClick(VK_RIGHT);
-		keyPress(VK_CONTROL, 0);
-		keyPress(VK_LWIN, 0);
+		const byte keys[] = { VK_LWIN, VK_CONTROL, VK_RIGHT };
+		keyChord(keys, 3);
 	}
 
 	//Get handle to the window below cursor and send it to foreground
@@ -244,4 +319,26 @@ namespace win_actions {
 		return retVal;
 	}
 
+	LONG writeStringToReg(HKEY hKey, LPTSTR subkey, const char * value) {
+		return RegSetValueEx(hKey, subkey, 0, REG_SZ, (const BYTE*)value, strlen(value) + 1);
+	}
+
+	LONG readStringFromReg(HKEY hKey, LPTSTR subkey, char * buffer, DWORD size) {
+		//Only overwrite the buffer if the value is available in registry.
+
+		LONG retVal;
+		char tmp[256];
+
+		DWORD sz = sizeof(tmp) - 1;
+		DWORD type = 0;
+		retVal = RegQueryValueEx(hKey, subkey, 0, &type, (BYTE*)tmp, &sz);
+
+		if (retVal == ERROR_SUCCESS && type == REG_SZ) {
+			tmp[min(sz, sizeof(tmp) - 1)] = 0;
+			strncpy(buffer, tmp, size - 1);
+			buffer[size - 1] = 0;
+		}
+		return retVal;
+	}
+
 }
\ No newline at end of file
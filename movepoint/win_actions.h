@@ -12,11 +12,20 @@
 
 namespace win_actions {
 
+	const int maxChordKeys = 4;
+
 	//Keyboard and cursor functions
 	void keyPress(byte bVk, byte keyState);
 	void mousePress(byte button, byte keyState);
 	void mouseClick(byte button);
 	void keyboardClick(byte bVk);
+	UINT keyChord(const byte* keys, int count);
+
+	//Keys and buttons pressed through keyPress and mousePress and not yet released
+	bool isHeld(byte bVk);
+	int heldInput(byte* keys, int size);
+	void forgetInput(byte bVk);
+	UINT releaseInput();
 
 	BOOL amIAdmin();
 	BOOL RunAsAdmin(HWND hWnd, LPTSTR lpFile, LPTSTR lpParameters);
@@ -47,5 +56,7 @@ namespace win_actions {
 	LONG writeFloatToReg(HKEY hKey, LPTSTR subkey, float value);
 	LONG readFloatFromReg(HKEY hKey, LPTSTR subkey, float * vp);
 	DWORD readDWORDFromReg(HKEY hKey, LPTSTR subkey, DWORD * vp);
+	LONG writeStringToReg(HKEY hKey, LPTSTR subkey, const char * value);
+	LONG readStringFromReg(HKEY hKey, LPTSTR subkey, char * buffer, DWORD size);
 
 }
\ No newline at end of file